@@ -1,564 +1,1288 @@
-/*
- * Elevator-Emulator.c
- *
- * Main file
- *
- * Authors: Peter Sutton, Ahmed Baig
- * Modified by Alex Holdcroft
- */ 
-
-/* Definitions */
-
-#define F_CPU 8000000L
-
-/* External Library Includes */
-
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <avr/pgmspace.h>
-#include <stdio.h>
-#include <util/delay.h>
-#include <stdbool.h>
-
-/* Internal Library Includes */
-
-#include "display.h"
-#include "ledmatrix.h"
-#include "buttons.h"
-#include "serialio.h"
-#include "terminalio.h"
-#include "timer0.h"
-
-/* Data Structures */
-
-typedef enum {UNDEF_FLOOR = -1, FLOOR_0=0, FLOOR_1=4, FLOOR_2=8, FLOOR_3=12} ElevatorFloor;
-
-/* Global Variables */
-uint32_t time_since_move;
-ElevatorFloor current_position;
-ElevatorFloor destination;
-uint8_t direction_change;
-uint8_t old_direction_change;
-ElevatorFloor old_floor;
-ElevatorFloor current_floor; // Stores the last floor the elevator visited
-bool traveller_active; // True if there is a traveller waiting or being moved.
-bool traveller_onboard; // True if a traveller is on the elevator.
-ElevatorFloor traveller_floor; // Stores the floor the traveller waits on.
-uint8_t floors_w_traveller = 0; // Counts the total number of floors travelled with a traveller
-uint8_t floors_no_traveller = 0; // Counts the total number of floors travelled without a traveller
-volatile uint8_t digit = 0; // The CC value to be set
-volatile bool floor_just_reached; // True if we just reached a traveller floor and should execute the door animation
-volatile uint8_t animation_phase = 0;   // Records which stage of the LED door animation we are in
-volatile uint16_t animation_timer = 0; // Used to count the progress of the LED door animation
-volatile bool elevator_door_open = false;
-volatile bool button_just_pushed; //True if the placing traveller sound should be played
-volatile uint8_t button_timer; //Counts how long it has been after the button push
-
-/* Internal Function Declarations */
-
-void initialise_hardware(void);
-void start_screen(void);
-void start_elevator_emulator(void);
-void handle_inputs(uint8_t);
-void draw_elevator(void);
-void draw_floors(void);
-void display_information(void);
-void handle_displays(void);
-void handle_seven_seg(uint8_t);
-void start_3kHz_sound(void);
-void start_500Hz_sound(void);
-void stop_sound(void);
-
-/* Main */
-
-int main(void) {
-	// Setup hardware and call backs. This will turn on 
-	// interrupts.
-	initialise_hardware();
-	
-	// Show the splash screen message. Returns when display is complete
-	start_screen();
-	
-	// Start elevator controller software
-	start_elevator_emulator();
-}
-
-/* Internal Function Definitions */
-
-/**
- * @brief All hardware initialisation occurs here
- * @arg none
- * @retval none
-*/
-void initialise_hardware(void) {
-	
-	ledmatrix_setup();
-	init_button_interrupts();
-	// Setup serial port for 19200 baud communication with no echo
-	// of incoming characters
-	init_serial_stdio(19200,0);
-	
-	init_timer0();
-
-	// Set Pin C7, C6, and C5 as inputs
-	DDRC &= ~((1 << PC7)|(1 << PC6)|(1 << PC5));
-
-	// Set Pin C4 as an output, to control the CC
-	DDRC |= (1 << PC4)|(1 << PC3)|(1 << PC2)|(1 << PC1)|(1 << PC0);
-
-	// Set port A pins to be outputs, for the seven segment display
-    DDRA = 0xFF;
-
-	/* Initialise timer/counter 1 so that it reaches the output compare
-	** register value every 1 millisecond, then resets. We need to divide
-	** the 8MHz value by 8, which will give 1000 ticks per ms.
-	*/
-	OCR1A = 499;
-	TCCR1A = 0; // Normal operation, no PWM
-	TCCR1B = (0 << WGM13) | (1 << WGM12) // Two most significant WGM bits
-	| (0 << CS12) | (1 << CS11) | (0 <<CS10); // Divide clock by 8
-
-	// Enable timer/counter1 Output Compare A Match
-	TIMSK1 = (1 << OCIE1A);
-
-	// Clear the flag value
-	TIFR1 = (1 << OCF1A);
-
-	// Configure OC2A, with prescalar 64, Fast PWM mode
-	TCCR2A = (1 << COM2B1)|(1 << WGM21)|(1 << WGM20);
-	TCCR2B = (1 << WGM22)|(1 << CS22);
-
-	// Turn on global interrupts
-	sei();
-}
-
-/**
- * @brief Displays the "EC" start screen with elevator symbol
- * @arg none
- * @retval none
-*/
-void start_screen(void) {
-	// Clear terminal screen and output a message
-	clear_terminal();
-	move_terminal_cursor(10,10);
-	printf_P(PSTR("Elevator Controller"));
-	move_terminal_cursor(10,12);
-	printf_P(PSTR("CSSE2010/7201 project by Alexandra Holdcroft, 48926782"));
-	
-	// Show start screen
-	start_display();
-	
-	// Animation variables
-	uint32_t doors_frame_time = 0;
-	uint32_t interval_delay = 150;
-	uint8_t frame = 0;
-	uint8_t doors_opening_closing = 1; // 1 => opening, 0 => closing
-	
-	// Wait until a button is pressed, or 's' is pressed on the terminal
-	while(1) {
-		
-		// Don't worry about this if/else tree. Its purely for animating
-		// the elevator doors on the start screen
-		if (get_current_time() - doors_frame_time  > interval_delay) {
-			start_display_animation(frame);
-			doors_frame_time   = get_current_time(); // Reset delay until next movement update
-			if (doors_opening_closing) {
-				interval_delay = 150;
-				frame++;
-				if (frame == 1) interval_delay = 2000;
-				if (frame == 3) doors_opening_closing = 0;
-			} else {
-				interval_delay = 150;
-				frame--;
-				if (frame == 2) interval_delay = 500;
-				if (frame == 0) doors_opening_closing = 1;
-			}
-		}
-	
-		// First check for if a 's' is pressed
-		// There are two steps to this
-		// 1) collect any serial input (if available)
-		// 2) check if the input is equal to the character 's'
-		char serial_input = -1;
-		if (serial_input_available()) {
-			serial_input = fgetc(stdin);
-		}
-		// If the serial input is 's', then exit the start screen
-		if (serial_input == 's' || serial_input == 'S') {
-			break;
-		}
-		// Next check for any button presses
-		int8_t btn = button_pushed();
-		if (btn != NO_BUTTON_PUSHED) {
-			break;
-		}
-	}
-}
-
-/**
- * @brief Initialises LED matrix and then starts infinite loop handling elevator
- * @arg none
- * @retval none
-*/
-void start_elevator_emulator(void) {
-	
-	// Clear the serial terminal
-	clear_terminal();
-	hide_cursor();
-	
-	// Initialise Display
-	initialise_display();
-	
-	// Clear a button push or serial input if any are waiting
-	// (The cast to void means the return value is ignored.)
-	(void)button_pushed();
-	clear_serial_input_buffer();
-
-	// Initialise local variables
-	time_since_move = get_current_time();
-	
-	// Draw the floors and elevator
-	draw_elevator();
-	draw_floors();
-
-	// Display the initial information
-	display_information();
-	
-	current_position = FLOOR_0;
-	destination = FLOOR_0;
-	direction_change = 0;
-	old_direction_change = 0;
-	old_floor = FLOOR_0;
-	current_floor = FLOOR_0;
-	traveller_active = false;
-
-	// Set the LEDs with the initial value (doors should be closed)
-	PORTC |= (1 << PC2)|(1 << PC1); 
-	PORTC &= ~((1 << PC0)|(1 << PC3));
-	
-	while(true) {
-		
-		uint16_t speed;
-		if (PINC & (1 << PC7)) {
-			speed = 300;
-		} else {
-			speed = 125;
-		}
-
-		// Only update the elevator every 125/300ms, depending on the speed.
-		if (get_current_time() - time_since_move > speed && !floor_just_reached) {	
-			
-			// Adjust the elevator based on where it needs to go
-			if (destination - current_position > 0) { // Move up
-				current_position++;
-			} else if (destination - current_position < 0) { // Move down
-				current_position--;
-			}
-			
-			// As we have potentially changed the elevator position, lets redraw it
-			draw_elevator();
-			
-			time_since_move = get_current_time(); // Reset delay until next movement update
-		}
-		if (!floor_just_reached) {
-			uint8_t switch_value = PINC & ((1<<PC6)|(1<<PC5)); // Reads input from switches 0 and 1
-			uint8_t floor_choice = switch_value >> 5; // Gives 0, 1, 2 or 3 depending on the switch values
-
-			// Handle any button or key inputs
-			handle_inputs(floor_choice);
-
-			// Upon picking up traveller, set the new destination (must be done before the display is handled)
-			if (traveller_active && traveller_floor == current_position) {
-				destination = (ElevatorFloor)(floor_choice * 4);
-			}
-
-			// Handle the display updates:
-			handle_displays();
-
-			// Tell the animation to begin when reaching the traveller floor
-			if (traveller_active && traveller_floor == current_position) {
-				floor_just_reached = true;
-			}
-
-			// Drop off the traveller (begin the animation and deactivate them)
-			if (traveller_onboard && current_position == destination) {
-				floor_just_reached = true;
-				traveller_onboard = false;
-				traveller_active = false;
-			}
-		}
-		// Take the traveller inside when the doors open
-		if (traveller_active && traveller_floor == current_position && elevator_door_open) {
-			update_square_colour(5, traveller_floor + 1, EMPTY_SQUARE);
-			traveller_onboard = true;
-		}
-	}
-}
-
-ISR(TIMER1_COMPA_vect) {
-	// Handle the seven segment display every 0.5ms (every interrupt)
-		handle_seven_seg(digit);   // Update SSD
-		digit = 1 - digit;         // Toggle between left and right
-
-	// Every 400ms, we want to handle the door display
-	if (floor_just_reached) {
-		animation_timer ++;
-	}
-	if (button_just_pushed) {
-		button_timer ++;
-	}
-	if (button_timer == 1) {
-		start_3kHz_sound();
-	}
-	if (button_timer >= 100) {
-		button_timer = 0;
-		button_just_pushed = false;
-		stop_sound();
-	}
-	switch (animation_phase) {
-		case 0: 
-			// doors should remain the same (closed) for the first 400ms, no need to update
-			if (animation_timer >= 800) {
-				animation_phase = 1;
-				animation_timer = 0;
-			}
-			break;
-		case 1: // open the doors and play the picking up/ dropping off sound
-			if (animation_timer == 1) {
-				PORTC |= (1 << PC0)|(1 << PC3); 
-				PORTC &= ~((1 << PC1)|(1 << PC2));
-				elevator_door_open = true;
-				start_500Hz_sound();
-			}
-			if (animation_timer == 100) { // stop the drop off sound after 50ms
-				stop_sound();
-			}
-			if (animation_timer >= 800) {
-				animation_phase = 2;
-				animation_timer = 0;
-			}
-			break;
-		case 2:
-			if (animation_timer == 1) {
-				PORTC |= (1 << PC1)|(1 << PC2); 
-				PORTC &= ~((1 << PC0)|(1 << PC3));
-				elevator_door_open = false;
-			}
-			if (animation_timer >= 800) {
-				animation_phase = 0;
-				animation_timer = 0;
-				floor_just_reached = false;
-			}
-			break;
-	}
-}
-
-
-/**
- * @brief Draws 4 lines of "FLOOR" coloured pixels
- * @arg none
- * @retval none
-*/
-void draw_floors(void) {
-	for (uint8_t i = 0; i < WIDTH; i++) {
-		update_square_colour(i, FLOOR_0, FLOOR);
-		update_square_colour(i, FLOOR_1, FLOOR);
-		update_square_colour(i, FLOOR_2, FLOOR);
-		update_square_colour(i, FLOOR_3, FLOOR);
-	}
-}
-
-/**
- * @brief Draws the elevator at the current_position
- * @arg none
- * @retval none
-*/
-void draw_elevator(void) {
-	
-	// Store where it used to be with old_position
-	static uint8_t old_position; // static variables maintain their value, every time the function is called
-	
-	int8_t y = 0; // Height position to draw elevator (i.e. y axis)
-	
-	// Clear where the elevator was
-	if (old_position > current_position) { // Elevator going down - clear above
-		y = old_position + 3;
-		} else if (old_position < current_position) { // Elevator going up - clear below
-		y = old_position + 1;
-	}
-	if (y % 4 != 0) { // Do not draw over the floor's LEDs
-		update_square_colour(1, y, EMPTY_SQUARE);
-		update_square_colour(2, y, EMPTY_SQUARE);
-	}
-	old_position = current_position;
-	
-	// Draw a 2x3 block representing the elevator
-	for (uint8_t i = 1; i <= 3; i++) { // 3 is the height of the elevator sprite on the LED matrix
-		y = current_position + i; // Adds current floor position to i=1->3 to draw elevator as 3-high block
-		if (y % 4 != 0) { // Do not draw on the floor
-			update_square_colour(1, y, ELEVATOR);
-			update_square_colour(2, y, ELEVATOR); // Elevator is 2 LEDs wide so draw twice
-		}
-	}
-}
-
-/**
- * @brief Reads btn values and serial input and adds a traveller as appropriate
- * @arg none
- * @retval none
-*/
-void handle_inputs(uint8_t floor_choice) {
-	
-	// We need to check if any button has been pushed
-	uint8_t btn = button_pushed();
-
-	// Additionally check if any serial input has been pressed
-	char serial_input = -1;
-	if (serial_input_available()) {
-		serial_input = fgetc(stdin);
-	}
-	
-	// Check if any elevator destination has been specified, either by buttons or serial input
-	ElevatorFloor floors[] = {FLOOR_0, FLOOR_1, FLOOR_2, FLOOR_3};
-	uint16_t colours[] = {TRAVELLER_TO_0, TRAVELLER_TO_1, TRAVELLER_TO_2, TRAVELLER_TO_3};
-
-	// i is the floor the traveller is being placed
-	// floor choice is the floor the traveller wants to go
-	for (int i = 0; i < 4; i++) {
-		if (btn == i || serial_input == '0' + i) {
-			if (!traveller_active && i != floor_choice) {
-				destination = floors[i];
-				update_square_colour(5, 4*i + 1, colours[floor_choice]);
-				traveller_active = true;
-				traveller_floor = destination;
-				button_just_pushed = true;
-			}
-		}
-	}
-}
-
-void handle_displays(void) {
-	bool floor_changed;
-	
-	// Check the direction
-	direction_change = destination - current_position;
-
-	// Update the current floor
-	if (current_position == FLOOR_0 || current_position == FLOOR_1 || current_position == FLOOR_2 
-		|| current_position == FLOOR_3) {
-		current_floor = current_position;
-	}
-
-	// Check whether the elevator has changed_floors
-	floor_changed = old_floor != current_floor;
-
-	// If the floor has changed, update the floors travelled with or without a traveller
-	if (floor_changed) {
-		if (traveller_onboard) {
-			floors_w_traveller += 1;
-		}
-		else {
-			floors_no_traveller += 1;
-		}
-	}
-
-	// If the direction has changed or the floor has changed, update the displays
-	if (direction_change != old_direction_change || floor_changed) {
-		display_information();
-	}
-
-	old_direction_change = direction_change;
-	old_floor = current_floor;
-}
-
-/// @brief handles the seven segment display
-/// @param digit the value determining whether the right or left display is shown 
-void handle_seven_seg(uint8_t digit) {
-	// Seven segment display values, for the floor number, corresponding to '0', '1', '2' and '3'.
-	uint8_t seven_seg[4] = {63,6,91,79};
-
-	/* Output the current digit */
-	if(digit == 0) { // show right display
-		PORTC &= ~(1 << 4);  // C4 = 0, enable right SSD
-		// First update the current floor to the current position whenever the elevator is on a floor (not between).
-		if (current_position == FLOOR_0 || current_position == FLOOR_1 || current_position == FLOOR_2 
-			|| current_position == FLOOR_3) {
-			PORTA = seven_seg[current_floor/4];
-		} else {
-			PORTA = seven_seg[current_floor/4]| 0b10000000;
-		}
-	} else { // show the left display
-		PORTC |= (1 << 4);   // C4 = 1, enable left SSD
-
-		if (floor_just_reached) {
-			PORTA = 0b01000000; // Segment G for stationary when floor just reached
-		}
-		else {
-			if (destination - current_position > 0) { // Moving up
-				PORTA = 0b00000001; // Segment A
-			} else if (destination - current_position < 0) { // Moving down
-				PORTA = 0b00001000; // Segment D
-			} else if (destination == current_position) { // Stationary
-				PORTA = 0b01000000; // Segment G
-			}
-		}
-	}
-}
-
-void display_information(void) {
-	// First handle the floor level updates:
-	// Clear terminal screen
-	move_terminal_cursor(10,10);
-
-	// Print the required output, depending on the floor.
-
-	printf_P(PSTR("Current floor: %d"), current_floor/4);
-
-	clear_to_end_of_line();
-
-	// Next handle the elevator direction display: 
-	move_terminal_cursor(10,12);
-
-	if (floor_just_reached) {
-		printf_P(PSTR("Direction of travel: Stationary")); // always stationary while dropping off/ picking up
-	}
-	else {
-		if (destination - current_position > 0) { // Moving up
-			printf_P(PSTR("Direction of travel: Up"));
-		} else if (destination - current_position < 0) { // Moving down
-			printf_P(PSTR("Direction of travel: Down"));
-		} else if (destination == current_position) { // Stationary
-			printf_P(PSTR("Direction of travel: Stationary"));
-		}
-	}
-	clear_to_end_of_line();
-
-	// Handle displaying the floors moved with and without a traveller
-	move_terminal_cursor(10,14);
-	printf_P(PSTR("Number of floors moved with traveller: %d"), floors_w_traveller);
-	clear_to_end_of_line();
-	move_terminal_cursor(10,15);
-	printf_P(PSTR("Number of floors moved without traveller: %d"), floors_no_traveller);
-	clear_to_end_of_line();
-}
-
-void start_3kHz_sound(void) {
-	// Set Pin D6 as an output, to control the piezo buzzer.
-	DDRD |= (1 << PD6);
-	OCR2A = 41;
-	OCR2B = OCR2A/2; // divide by 2 to get 50% duty cycle
-}
-
-void start_500Hz_sound(void) {
-	// Set Pin D6 as an output, to control the piezo buzzer.
-	DDRD |= (1 << PD6);
-	OCR2A = 249;
-	OCR2B = OCR2A/2; // divide by 2 to get 50% duty cycle
-}
-
-void stop_sound(void) {
-	// Turn pin D6 off to fully silence it
-	DDRD &= ~(1<<PD6);
-	OCR2A = 0;
-	OCR2B = 0; // gives 0% duty cycle
-}
\ No newline at end of file
+/*
+ * Elevator-Emulator.c
+ *
+ * Main file
+ *
+ * Authors: Peter Sutton, Ahmed Baig
+ * Modified by Alex Holdcroft
+ */ 
+
+/* Definitions */
+
+#define F_CPU 8000000L
+
+/* External Library Includes */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <stdio.h>
+#include <util/delay.h>
+#include <stdbool.h>
+
+/* Internal Library Includes */
+
+#include "display.h"
+#include "ledmatrix.h"
+#include "buttons.h"
+#include "serialio.h"
+#include "terminalio.h"
+#include "timer0.h"
+#include "termrender.h"
+#include "dispatch.h"
+#include "benchmark.h"
+#include "scheduler.h"
+#include "power.h"
+#include "motion.h"
+#include "hal.h"
+#include "traffic.h"
+#include "profile.h"
+#include "latency.h"
+#include "stats.h"
+#include "eventlog.h"
+#include "sound.h"
+#include "persist.h"
+#include "emulator.h"
+
+/* Data Structures */
+
+// The stages of the door cycle when a car stops at a floor. The doors open
+// DOOR_PHASE_TIME ms after the car arrives, stay open for DOOR_PHASE_TIME
+// and the car can leave DOOR_PHASE_TIME after they close.
+typedef enum {DOOR_SHUT, DOOR_ARRIVING, DOOR_OPEN, DOOR_CLOSING} DoorPhase;
+#define DOOR_PHASE_TIME 400
+
+// The cars' top speed, one row every FAST_MS_PER_ROW ms or every
+// SLOW_MS_PER_ROW ms. They speed up and slow down at the ends of each trip
+// (see motion.h). The speed setting chooses between them, or leaves it to
+// switch C7 (slow when on).
+#define FAST_MS_PER_ROW 125
+#define SLOW_MS_PER_ROW 300
+typedef enum {SPEED_SWITCH, SPEED_FAST, SPEED_SLOW} SpeedSetting;
+#define NUM_SPEED_SETTINGS 3
+
+// The sounds (see sound.h), each on its own voice so that they can
+// overlap: a beep when a traveller is placed, a chime as a car arrives at
+// a floor and a tone as its doors open
+#define VOICE_BUTTON	0
+#define VOICE_ARRIVAL	1
+#define VOICE_DOOR		2
+
+#if VOICE_DOOR >= SOUND_VOICES
+#error "SOUND_VOICES is too small for the sounds"
+#endif
+
+// How long everything must have been still (ms) before the timers are
+// stopped to save power. This also gives a button that woke us time to be
+// debounced before we can go back to sleep.
+#define TICKLESS_HOLDOFF_MS 1000
+
+// Scheduler tasks (see scheduler.h). Each car has its own door task.
+#define TASK_MOVE			0
+#define TASK_TRAFFIC		1
+#define TASK_DOORS			2
+
+#if TASK_DOORS + NUM_CARS > SCHEDULER_MAX_TASKS
+#error "Not enough scheduler tasks for the door of each car"
+#endif
+
+// The state of each car, packed into 7 bytes
+typedef struct {
+	Motion motion; // Where the floor line under the car is (see motion.h) and its speed
+	uint8_t destination; // The row the car will next stop at (see building.h)
+	uint8_t drawn_position; // The row draw_elevator() last drew the car at
+	uint8_t empty_floors; // Floors moved empty since the car last had someone on board
+	uint8_t floor : 4; // The last floor the car visited
+	uint8_t door_phase : 2; // DOOR_SHUT unless the car has stopped at a floor
+	uint8_t direction : 2; // The direction last recorded in the event log (see eventlog.h)
+} ElevatorCar;
+
+// The settings kept in the EEPROM (see persist.h). The number of floors is
+// kept to check that the saved totals are for the same building.
+typedef struct {
+	uint8_t policy; // The dispatch policy (see dispatch.h)
+	uint8_t speed; // One of the SpeedSetting values
+	uint8_t floors; // NUM_FLOORS
+} Settings;
+
+// The totals which are kept in the EEPROM (with the dispatcher's
+// statistics) from one run to the next
+typedef struct {
+	uint32_t travellers_delivered; // Counts the total number of travellers taken to their destination
+	uint32_t floors_w_traveller; // Counts the total number of floors travelled with a traveller
+	uint32_t floors_no_traveller; // Counts the total number of floors travelled without a traveller
+	RunningStats empty_runs; // Floors moved empty before each pickup (see stats.h)
+} Totals;
+
+// Everything the main loop keeps track of. None of this is used by the
+// interrupt handlers, so none of it needs to be volatile.
+typedef struct {
+	ElevatorCar cars[NUM_CARS];
+	Settings settings;
+	Totals totals;
+} ElevatorState;
+
+// The parts of the state kept in the EEPROM: the settings, the totals and
+// the dispatcher's statistics (set up by setup_elevator_emulator())
+#define PERSIST_SECTIONS 3
+
+// Number of seven segment digits multiplexed by the timer 1 interrupt.
+// Digit 0 is the right display.
+#define SEVEN_SEG_DIGITS 2
+
+// Terminal status lines (see display_information()). The floor and
+// direction are for car 0, which is also shown on the seven segment
+// display and door LEDs.
+#define STATUS_FLOOR			0
+#define STATUS_DIRECTION		1
+#define STATUS_FLOORS_WITH		2
+#define STATUS_FLOORS_WITHOUT	3
+#define STATUS_DELIVERED		4
+#define STATUS_POLICY			5
+#define STATUS_OTHER_CARS		6
+#define STATUS_TRAFFIC			7
+#define STATUS_DEADLINES		8
+#define STATUS_SPEED			9
+#define STATUS_TURNED_AWAY		10
+
+#if STATUS_TURNED_AWAY >= TERM_NUM_FIELDS
+#error "TERM_NUM_FIELDS is too small for the status lines"
+#endif
+
+// The trip statistics (see display_trip_stats()) are shown on the
+// terminal from this row down
+#define TRIP_STATS_ROW 23
+
+// The benchmark results (and the profile and latency histograms, see
+// profile.h and latency.h) are shown on the terminal from this row down
+#define BENCHMARK_ROW 27
+#define PROFILE_ROW BENCHMARK_ROW
+#define LATENCY_ROW BENCHMARK_ROW
+
+// The cars are drawn side by side from column 1, 2 columns wide if there
+// are up to 2 cars and 1 column wide if there are more
+#if NUM_CARS <= 2
+#define CAR_WIDTH 2
+#else
+#define CAR_WIDTH 1
+#endif
+#define CAR_X(car_id) (1 + (car_id) * CAR_WIDTH)
+
+// Travellers waiting on a floor are drawn in a row starting at this column
+#define WAITING_X 5
+
+#if CAR_X(NUM_CARS) > WAITING_X
+#error "Too many cars to fit on the LED matrix"
+#endif
+#if WAITING_X + WAITING_PER_FLOOR > WIDTH
+#error "WAITING_PER_FLOOR is too large to fit on the LED matrix"
+#endif
+
+// When the building is taller than the LED matrix, the view scrolls to keep
+// this many rows below the elevator's floor line (which puts the elevator
+// in the middle of the display)
+#define VIEW_MARGIN ((HEIGHT - FLOOR_SPACING) / 2)
+
+// Seven segment display values for the digits '0' to '9'
+static const uint8_t seven_seg[10] = {63,6,91,79,102,109,125,7,127,111};
+
+// The tunes for the sounds above (a two note "ding dong" for the arrival
+// chime)
+static const Note button_sound[] PROGMEM = {SOUND_NOTE(3000, 50), SOUND_END};
+static const Note arrival_sound[] PROGMEM = {
+	SOUND_NOTE(1250, 80), SOUND_REST(20), SOUND_NOTE(1000, 150), SOUND_END
+};
+static const Note door_sound[] PROGMEM = {SOUND_NOTE(500, 50), SOUND_END};
+
+/* Global Variables */
+ElevatorState state;
+
+// The parts of the state kept in the EEPROM (see persist.h)
+PersistSection persisted[PERSIST_SECTIONS];
+
+// When the cars were last seen doing something (see run_elevator_emulator())
+uint16_t parked_since;
+
+// Whether the traffic task is running (see traffic.h)
+bool traffic_running;
+
+// The segments to show on each digit, shared with the timer 1 interrupt.
+// The main loop fills in the frame the interrupt isn't showing, then
+// switches the interrupt over to it with a single write (see
+// publish_seven_seg()).
+volatile uint8_t seven_seg_frames[2][SEVEN_SEG_DIGITS];
+volatile uint8_t seven_seg_front;
+
+/* Internal Function Declarations */
+
+void start_screen(void);
+void start_elevator_emulator(void);
+void handle_inputs(uint8_t);
+void place_traveller(uint8_t, uint8_t, bool);
+void release_traffic(uint8_t);
+void move_cars(uint8_t);
+void move_car(uint8_t, uint8_t);
+void advance_doors(uint8_t);
+void show_doors(uint8_t, bool);
+void draw_elevator(uint8_t);
+void draw_floors(void);
+void update_view(void);
+void draw_waiting_travellers(uint8_t);
+void display_information(void);
+void display_trip_stats(void);
+void update_trip_stats(bool, bool);
+void print_stats_row(uint8_t, const RunningStats*);
+void publish_seven_seg(void);
+bool emulator_parked(void);
+void sleep_while_parked(void);
+void reset_saved_state(void);
+bool saved_state_valid(void);
+Direction car_direction(const ElevatorCar*);
+void start_3kHz_sound(void);
+void start_500Hz_sound(void);
+void start_arrival_chime(void);
+
+/* Main */
+
+#ifndef HOST_SIM // The host simulation has its own main() (see sim/sim.c)
+int main(void) {
+	// Setup hardware and call backs. This will turn on 
+	// interrupts.
+	initialise_hardware();
+	
+	// Show the splash screen message. Returns when display is complete
+	start_screen();
+	
+	// Start elevator controller software
+	start_elevator_emulator();
+}
+#endif
+
+/* Internal Function Definitions */
+
+/**
+ * @brief All hardware initialisation occurs here
+ * @arg none
+ * @retval none
+*/
+void initialise_hardware(void) {
+	
+	ledmatrix_setup();
+	// Use a faster SPI clock for the LED matrix, if built with
+	// LEDMATRIX_FAST_CLOCK (see ledmatrix.h)
+	(void)ledmatrix_select_fastest_clock();
+	init_button_interrupts();
+	// Setup serial port for 19200 baud communication with no echo
+	// of incoming characters
+	init_serial_stdio(19200,0);
+	// Serial input can also be binary traffic commands (see traffic.h),
+	// which can come faster than we read them
+	serial_set_binary_input(1);
+	serial_set_flow_control(1);
+	
+	init_timer0();
+	power_init();
+
+	// Set up the switches, seven segment display, door LEDs and buzzer, and
+	// the timer 1 interrupt which multiplexes the display
+	hal_init();
+	sound_init();
+	profile_init();
+
+	// The seven segment display shows car 0 from the start
+	publish_seven_seg();
+
+	// Turn on global interrupts
+	sei();
+}
+
+/**
+ * @brief Displays the "EC" start screen with elevator symbol
+ * @arg none
+ * @retval none
+*/
+void start_screen(void) {
+	// Clear terminal screen and output a message
+	clear_terminal();
+	move_terminal_cursor(10,10);
+	serial_write_P_str("Elevator Controller");
+	move_terminal_cursor(10,12);
+	serial_write_P_str("CSSE2010/7201 project by Alexandra Holdcroft, 48926782");
+	
+	// Show start screen
+	start_display();
+	
+	// Animation variables
+	uint16_t doors_frame_time = 0;
+	uint16_t interval_delay = 150;
+	uint8_t frame = 0;
+	uint8_t doors_opening_closing = 1; // 1 => opening, 0 => closing
+	
+	// Wait until a button is pressed, or 's' is pressed on the terminal
+	while(1) {
+		
+		// Don't worry about this if/else tree. Its purely for animating
+		// the elevator doors on the start screen
+		uint16_t now = get_current_time16();
+		if ((uint16_t)(now - doors_frame_time) > interval_delay) {
+			start_display_animation(frame);
+			doors_frame_time = now; // Reset delay until next movement update
+			if (doors_opening_closing) {
+				interval_delay = 150;
+				frame++;
+				if (frame == 1) interval_delay = 2000;
+				if (frame == 3) doors_opening_closing = 0;
+			} else {
+				interval_delay = 150;
+				frame--;
+				if (frame == 2) interval_delay = 500;
+				if (frame == 0) doors_opening_closing = 1;
+			}
+		}
+	
+		// First check for if a 's' is pressed
+		// There are two steps to this
+		// 1) collect any serial input (if available)
+		// 2) check if the input is equal to the character 's'
+		char serial_input = -1;
+		if (serial_input_available()) {
+			serial_input = fgetc(stdin);
+		}
+		// If the serial input is 's', then exit the start screen
+		if (serial_input == 's' || serial_input == 'S') {
+			break;
+		}
+		// Next check for any button presses
+		int8_t btn = button_pushed();
+		if (btn != NO_BUTTON_PUSHED) {
+			break;
+		}
+
+		// Nothing else to do until the next interrupt
+		power_idle();
+	}
+}
+
+/**
+ * @brief Initialises LED matrix and then starts infinite loop handling elevator
+ * @arg none
+ * @retval none
+*/
+void start_elevator_emulator(void) {
+	setup_elevator_emulator();
+	while(true) {
+		run_elevator_emulator();
+	}
+}
+
+/**
+ * @brief Clears the terminal and LED matrix, parks the cars and starts them
+ * @arg none
+ * @retval none
+*/
+void setup_elevator_emulator(void) {
+	
+	// Clear the serial terminal and print the status line labels
+	clear_terminal();
+	hide_cursor();
+	term_field_init(STATUS_FLOOR, 10, 10, PSTR("Current floor: "));
+	term_field_init(STATUS_DIRECTION, 10, 12, PSTR("Direction of travel: "));
+	term_field_init(STATUS_FLOORS_WITH, 10, 14, PSTR("Number of floors moved with traveller: "));
+	term_field_init(STATUS_FLOORS_WITHOUT, 10, 15, PSTR("Number of floors moved without traveller: "));
+	term_field_init(STATUS_DELIVERED, 10, 16, PSTR("Travellers delivered: "));
+	term_field_init(STATUS_TURNED_AWAY, 10, 17, PSTR("Travellers turned away (floor full): "));
+	term_field_init(STATUS_POLICY, 10, 18, PSTR("Dispatch policy: "));
+	if (NUM_CARS > 1) {
+		term_field_init(STATUS_OTHER_CARS, 10, 19, PSTR("Other cars (floor, direction): "));
+	}
+	term_field_init(STATUS_TRAFFIC, 10, 20, PSTR("Traffic: "));
+	term_field_init(STATUS_DEADLINES, 10, 21, PSTR("Deadlines missed: "));
+	term_field_init(STATUS_SPEED, 10, 22, PSTR("Speed: "));
+	
+	// Initialise Display
+	initialise_display();
+	
+	// Clear a button push or serial input if any are waiting
+	// (The cast to void means the return value is ignored.)
+	(void)button_pushed();
+	clear_serial_input_buffer();
+
+	// Initialise local variables
+	for (uint8_t car_id = 0; car_id < NUM_CARS; car_id++) {
+		state.cars[car_id].motion.position = 0;
+		state.cars[car_id].motion.speed = 0;
+		state.cars[car_id].destination = 0;
+		state.cars[car_id].drawn_position = 0;
+		state.cars[car_id].empty_floors = 0;
+		state.cars[car_id].floor = 0;
+		state.cars[car_id].door_phase = DOOR_SHUT;
+		state.cars[car_id].direction = DIRECTION_NONE;
+	}
+
+	// Put back the settings and totals saved in the EEPROM, unless there
+	// aren't any (or they are for a different building). This also
+	// clears the dispatcher.
+	persisted[0] = (PersistSection){&state.settings, sizeof(state.settings)};
+	persisted[1] = (PersistSection){&state.totals, sizeof(state.totals)};
+	persisted[2] = (PersistSection){dispatch_stats(), sizeof(DispatchStats)};
+	reset_saved_state();
+	if (persist_load(persisted, PERSIST_SECTIONS) && !saved_state_valid()) {
+		reset_saved_state();
+	}
+	dispatch_set_policy(state.settings.policy);
+	
+	// Draw the floors and elevator cars
+	for (uint8_t car_id = 0; car_id < NUM_CARS; car_id++) {
+		draw_elevator(car_id);
+	}
+	draw_floors();
+	ledmatrix_flush();
+
+	// Display the initial information
+	display_information();
+	display_trip_stats();
+
+	// Set the LEDs with the initial value (doors should be closed)
+	show_doors(0, false);
+	show_doors(1, false);
+	
+	// Set up the timed tasks and start the cars moving
+	scheduler_add_task(TASK_MOVE, move_cars);
+	scheduler_add_task(TASK_TRAFFIC, release_traffic);
+	traffic_running = false;
+	for (uint8_t car_id = 0; car_id < NUM_CARS; car_id++) {
+		scheduler_add_task(TASK_DOORS + car_id, advance_doors);
+	}
+	move_cars(TASK_MOVE);
+	parked_since = get_current_time16();
+}
+
+/**
+ * @brief One pass of the main loop: runs the timed tasks, handles inputs and
+ * sleeps until there is more to do
+ * @arg none
+ * @retval none
+*/
+void run_elevator_emulator(void) {
+	
+	// Keep track of how long each pass takes
+	latency_loop();
+
+	// Move the cars and open and close doors when it is time
+	PROFILE_BEGIN(PROFILE_SCHEDULER);
+	scheduler_run();
+	PROFILE_END(PROFILE_SCHEDULER);
+
+	// Switches 0 and 1 give 0, 1, 2 or 3 for the destination floor
+	uint8_t floor_choice = hal_switches() & HAL_SWITCH_FLOOR_MASK;
+
+	// Handle any button or key inputs
+	PROFILE_BEGIN(PROFILE_INPUTS);
+	handle_inputs(floor_choice);
+	PROFILE_END(PROFILE_INPUTS);
+
+	// Send any pixels changed in this pass to the LED matrix
+	PROFILE_BEGIN(PROFILE_FLUSH);
+	ledmatrix_flush();
+	PROFILE_END(PROFILE_FLUSH);
+
+	// Send the event log while the terminal output has room to spare
+	eventlog_drain();
+
+	// Save the settings and totals if they have changed (sooner if the
+	// cars are parked)
+	bool parked = emulator_parked();
+	persist_run(parked);
+
+	// Once the cars have been parked for a while, stop the timers
+	// until there is something to do. Otherwise just wait for the
+	// next interrupt (never more than 0.5ms away). A record being
+	// saved is finished first, and changes not yet due to be saved
+	// wake us when they are.
+	if (!parked || persist_busy()) {
+		parked_since = get_current_time16();
+	} else if ((uint16_t)(get_current_time16() - parked_since) >= TICKLESS_HOLDOFF_MS) {
+		sleep_while_parked();
+		parked_since = get_current_time16();
+		return;
+	}
+	power_idle();
+}
+
+/**
+ * @brief Checks whether the cars are parked with nothing left to do
+ * @arg none
+ * @retval true if no car is moving or has its doors open, nobody is
+ * waiting or travelling, no traffic is on its way and no sound is playing
+*/
+bool emulator_parked(void) {
+	if (traffic_active() || eventlog_pending()) {
+		return false;
+	}
+	for (uint8_t car_id = 0; car_id < NUM_CARS; car_id++) {
+		const ElevatorCar* car = &state.cars[car_id];
+		if (car->door_phase != DOOR_SHUT
+				|| car->motion.position != motion_row_position(car->destination)
+				|| dispatch_onboard_count(car_id) > 0) {
+			return false;
+		}
+	}
+	for (uint8_t floor = 0; floor < NUM_FLOORS; floor++) {
+		if (dispatch_waiting_count(floor) > 0) {
+			return false;
+		}
+	}
+	return !sound_playing();
+}
+
+/**
+ * @brief Sleeps with the timers stopped until a button is pushed or a key
+ * is pressed, or until unsaved changes are due to be saved (see persist.h).
+ * The seven segment display isn't multiplexed while asleep, so only the
+ * right digit (the floor units) is left on.
+ * @arg none
+ * @retval none
+*/
+void sleep_while_parked(void) {
+	cli();
+	if (serial_input_available() || !button_idle()) {
+		sei();
+		return;
+	}
+	hal_seven_seg(0, seven_seg_frames[seven_seg_front][0]);
+
+	// Wake (on the next whole second) when the changes are due, so they
+	// are saved even if nothing else wakes us before the power goes off
+	uint16_t wake_after = 0;
+	uint32_t save_in = persist_time_to_save(true);
+	if (save_in != UINT32_MAX) {
+		save_in = save_in / 1000 + 1;
+		wake_after = save_in > UINT16_MAX ? UINT16_MAX : save_in;
+	}
+	power_sleep_tickless(wake_after);
+
+	// The tasks were held up while the timers were stopped, which doesn't
+	// count as missing their deadlines
+	latency_forget();
+}
+
+/**
+ * @brief Sets the settings to their defaults and clears the totals and the
+ * dispatcher's statistics (the state used when nothing has been saved)
+ * @arg none
+ * @retval none
+*/
+void reset_saved_state(void) {
+	state.settings.policy = dispatch_get_policy();
+	state.settings.speed = SPEED_SWITCH;
+	state.settings.floors = NUM_FLOORS;
+	state.totals.travellers_delivered = 0;
+	state.totals.floors_w_traveller = 0;
+	state.totals.floors_no_traveller = 0;
+	stats_init(&state.totals.empty_runs);
+	dispatch_init();
+}
+
+/**
+ * @brief Checks the settings put back from the EEPROM
+ * @arg none
+ * @retval true if they can be used, i.e. they were saved for a building
+ * with the same number of floors and the policy and speed are ones we have
+*/
+bool saved_state_valid(void) {
+	return state.settings.floors == NUM_FLOORS
+			&& state.settings.policy < NUM_DISPATCH_POLICIES
+			&& state.settings.speed < NUM_SPEED_SETTINGS;
+}
+
+ISR(TIMER1_COMPA_vect) {
+	PROFILE_ISR_BEGIN();
+	latency_tick();
+	// Only used here, so this doesn't need to be volatile
+	static uint8_t digit = 0; // The CC value to be set
+	
+	// Show the next seven segment digit every 0.5ms (every interrupt)
+	hal_seven_seg(digit, seven_seg_frames[seven_seg_front][digit]);
+	if (++digit == SEVEN_SEG_DIGITS) { // Move on to the next display
+		digit = 0;
+	}
+
+	// Everything else that happens at set times is run from the main loop
+	scheduler_tick();
+	PROFILE_ISR_END(PROFILE_TIMER1_ISR);
+}
+
+
+/**
+ * @brief Draws a line of "FLOOR" coloured pixels for each floor in view
+ * @arg none
+ * @retval none
+*/
+void draw_floors(void) {
+	uint8_t bottom = display_view_bottom();
+	uint8_t first = row_floor(bottom + FLOOR_SPACING - 1);
+	uint8_t last = row_floor(bottom + HEIGHT - 1);
+	for (uint8_t floor = first; floor <= last && floor < NUM_FLOORS; floor++) {
+		update_squares(0, floor_row(floor), WIDTH, FLOOR);
+	}
+}
+
+/**
+ * @brief Scrolls the display to follow the elevator, if the building is
+ * taller than the LED matrix, and redraws whatever scrolled into view
+ * @arg none
+ * @retval none
+*/
+void update_view(void) {
+#if BUILDING_ROWS > HEIGHT
+	uint8_t bottom = 0;
+	uint8_t row = motion_row(state.cars[0].motion.position);
+	if (row > VIEW_MARGIN) {
+		bottom = row - VIEW_MARGIN;
+	}
+	if (bottom > BUILDING_ROWS - HEIGHT) {
+		bottom = BUILDING_ROWS - HEIGHT;
+	}
+	if (bottom == display_view_bottom()) {
+		return;
+	}
+	display_set_view(bottom);
+	
+	// Redraw everything in view (the cars are redrawn by the caller). Only
+	// squares which have changed are sent to the LED matrix, which after a
+	// one row scroll is just the new row.
+	draw_floors();
+	for (uint8_t floor = row_floor(bottom); floor <= row_floor(bottom + HEIGHT - 1)
+			&& floor < NUM_FLOORS; floor++) {
+		draw_waiting_travellers(floor);
+	}
+#endif
+}
+
+/**
+ * @brief Draws a car at its current position
+ * @arg car_id the car to draw
+ * @retval none
+*/
+void draw_elevator(uint8_t car_id) {
+	
+	ElevatorCar* car = &state.cars[car_id];
+	uint8_t x = CAR_X(car_id);
+	uint8_t row = motion_row(car->motion.position);
+	uint8_t y = 0; // Height position to draw elevator (i.e. y axis)
+	
+	// The car is drawn 3 rows high above its floor line. While it is part
+	// way between rows, its bottom row fades out and the row above its top
+	// row fades in, in step with how far it has moved.
+	uint8_t top_brightness = ((uint16_t)motion_fraction(car->motion.position)
+			* FULL_BRIGHTNESS + MOTION_ONE_ROW / 2) / MOTION_ONE_ROW;
+	
+	// Clear the rows the car has moved off
+	for (uint8_t i = 1; i <= 4; i++) {
+		y = car->drawn_position + i;
+		uint8_t column = display_matrix_column(y);
+		if ((y <= row || y > row + 4) && !row_is_floor(y) // Do not draw over the floor's LEDs
+				&& column < MATRIX_NUM_COLUMNS) {
+			for (uint8_t j = 0; j < CAR_WIDTH; j++) {
+				UPDATE_MATRIX_SQUARE(column, x + j, EMPTY_SQUARE);
+			}
+		}
+	}
+	car->drawn_position = row;
+	
+	// Draw the car CAR_WIDTH wide, over the 4 rows it can partly cover.
+	// Only the rows it fades in and out of need their colour dimmed.
+	for (uint8_t i = 1; i <= 4; i++) {
+		y = row + i;
+		uint8_t column = display_matrix_column(y);
+		if (row_is_floor(y) || column >= MATRIX_NUM_COLUMNS) { // Do not draw on the floor
+			continue;
+		}
+		for (uint8_t j = 0; j < CAR_WIDTH; j++) {
+			if (i == 1) {
+				update_square_brightness(x + j, y, ELEVATOR, FULL_BRIGHTNESS - top_brightness);
+			} else if (i == 4) {
+				update_square_brightness(x + j, y, ELEVATOR, top_brightness);
+			} else {
+				UPDATE_MATRIX_SQUARE(column, x + j, ELEVATOR);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Draws the travellers waiting on a floor, in the colour of their destination
+ * (the four colours are reused for every four floors)
+ * @arg floor the floor number (0 to NUM_FLOORS-1)
+ * @retval none
+*/
+void draw_waiting_travellers(uint8_t floor) {
+	uint8_t column = display_matrix_column(floor_row(floor) + 1);
+	if (column >= MATRIX_NUM_COLUMNS) {
+		return;
+	}
+	uint8_t count = dispatch_waiting_count(floor);
+	for (uint8_t slot = 0; slot < WAITING_PER_FLOOR; slot++) {
+		uint8_t object = EMPTY_SQUARE;
+		if (slot < count) {
+			object = TRAVELLER_TO_0 + (dispatch_waiting_destination(floor, slot) & 3);
+		}
+		UPDATE_MATRIX_SQUARE(column, WAITING_X + slot, object);
+	}
+}
+
+/**
+ * @brief Reads btn values and serial input and adds a traveller as appropriate
+ * @arg none
+ * @retval none
+*/
+void handle_inputs(uint8_t floor_choice) {
+	
+	// We need to check if any button has been pushed
+	uint8_t btn = button_pushed();
+
+	// Additionally check if any serial input has been pressed. Traffic
+	// commands are read until the next key (or until no more traffic can
+	// be queued).
+	char serial_input = -1;
+	uint32_t now = get_current_time();
+	while (serial_input_available() && traffic_can_receive()) {
+		char c = fgetc(stdin);
+		if (!traffic_receive(c, now)) {
+			serial_input = c;
+			break;
+		}
+	}
+	if (traffic_active() && !traffic_running) {
+		traffic_running = true;
+		release_traffic(TASK_TRAFFIC);
+	}
+	
+	// Check if any traveller has been placed, either by buttons or serial input
+	// i is the floor the traveller is being placed
+	// floor choice is the floor the traveller wants to go
+	// (Buttons place travellers on floors 0 to 3 and the keys '0' to '9' on
+	// floors 0 to 9.)
+	// (The traveller is ignored if the floor already has as many travellers
+	// waiting as can be shown.)
+	for (uint8_t i = 0; i < NUM_FLOORS; i++) {
+		if (btn == i || (i < 10 && serial_input == '0' + i)) {
+			place_traveller(i, floor_choice, true);
+		}
+	}
+
+	// 'p' selects the next dispatch policy
+	if (serial_input == 'p' || serial_input == 'P') {
+		state.settings.policy = (state.settings.policy + 1) % NUM_DISPATCH_POLICIES;
+		dispatch_set_policy(state.settings.policy);
+		persist_changed();
+		display_information();
+	}
+
+	// 's' selects the next speed setting (switch C7, fast or slow)
+	if (serial_input == 's' || serial_input == 'S') {
+		state.settings.speed = (state.settings.speed + 1) % NUM_SPEED_SETTINGS;
+		persist_changed();
+		display_information();
+	}
+
+	// 'b' compares the dispatch policies, when nobody is waiting or
+	// travelling (the benchmark uses the dispatcher, see benchmark.h).
+	// Everything else waits until it has finished, which doesn't count as
+	// missing deadlines.
+	if (serial_input == 'b' || serial_input == 'B') {
+		if (benchmark_run_all(BENCHMARK_ROW)) {
+			latency_forget();
+		}
+	}
+
+	// 'c' shows how many cycles things take (only if profiling is
+	// compiled in, see profile.h)
+	if (serial_input == 'c' || serial_input == 'C') {
+		profile_dump(PROFILE_ROW);
+	}
+
+	// 'l' shows how long main loop passes take and how late the timer 1
+	// interrupt is
+	if (serial_input == 'l' || serial_input == 'L') {
+		latency_dump(LATENCY_ROW);
+	}
+
+	// 'e' turns the event log on or off (see eventlog.h)
+	if (serial_input == 'e' || serial_input == 'E') {
+		eventlog_set_streaming(!eventlog_streaming());
+	}
+}
+
+/**
+ * @brief Adds a traveller to the dispatcher and draws them (unless the floor
+ * already has as many travellers waiting as can be shown, when the
+ * dispatcher counts them as turned away)
+ * @arg floor the floor the traveller is on
+ * @arg destination the floor the traveller wants to go to
+ * @arg beep true to sound the buzzer when they are added
+ * @retval none
+*/
+void place_traveller(uint8_t floor, uint8_t destination, bool beep) {
+	if (dispatch_add_traveller(floor, destination, get_current_time())) {
+		eventlog_record(EVENT_PLACED, 0, (floor << 4) | destination);
+		draw_waiting_travellers(floor);
+		if (beep) {
+			start_3kHz_sound();
+		}
+	} else {
+		persist_changed();
+	}
+}
+
+/**
+ * @brief Runs the traffic generator and places the travellers whose time has
+ * come (the traffic task, which runs every TRAFFIC_STEP_MS while there is
+ * traffic). Traffic travellers are placed without a beep, as there can be
+ * many of them.
+ * @arg task TASK_TRAFFIC
+ * @retval none
+*/
+void release_traffic(uint8_t task) {
+	uint32_t now = get_current_time();
+	uint8_t floor;
+	uint8_t destination;
+	traffic_step(now);
+	while (traffic_next_arrival(now, &floor, &destination)) {
+		place_traveller(floor, destination, false);
+	}
+	traffic_running = traffic_active();
+	if (traffic_running) {
+		scheduler_start(task, TRAFFIC_STEP_MS);
+	}
+}
+
+/**
+ * @brief Moves every car which isn't stopped at a floor and redraws them (the
+ * movement task, which runs every MOTION_STEP_MS)
+ * @arg task TASK_MOVE
+ * @retval none
+*/
+void move_cars(uint8_t task) {
+	latency_check(task);
+	uint8_t top_speed = MOTION_SPEED(FAST_MS_PER_ROW);
+	if (state.settings.speed == SPEED_SLOW || (state.settings.speed == SPEED_SWITCH
+			&& (hal_switches() & HAL_SWITCH_SLOW))) {
+		top_speed = MOTION_SPEED(SLOW_MS_PER_ROW);
+	}
+	for (uint8_t car_id = 0; car_id < NUM_CARS; car_id++) {
+		move_car(car_id, top_speed);
+		// Record when the car starts, stops or turns around
+		ElevatorCar* car = &state.cars[car_id];
+		Direction direction = car_direction(car);
+		if (direction != car->direction) {
+			car->direction = direction;
+			eventlog_record(EVENT_DIRECTION, car_id, direction);
+		}
+	}
+	
+	// As we have potentially changed the car positions, lets redraw them
+	// (scrolling the display first if it needs to follow car 0)
+	update_view();
+	PROFILE_BEGIN(PROFILE_DRAW);
+	for (uint8_t car_id = 0; car_id < NUM_CARS; car_id++) {
+		draw_elevator(car_id);
+	}
+	PROFILE_END(PROFILE_DRAW);
+	publish_seven_seg();
+	PROFILE_BEGIN(PROFILE_INFORMATION);
+	display_information();
+	PROFILE_END(PROFILE_INFORMATION);
+	
+	scheduler_start(TASK_MOVE, MOTION_STEP_MS);
+	latency_expect(TASK_MOVE, MOTION_STEP_MS);
+}
+
+/**
+ * @brief Moves a car one step towards its destination. Whenever the car is
+ * stopped at a floor, first decides whether it should stop there or where it
+ * should go next. On the way, decides whether to stop at each floor while it
+ * can still slow down in time.
+ * @arg car_id the car to move
+ * @arg top_speed the fastest the car may go (see motion.h)
+ * @retval none
+*/
+void move_car(uint8_t car_id, uint8_t top_speed) {
+	ElevatorCar* car = &state.cars[car_id];
+	if (car->door_phase != DOOR_SHUT) {
+		return; // Stopped at a floor until the doors have closed
+	}
+	
+	uint16_t position = car->motion.position;
+	uint8_t floor = row_floor(motion_row(position));
+	if (car->motion.speed == 0 && position == motion_row_position(floor_row(floor))) {
+		// Stopped at a floor. Check whether it should stop here to let
+		// travellers off or on, and otherwise where it should go next
+		// (new calls may have been made since it got here).
+		if (dispatch_should_stop(car_id, floor)) {
+			// Begin the door cycle. Travellers get off and on
+			// once the doors are open (see advance_doors()).
+			car->destination = floor_row(floor);
+			car->door_phase = DOOR_ARRIVING;
+			eventlog_record(EVENT_DOOR, car_id, DOOR_ARRIVING);
+			start_arrival_chime();
+			scheduler_start(TASK_DOORS + car_id, DOOR_PHASE_TIME);
+			latency_expect(TASK_DOORS + car_id, DOOR_PHASE_TIME);
+			return;
+		}
+		uint8_t next_floor = dispatch_next_floor(car_id, floor);
+		if (next_floor == NO_FLOOR) {
+			car->destination = floor_row(floor);
+		} else {
+			car->destination = floor_row(next_floor);
+		}
+	} else {
+		// On the way. Find the next floor ahead, and while the car can still
+		// stop there, check whether it should. If it is the destination, the
+		// car carries on past it when the dispatcher has somewhere further
+		// on for it to go.
+		bool going_up = motion_row_position(car->destination) > position;
+		if (going_up) {
+			floor++;
+		} else if (position == motion_row_position(floor_row(floor))) {
+			floor--;
+		}
+		if (motion_can_stop(&car->motion, motion_row_position(floor_row(floor)))) {
+			if (dispatch_should_stop(car_id, floor)) {
+				car->destination = floor_row(floor);
+			} else if (floor_row(floor) == car->destination) {
+				uint8_t next_floor = dispatch_next_floor(car_id, floor);
+				if (next_floor != NO_FLOOR &&
+						(going_up ? next_floor > floor : next_floor < floor)) {
+					car->destination = floor_row(next_floor);
+				}
+			}
+		}
+	}
+
+	// Move the car on towards where it needs to go
+	(void)motion_step(&car->motion, motion_row_position(car->destination), top_speed);
+	
+	// If the car has reached another floor (is nearer to it than to any
+	// other row), update the floors travelled with or without a traveller
+	uint8_t row = motion_nearest_row(car->motion.position);
+	if (row_is_floor(row) && row_floor(row) != car->floor) {
+		car->floor = row_floor(row);
+		persist_changed();
+		if (dispatch_onboard_count(car_id) > 0) {
+			state.totals.floors_w_traveller += 1;
+		}
+		else {
+			state.totals.floors_no_traveller += 1;
+			if (car->empty_floors < UINT8_MAX) {
+				car->empty_floors += 1;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Moves a car which has stopped at a floor on to the next stage of its
+ * door cycle (the door task for each car)
+ * @arg task TASK_DOORS plus the car number
+ * @retval none
+*/
+void advance_doors(uint8_t task) {
+	uint8_t car_id = task - TASK_DOORS;
+	ElevatorCar* car = &state.cars[car_id];
+	latency_check(task);
+	
+	if (car->door_phase == DOOR_ARRIVING) {
+		// Open the doors, play the picking up/ dropping off sound and let
+		// travellers off, then on
+		car->door_phase = DOOR_OPEN;
+		eventlog_record(EVENT_DOOR, car_id, DOOR_OPEN);
+		show_doors(car_id, true);
+		start_500Hz_sound();
+		uint8_t floor = row_floor(motion_row(car->motion.position));
+		uint32_t now = get_current_time();
+		uint8_t unloaded = dispatch_unload(car_id, floor, now);
+		state.totals.travellers_delivered += unloaded;
+		if (unloaded > 0) {
+			eventlog_record(EVENT_DROPOFF, car_id, (floor << 4) | unloaded);
+		}
+		// A car which is empty and picks someone up has finished an empty
+		// run (which may have been no floors, if someone has just got off)
+		bool was_empty = dispatch_onboard_count(car_id) == 0;
+		uint8_t loaded = dispatch_load(car_id, floor, now);
+		if (loaded > 0) {
+			eventlog_record(EVENT_PICKUP, car_id, (floor << 4) | loaded);
+		}
+		bool empty_run = was_empty && loaded > 0;
+		if (empty_run) {
+			stats_add(&state.totals.empty_runs, car->empty_floors);
+			car->empty_floors = 0;
+		}
+		if (unloaded > 0 || empty_run) {
+			persist_changed();
+		}
+		draw_waiting_travellers(floor);
+		update_trip_stats(unloaded > 0, empty_run);
+	} else if (car->door_phase == DOOR_OPEN) {
+		car->door_phase = DOOR_CLOSING;
+		show_doors(car_id, false);
+	} else {
+		car->door_phase = DOOR_SHUT;
+	}
+	if (car->door_phase != DOOR_OPEN) {
+		eventlog_record(EVENT_DOOR, car_id, car->door_phase);
+	}
+	if (car->door_phase != DOOR_SHUT) {
+		scheduler_start(task, DOOR_PHASE_TIME);
+		latency_expect(task, DOOR_PHASE_TIME);
+	}
+	if (car_id == 0) {
+		publish_seven_seg();
+	}
+	display_information();
+}
+
+/**
+ * @brief Shows whether a car's doors are open on the door LEDs. The LEDs are
+ * in two halves, C1/C0 for car 0 and C2/C3 for car 1 (with one car, both
+ * halves show it). The inner LED of each half is on while the doors are
+ * closed and the outer LED while they are open.
+ * @arg car_id the car
+ * @arg open true if the doors are open
+ * @retval none
+*/
+void show_doors(uint8_t car_id, bool open) {
+	uint8_t inner;
+	uint8_t outer;
+	if (NUM_CARS == 1) {
+		inner = (1 << 1)|(1 << 2);
+		outer = (1 << 0)|(1 << 3);
+	} else if (car_id == 0) {
+		inner = (1 << 1);
+		outer = (1 << 0);
+	} else if (car_id == 1) {
+		inner = (1 << 2);
+		outer = (1 << 3);
+	} else {
+		return; // There are no LEDs for any other cars
+	}
+	
+	if (open) {
+		hal_door_leds(outer, inner);
+	} else {
+		hal_door_leds(inner, outer);
+	}
+}
+
+/// @brief works out what the seven segment display should show for car 0
+/// and hands it to the timer 1 interrupt. Called whenever car 0 moves or its
+/// doors change.
+/// The right display shows the floor, with the decimal point on between
+/// floors, and the left display the direction. Floors 10 and above use both
+/// digits, and the left decimal point shows that the elevator is moving
+/// instead of the direction segments.
+void publish_seven_seg(void) {
+	const ElevatorCar* car = &state.cars[0];
+	Direction direction = car_direction(car);
+	uint8_t frame[SEVEN_SEG_DIGITS];
+	uint8_t tens = 0;
+	uint8_t units = car->floor;
+	while (units >= 10) {
+		units -= 10;
+		tens++;
+	}
+	
+	frame[0] = seven_seg[units];
+	if (car->motion.position != motion_row_position(floor_row(car->floor))) {
+		frame[0] |= 0b10000000; // Between floors
+	}
+	if (tens > 0) {
+		frame[1] = seven_seg[tens];
+		if (direction != DIRECTION_NONE) {
+			frame[1] |= 0b10000000; // Moving
+		}
+	} else if (direction == DIRECTION_UP) { // Moving up
+		frame[1] = 0b00000001; // Segment A
+	} else if (direction == DIRECTION_DOWN) { // Moving down
+		frame[1] = 0b00001000; // Segment D
+	} else { // Stationary
+		frame[1] = 0b01000000; // Segment G
+	}
+	
+	// Only switch frames if something has changed
+	uint8_t front = seven_seg_front;
+	bool changed = false;
+	for (uint8_t i = 0; i < SEVEN_SEG_DIGITS; i++) {
+		if (seven_seg_frames[front][i] != frame[i]) {
+			changed = true;
+		}
+		seven_seg_frames[1 - front][i] = frame[i];
+	}
+	if (changed) {
+		seven_seg_front = 1 - front;
+	}
+}
+
+/// @brief works out which way a car is moving
+/// @param car the car
+/// @return DIRECTION_UP or DIRECTION_DOWN, or DIRECTION_NONE if the car is
+/// stationary (which it always is while dropping off/ picking up)
+Direction car_direction(const ElevatorCar* car) {
+	uint16_t destination = motion_row_position(car->destination);
+	if (car->door_phase != DOOR_SHUT || destination == car->motion.position) {
+		return DIRECTION_NONE;
+	} else if (destination > car->motion.position) {
+		return DIRECTION_UP;
+	}
+	return DIRECTION_DOWN;
+}
+
+void display_information(void) {
+	// Only the parts of each line that have changed are sent to the terminal
+	term_field_set_number(STATUS_FLOOR, state.cars[0].floor);
+
+	// Next handle the elevator direction display: 
+	Direction direction = car_direction(&state.cars[0]);
+	if (direction == DIRECTION_UP) { // Moving up
+		term_field_set_P(STATUS_DIRECTION, PSTR("Up"));
+	} else if (direction == DIRECTION_DOWN) { // Moving down
+		term_field_set_P(STATUS_DIRECTION, PSTR("Down"));
+	} else { // Stationary
+		term_field_set_P(STATUS_DIRECTION, PSTR("Stationary"));
+	}
+
+	// Handle displaying the floors moved with and without a traveller
+	term_field_set_number(STATUS_FLOORS_WITH, state.totals.floors_w_traveller);
+	term_field_set_number(STATUS_FLOORS_WITHOUT, state.totals.floors_no_traveller);
+	term_field_set_number(STATUS_DELIVERED, state.totals.travellers_delivered);
+	term_field_set_number(STATUS_TURNED_AWAY, dispatch_stats()->turned_away);
+	term_field_set_P(STATUS_POLICY, dispatch_policy_name_P(dispatch_get_policy()));
+	switch (traffic_pattern()) {
+		case TRAFFIC_UP_PEAK:
+			term_field_set_P(STATUS_TRAFFIC, PSTR("Up peak"));
+			break;
+		case TRAFFIC_DOWN_PEAK:
+			term_field_set_P(STATUS_TRAFFIC, PSTR("Down peak"));
+			break;
+		case TRAFFIC_INTER_FLOOR:
+			term_field_set_P(STATUS_TRAFFIC, PSTR("Inter-floor"));
+			break;
+		default:
+			term_field_set_P(STATUS_TRAFFIC, traffic_active() ? PSTR("Trace") : PSTR("Off"));
+			break;
+	}
+	term_field_set_number(STATUS_DEADLINES, latency_misses());
+	if (state.settings.speed == SPEED_FAST) {
+		term_field_set_P(STATUS_SPEED, PSTR("Fast"));
+	} else if (state.settings.speed == SPEED_SLOW) {
+		term_field_set_P(STATUS_SPEED, PSTR("Slow"));
+	} else {
+		term_field_set_P(STATUS_SPEED, PSTR("Switch C7"));
+	}
+
+	// The other cars are shown as their floor followed by ^ (up), v (down)
+	// or - (stationary), e.g. "3^ 0-"
+	if (NUM_CARS > 1) {
+		char cars_text[4 * NUM_CARS];
+		uint8_t length = 0;
+		for (uint8_t car_id = 1; car_id < NUM_CARS; car_id++) {
+			uint8_t floor = state.cars[car_id].floor;
+			if (length > 0) {
+				cars_text[length++] = ' ';
+			}
+			if (floor >= 10) {
+				cars_text[length++] = '1';
+				floor -= 10;
+			}
+			cars_text[length++] = '0' + floor;
+			direction = car_direction(&state.cars[car_id]);
+			if (direction == DIRECTION_UP) {
+				cars_text[length++] = '^';
+			} else if (direction == DIRECTION_DOWN) {
+				cars_text[length++] = 'v';
+			} else {
+				cars_text[length++] = '-';
+			}
+		}
+		cars_text[length] = '\0';
+		term_field_set(STATUS_OTHER_CARS, cars_text);
+	}
+}
+
+/**
+ * @brief Shows a table of the travellers' wait and ride times and the cars'
+ * empty runs (count, minimum, mean, standard deviation, 95th percentile and
+ * maximum, see stats.h). After this only the rows which change are
+ * redrawn (see update_trip_stats()).
+ * @arg none
+ * @retval none
+*/
+void display_trip_stats(void) {
+	move_terminal_cursor(10, TRIP_STATS_ROW);
+	serial_write_P_str("Trips           Count   Min     Mean    SD      P95     Max");
+	clear_to_end_of_line();
+	move_terminal_cursor(10, TRIP_STATS_ROW + 1);
+	serial_write_P_str("Wait (ms)");
+	move_terminal_cursor(10, TRIP_STATS_ROW + 2);
+	serial_write_P_str("Ride (ms)");
+	move_terminal_cursor(10, TRIP_STATS_ROW + 3);
+	serial_write_P_str("Empty floors");
+	update_trip_stats(true, true);
+}
+
+/**
+ * @brief Redraws the rows of the trip statistics table which have changed.
+ * They only change when someone gets on or off, so they are written straight
+ * to the terminal rather than with term_field_set().
+ * @arg delivered true if someone has got off (so the wait and ride times have
+ * changed)
+ * @arg empty_run true if an empty run has finished
+ * @retval none
+*/
+void update_trip_stats(bool delivered, bool empty_run) {
+	if (delivered) {
+		const DispatchStats* stats = dispatch_stats();
+		print_stats_row(TRIP_STATS_ROW + 1, &stats->wait_times);
+		print_stats_row(TRIP_STATS_ROW + 2, &stats->ride_times);
+	}
+	if (empty_run) {
+		print_stats_row(TRIP_STATS_ROW + 3, &state.totals.empty_runs);
+	}
+}
+
+/**
+ * @brief Prints the numbers in one row of the trip statistics table
+ * @arg y the terminal row
+ * @arg stats the statistics to show
+ * @retval none
+*/
+void print_stats_row(uint8_t y, const RunningStats* stats) {
+	move_terminal_cursor(26, y);
+	clear_to_end_of_line();
+	print_number(stats->count);
+	if (stats->count == 0) {
+		return;
+	}
+	move_terminal_cursor(34, y);
+	print_number(stats->min);
+	move_terminal_cursor(42, y);
+	print_number(stats_mean(stats));
+	move_terminal_cursor(50, y);
+	print_number(stats_std_dev(stats));
+	move_terminal_cursor(58, y);
+	print_number(stats_p95(stats));
+	move_terminal_cursor(66, y);
+	print_number(stats->max);
+}
+
+void start_3kHz_sound(void) {
+	(void)sound_play(VOICE_BUTTON, button_sound);
+}
+
+void start_500Hz_sound(void) {
+	(void)sound_play(VOICE_DOOR, door_sound);
+}
+
+void start_arrival_chime(void) {
+	(void)sound_play(VOICE_ARRIVAL, arrival_sound);
+}
@@ -0,0 +1,221 @@
+/*
+ * benchmark.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * The simulation mirrors start_elevator_emulator(): the elevator moves one
+ * LED row every MOVE_TIME ms (4 rows per floor), and at each floor asks the
+ * dispatch module whether to stop. A stop takes DOOR_CYCLE_TIME ms and
+ * travellers get off and on DOOR_OPEN_TIME ms into it (as in the door
+ * animation in TIMER1_COMPA_vect).
+ */
+
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+
+#include "benchmark.h"
+#include "dispatch.h"
+#include "serialio.h"
+#include "terminalio.h"
+
+#define MOVE_TIME 125
+#define DOOR_OPEN_TIME 400
+#define DOOR_CYCLE_TIME 1200
+
+// Travellers arrive at random intervals of up to this many ms (so on
+// average every MAX_ARRIVAL_GAP/2 ms)
+#define MAX_ARRIVAL_GAP 4000
+
+// Give up on travellers who still haven't been delivered by this time
+#define TIME_LIMIT (BENCHMARK_TRAVELLERS * (uint32_t)MAX_ARRIVAL_GAP * 4)
+
+// A car in the simulation. Its doors open DOOR_OPEN_TIME after it stops
+// and it can move again DOOR_CYCLE_TIME after it stops.
+typedef struct {
+	uint8_t position;
+	uint8_t destination;
+	uint8_t last_floor;
+	uint8_t doors_opening; // 1 if next_time is when the doors open
+	uint32_t next_time;
+} SimulatedCar;
+
+static uint32_t random_state;
+static uint16_t travellers_placed;
+static uint32_t next_arrival;
+
+// The dispatcher's statistics while the benchmark uses the dispatcher
+// (too big for the stack)
+static DispatchStats saved_stats;
+
+static uint16_t random_number(uint16_t limit);
+static void add_arrivals(uint32_t now, BenchmarkResult* result);
+static uint8_t not_run(uint8_t y);
+
+void benchmark_policy(uint8_t policy_id, BenchmarkResult* result) {
+	dispatch_set_policy(policy_id);
+	dispatch_init();
+	random_state = BENCHMARK_SEED;
+	travellers_placed = 0;
+	next_arrival = random_number(MAX_ARRIVAL_GAP);
+	result->rejected = 0;
+	result->floors_with_traveller = 0;
+	result->floors_without_traveller = 0;
+	
+	SimulatedCar cars[NUM_CARS];
+	for(uint8_t id = 0; id < NUM_CARS; id++) {
+		cars[id].position = 0;
+		cars[id].destination = 0;
+		cars[id].last_floor = 0;
+		cars[id].doors_opening = 0;
+		cars[id].next_time = 0;
+	}
+	
+	uint32_t now = 0;
+	const DispatchStats* stats = dispatch_stats();
+	
+	while(now < TIME_LIMIT) {
+		// Each step, the car with the earliest next event moves (the lowest
+		// numbered if they are equal)
+		uint8_t id = 0;
+		for(uint8_t other = 1; other < NUM_CARS; other++) {
+			if(cars[other].next_time < cars[id].next_time) {
+				id = other;
+			}
+		}
+		SimulatedCar* car = &cars[id];
+		now = car->next_time;
+		
+		add_arrivals(now, result);
+		if(travellers_placed == BENCHMARK_TRAVELLERS &&
+				stats->delivered + result->rejected == BENCHMARK_TRAVELLERS) {
+			break;
+		}
+		
+		if(car->doors_opening) {
+			uint8_t floor = row_floor(car->position);
+			(void)dispatch_unload(id, floor, now);
+			(void)dispatch_load(id, floor, now);
+			car->doors_opening = 0;
+			car->next_time = now + DOOR_CYCLE_TIME - DOOR_OPEN_TIME;
+			continue;
+		}
+		
+		if(row_is_floor(car->position)) {
+			uint8_t floor = row_floor(car->position);
+			
+			// Count the floors moved, as the emulator does
+			if(floor != car->last_floor) {
+				if(dispatch_onboard_count(id) > 0) {
+					result->floors_with_traveller++;
+				} else {
+					result->floors_without_traveller++;
+				}
+				car->last_floor = floor;
+			}
+			
+			if(dispatch_should_stop(id, floor)) {
+				car->doors_opening = 1;
+				car->next_time = now + DOOR_OPEN_TIME;
+				continue;
+			}
+			uint8_t next_floor = dispatch_next_floor(id, floor);
+			if(next_floor == NO_FLOOR) {
+				car->destination = car->position;
+			} else {
+				car->destination = floor_row(next_floor);
+			}
+		}
+		if(car->destination > car->position) {
+			car->position++;
+		} else if(car->destination < car->position) {
+			car->position--;
+		}
+		car->next_time = now + MOVE_TIME;
+	}
+	
+	result->delivered = stats->delivered;
+	result->average_wait_time = 0;
+	result->average_ride_time = 0;
+	if(stats->delivered > 0) {
+		result->average_wait_time = stats->total_wait_time / stats->delivered;
+		result->average_ride_time = stats->total_ride_time / stats->delivered;
+	}
+	result->finish_time = now;
+}
+
+uint8_t benchmark_run_all(uint8_t y) {
+	// Anyone waiting or travelling would be lost when the dispatcher is
+	// started again afterwards
+	for(uint8_t floor = 0; floor < NUM_FLOORS; floor++) {
+		if(dispatch_waiting_count(floor) > 0) {
+			return not_run(y);
+		}
+	}
+	for(uint8_t id = 0; id < NUM_CARS; id++) {
+		if(dispatch_onboard_count(id) > 0) {
+			return not_run(y);
+		}
+	}
+	uint8_t policy_in_use = dispatch_get_policy();
+	BenchmarkResult result;
+	saved_stats = *dispatch_stats();
+	
+	move_terminal_cursor(10, y);
+	serial_write_P_str("Policy    Delivered  Wait(ms)  Ride(ms)  Floors with/without");
+	clear_to_end_of_line();
+	for(uint8_t policy_id = 0; policy_id < NUM_DISPATCH_POLICIES; policy_id++) {
+		benchmark_policy(policy_id, &result);
+		
+		move_terminal_cursor(10, y + 1 + policy_id);
+		clear_to_end_of_line();
+		const char* name_P = dispatch_policy_name_P(policy_id);
+		serial_write_P(name_P, strlen_P(name_P));
+		move_terminal_cursor(20, y + 1 + policy_id);
+		print_number(result.delivered);
+		move_terminal_cursor(31, y + 1 + policy_id);
+		print_number(result.average_wait_time);
+		move_terminal_cursor(41, y + 1 + policy_id);
+		print_number(result.average_ride_time);
+		move_terminal_cursor(51, y + 1 + policy_id);
+		print_number(result.floors_with_traveller);
+		serial_write_P_str("/");
+		print_number(result.floors_without_traveller);
+	}
+	
+	// With nobody waiting or in a car, all the dispatcher had besides its
+	// statistics was the cars' floors and directions, which it is told
+	// again when they next move
+	dispatch_set_policy(policy_in_use);
+	dispatch_init();
+	*dispatch_stats() = saved_stats;
+	return 1;
+}
+
+// Say why the benchmark can't be run now
+static uint8_t not_run(uint8_t y) {
+	move_terminal_cursor(10, y);
+	serial_write_P_str("Benchmark: wait until nobody is waiting or travelling");
+	clear_to_end_of_line();
+	return 0;
+}
+
+// A linear congruential generator (the same constants as the C standard's
+// example rand()), returning a number from 0 to limit-1
+static uint16_t random_number(uint16_t limit) {
+	random_state = random_state * 1103515245 + 12345;
+	return (uint16_t)(random_state >> 16) % limit;
+}
+
+// Add every traveller who has arrived by time now
+static void add_arrivals(uint32_t now, BenchmarkResult* result) {
+	while(travellers_placed < BENCHMARK_TRAVELLERS && next_arrival <= now) {
+		uint8_t floor = random_number(NUM_FLOORS);
+		uint8_t destination = (floor + 1 + random_number(NUM_FLOORS - 1)) % NUM_FLOORS;
+		if(!dispatch_add_traveller(floor, destination, next_arrival)) {
+			result->rejected++;
+		}
+		travellers_placed++;
+		next_arrival += random_number(MAX_ARRIVAL_GAP);
+	}
+}
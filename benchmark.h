@@ -0,0 +1,55 @@
+/*
+ * benchmark.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Compares the dispatch policies (see dispatch.h) by replaying the same
+ * sequence of travellers through each one in simulated time. The sequence
+ * comes from a fixed seed, so results are repeatable.
+ */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <stdint.h>
+
+#ifndef BENCHMARK_TRAVELLERS
+#define BENCHMARK_TRAVELLERS 100
+#endif
+#ifndef BENCHMARK_SEED
+#define BENCHMARK_SEED 2010
+#endif
+
+// Results for one policy. Times are in milliseconds. Travellers are
+// rejected if their floor already has WAITING_PER_FLOOR waiting. Floors
+// moved are counted the same way as the emulator's status display.
+typedef struct {
+	uint16_t delivered;
+	uint16_t rejected;
+	uint32_t average_wait_time;
+	uint32_t average_ride_time;
+	uint16_t floors_with_traveller;
+	uint16_t floors_without_traveller;
+	uint32_t finish_time;
+} BenchmarkResult;
+
+/* Run the benchmark for one policy. This uses the dispatch module, so
+ * any travellers waiting or in the elevator are removed (and the policy
+ * in use is changed to policy_id).
+ */
+void benchmark_policy(uint8_t policy_id, BenchmarkResult* result);
+
+/* Run the benchmark for every policy and print a table of the results on
+ * the terminal, starting at row y. This only works when nobody is waiting
+ * or in a car, as then the dispatch module can be put back as it was by
+ * starting it again and putting back its statistics (with the policy used
+ * before). Otherwise nothing is run, a message is printed instead and 0 is
+ * returned.
+ * The whole of every policy's simulation runs before this returns, so
+ * nothing else in the main loop (moving the cars, the doors, drawing)
+ * happens until then. The caller should forget the deadlines which were
+ * due meanwhile (see latency_forget()).
+ */
+uint8_t benchmark_run_all(uint8_t y);
+
+#endif /* BENCHMARK_H_ */
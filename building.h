@@ -0,0 +1,57 @@
+/*
+ * building.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * The shape of the building. Floors are numbered from 0 (the bottom
+ * floor) and are FLOOR_SPACING rows apart, with floor 0 on row 0. Rows
+ * count up from the bottom of the building, and the elevator's position
+ * is the row of the floor line under it. Floor lookups are shifts, so
+ * FLOOR_SPACING is a power of two (set by FLOOR_SHIFT).
+ *
+ * NUM_FLOORS and FLOOR_SHIFT can be chosen at compile time. The building
+ * is BUILDING_ROWS high - if that is more than the LED matrix the display
+ * scrolls to follow the elevator (see display_set_view()).
+ */
+
+#ifndef BUILDING_H_
+#define BUILDING_H_
+
+#include <stdint.h>
+
+#ifndef NUM_FLOORS
+#define NUM_FLOORS 4
+#endif
+#ifndef FLOOR_SHIFT
+#define FLOOR_SHIFT 2
+#endif
+
+#define FLOOR_SPACING (1 << FLOOR_SHIFT)
+
+// Each floor has its floor line and the space above it, so the elevator
+// (3 rows high) fits above the top floor
+#define BUILDING_ROWS (NUM_FLOORS * FLOOR_SPACING)
+
+#if NUM_FLOORS < 2 || NUM_FLOORS > 16
+#error "NUM_FLOORS must be between 2 and 16"
+#endif
+#if FLOOR_SHIFT < 2 || BUILDING_ROWS > 255
+#error "FLOOR_SHIFT must be at least 2 and the building at most 255 rows"
+#endif
+
+// Set of floors, with bit n for floor n
+#if NUM_FLOORS <= 8
+typedef uint8_t FloorMask;
+#else
+typedef uint16_t FloorMask;
+#endif
+
+#define FLOOR_BIT(floor) ((FloorMask)(1u << (floor)))
+
+// The row of a floor's floor line, the floor a row is on or above, and
+// whether a row is a floor line
+#define floor_row(floor) ((uint8_t)((floor) << FLOOR_SHIFT))
+#define row_floor(row) ((uint8_t)((row) >> FLOOR_SHIFT))
+#define row_is_floor(row) (((row) & (FLOOR_SPACING - 1)) == 0)
+
+#endif /* BUILDING_H_ */
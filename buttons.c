@@ -1,96 +1,157 @@
-/*
- * buttons.c
- *
- * Author: Peter Sutton
- */ 
-
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include "buttons.h"
-
-// Global variable to keep track of the last button state so that we 
-// can detect changes when an interrupt fires. The lower 4 bits (0 to 3)
-// will correspond to the last state of port B pins 0 to 3.
-static volatile uint8_t last_button_state;
-
-// Our button queue. button_queue[0] is always the head of the queue. If we
-// take something off the queue we just move everything else along. We don't
-// use a circular buffer since it is usually expected that the queue is very
-// short. In most uses it will never have more than 1 element at a time.
-// This button queue can be changed by the interrupt handler below so we should
-// turn off interrupts if we're changing the queue outside the handler.
-#define BUTTON_QUEUE_SIZE 4
-static volatile uint8_t button_queue[BUTTON_QUEUE_SIZE];
-static volatile int8_t queue_length;
-
-// Setup interrupt if any of pins B0 to B3 change. We do this
-// using a pin change interrupt. These pins correspond to pin
-// change interrupts PCINT8 to PCINT11 which are covered by
-// Pin change interrupt 1.
-void init_button_interrupts(void) {
-	// Enable the interrupt (see datasheet page 77)
-	PCICR |= (1<<PCIE1);
-	
-	// Make sure the interrupt flag is cleared (by writing a 
-	// 1 to it) (see datasheet page 78)
-	PCIFR |= (1<<PCIF1);
-	
-	// Choose which pins we're interested in by setting
-	// the relevant bits in the mask register (see datasheet page 78)
-	PCMSK1 |= (1<<PCINT8)|(1<<PCINT9)|(1<<PCINT10)|(1<<PCINT11);	
-	
-	// Empty the button push queue
-	queue_length = 0;
-}
-
-int8_t button_pushed(void) {
-	int8_t return_value = NO_BUTTON_PUSHED;	// Assume no button pushed
-	if(queue_length > 0) {
-		// Remove the first element off the queue and move all the other
-		// entries closer to the front of the queue. We turn off interrupts (if on)
-		// before we make any changes to the queue. If interrupts were on
-		// we turn them back on when done.
-		return_value = button_queue[0];
-		
-		// Save whether interrupts were enabled and turn them off
-		int8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
-		cli();
-		
-		for(uint8_t i = 1; i < queue_length; i++) {
-			button_queue[i-1] = button_queue[i];
-		}
-		queue_length--;
-		
-		if(interrupts_were_enabled) {
-			// Turn them back on again
-			sei();
-		}
-	}
-	return return_value;
-}
-
-
-// Interrupt handler for a change on buttons
-ISR(PCINT1_vect) {
-	// Get the current state of the buttons. We'll compare this with
-	// the last state to see what has changed.
-	uint8_t button_state = PINB & 0x0F;
-	
-	// Iterate over all the buttons and see which ones have changed.
-	// Any button pushes are added to the queue of button pushes (if
-	// there is space). We ignore button releases so we're just looking
-	// for a transition from 0 in the last_button_state bit to a 1 in the 
-	// button_state.
-	for(uint8_t pin=0; pin<=3; pin++) {
-		if(queue_length < BUTTON_QUEUE_SIZE && 
-				(button_state & (1<<pin)) && 
-				!(last_button_state & (1<<pin))) {
-			// Add the button push to the queue (and update the
-			// length of the queue
-			button_queue[queue_length++] = pin;
-		}
-	}
-	
-	// Remember this button state
-	last_button_state = button_state;
-}
+/*
+ * buttons.c
+ *
+ * Author: Peter Sutton
+ */ 
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "buttons.h"
+
+// Debounced state of the buttons. The lower 4 bits (0 to 3) correspond to
+// port B pins 0 to 3 and are only changed when a pin has read the same
+// (new) value for 4 samples in a row. The two count bytes form a 2 bit
+// counter for each pin ("vertical" counter - bit n of count0 and bit n of
+// count1 make up the counter for pin n) of how many samples in a row
+// have differed from the debounced state. All counters are updated at once
+// with a few logic operations. They start at 3 and count down.
+static uint8_t debounced_state;
+static uint8_t count0 = 0xFF;
+static uint8_t count1 = 0xFF;
+
+// Time (low 16 bits of the clock tick) each button was last pressed, and
+// which held buttons have already had a long press reported.
+static uint16_t press_time[4];
+static uint8_t long_press_reported;
+
+// Our button event queue. This is a circular buffer with a single producer
+// (button_sample(), called from the timer 0 interrupt handler) and a single
+// consumer (button_event_get()). The producer only ever writes queue_head
+// and the consumer only ever writes queue_tail, so neither side needs to
+// turn interrupts off. The positions are free-running 8 bit counters - the
+// number of entries in the queue is queue_head - queue_tail (which works
+// even after they wrap around) and the buffer index is the position masked
+// to the queue size.
+#define BUTTON_QUEUE_MASK (BUTTON_QUEUE_SIZE - 1)
+#if (BUTTON_QUEUE_SIZE & BUTTON_QUEUE_MASK) != 0 || BUTTON_QUEUE_SIZE > 128
+#error "BUTTON_QUEUE_SIZE must be a power of two no larger than 128"
+#endif
+static volatile ButtonEvent button_queue[BUTTON_QUEUE_SIZE];
+static volatile uint8_t queue_head;
+static volatile uint8_t queue_tail;
+
+// Number of button events discarded because the queue was full
+static volatile uint16_t queue_overflows;
+
+static void queue_event(uint8_t button, uint8_t type, uint32_t now);
+
+// The buttons are just read every millisecond by button_sample() so there
+// is nothing to set up other than making sure pins B0 to B3 are inputs and
+// the queue is empty.
+void init_button_interrupts(void) {
+	DDRB &= ~((1<<PB0)|(1<<PB1)|(1<<PB2)|(1<<PB3));
+	
+	debounced_state = PINB & 0x0F;
+	count0 = 0xFF;
+	count1 = 0xFF;
+	long_press_reported = 0;
+	
+	// Empty the button event queue
+	queue_head = 0;
+	queue_tail = 0;
+	queue_overflows = 0;
+}
+
+uint8_t button_event_get(ButtonEvent* event) {
+	uint8_t tail = queue_tail;
+	if(queue_head == tail) {
+		return 0;
+	}
+	// Take the entry at the tail of the queue, then move the tail
+	// on. The entry must be read before queue_tail is updated since
+	// the interrupt handler may reuse the slot as soon as it is.
+	volatile ButtonEvent* entry = &button_queue[tail & BUTTON_QUEUE_MASK];
+	event->time = entry->time;
+	event->button = entry->button;
+	event->type = entry->type;
+	queue_tail = tail + 1;
+	return 1;
+}
+
+int8_t button_pushed(void) {
+	ButtonEvent event;
+	// Discard anything other than presses
+	while(button_event_get(&event)) {
+		if(event.type == BUTTON_PRESS) {
+			return event.button;
+		}
+	}
+	return NO_BUTTON_PUSHED;
+}
+
+uint8_t button_idle(void) {
+	// The pins must match the debounced state, otherwise a debounce
+	// counter is running
+	return queue_head == queue_tail && debounced_state == 0 &&
+			(PINB & 0x0F) == 0;
+}
+
+uint16_t button_queue_overflows(void) {
+	uint16_t return_value;
+	
+	// The count is 16 bits, so make sure the interrupt handler doesn't
+	// change it while we read it
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	return_value = queue_overflows;
+	if(interrupts_were_enabled) {
+		sei();
+	}
+	return return_value;
+}
+
+// Called every millisecond (from the timer 0 interrupt handler) with the
+// current clock tick.
+void button_sample(uint32_t now) {
+	// Update the debounce counters. Any pin whose reading matches the
+	// debounced state has its counter reset. Other counters count down
+	// and those that reach zero (4 samples) are the pins that changed.
+	uint8_t changed = debounced_state ^ (PINB & 0x0F);
+	count0 = ~(count0 & changed);
+	count1 = count0 ^ (count1 & changed);
+	changed &= count0 & count1;
+	debounced_state ^= changed;
+	
+	for(uint8_t pin=0; pin<=3; pin++) {
+		uint8_t mask = (1<<pin);
+		if(changed & mask) {
+			if(debounced_state & mask) {
+				press_time[pin] = (uint16_t)now;
+				long_press_reported &= ~mask;
+				queue_event(pin, BUTTON_PRESS, now);
+			} else {
+				queue_event(pin, BUTTON_RELEASE, now);
+			}
+		} else if((debounced_state & mask) && !(long_press_reported & mask) &&
+				(uint16_t)((uint16_t)now - press_time[pin]) >= BUTTON_LONG_PRESS_MS) {
+			long_press_reported |= mask;
+			queue_event(pin, BUTTON_LONG_PRESS, now);
+		}
+	}
+}
+
+// Add an event at the head of the queue (if there is space - otherwise
+// we count it as lost).
+static void queue_event(uint8_t button, uint8_t type, uint32_t now) {
+	uint8_t head = queue_head;
+	if((uint8_t)(head - queue_tail) < BUTTON_QUEUE_SIZE) {
+		volatile ButtonEvent* entry = &button_queue[head & BUTTON_QUEUE_MASK];
+		entry->time = now;
+		entry->button = button;
+		entry->type = type;
+		// Publish the new entry to button_event_get()
+		queue_head = head + 1;
+	} else {
+		queue_overflows++;
+	}
+}
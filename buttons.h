@@ -1,38 +1,96 @@
-/*
- * buttons.h
- *
- * Author: Peter Sutton
- *
- * We assume four push buttons (B0 to B3) are connected to pins B0 to B3. We configure
- * pin change interrupts on these pins.
- */ 
-
-
-#ifndef BUTTONS_H_
-#define BUTTONS_H_
-
-#include <stdint.h>
-
-#define NO_BUTTON_PUSHED (-1)
-#define BUTTON0_PUSHED 0
-#define BUTTON1_PUSHED 1
-#define BUTTON2_PUSHED 2
-#define BUTTON3_PUSHED 3
-
-/* Set up pin change interrupts on pins B0 to B3.
- * It is assumed that global interrupts are off when this function is called
- * and are enabled sometime after this function is called.
- */
-void init_button_interrupts(void);
-
-/* Return the last button pushed (0 to 3) or -1 (NO_BUTTON_PUSHED) if 
- * there are no button pushes to return. (A small queue of button pushes
- * is kept. This function should be called frequently enough to
- * ensure the queue does not overflow. Excess button pushes are
- * discarded.)
- */
-
-int8_t button_pushed(void);
-
-
+/*
+ * buttons.h
+ *
+ * Author: Peter Sutton
+ *
+ * We assume four push buttons (B0 to B3) are connected to pins B0 to B3. These
+ * pins are sampled every millisecond (from the timer 0 interrupt) and
+ * debounced - a button must read the same for 4 samples in a row before a
+ * press or release is reported.
+ */ 
+
+
+#ifndef BUTTONS_H_
+#define BUTTONS_H_
+
+#include <stdint.h>
+
+#define NO_BUTTON_PUSHED (-1)
+#define BUTTON0_PUSHED 0
+#define BUTTON1_PUSHED 1
+#define BUTTON2_PUSHED 2
+#define BUTTON3_PUSHED 3
+
+/* Number of button events that can be queued. Must be a power of two
+ * (no larger than 128). Can be changed at compile time.
+ */
+#ifndef BUTTON_QUEUE_SIZE
+#define BUTTON_QUEUE_SIZE 8
+#endif
+
+/* How long (in milliseconds) a button must be held before a long press
+ * event is reported. Must be less than 65536.
+ */
+#ifndef BUTTON_LONG_PRESS_MS
+#define BUTTON_LONG_PRESS_MS 1000
+#endif
+
+/* Types of button event. A long press is reported (once) when a button has
+ * been held for BUTTON_LONG_PRESS_MS - the press itself has already been
+ * reported and the release will be reported later.
+ */
+#define BUTTON_PRESS 0
+#define BUTTON_RELEASE 1
+#define BUTTON_LONG_PRESS 2
+
+/* A button event. time is the clock tick (see get_current_time()) at which
+ * the event was detected, button is 0 to 3 and type is one of the values
+ * above.
+ */
+typedef struct {
+	uint32_t time;
+	uint8_t button;
+	uint8_t type;
+} ButtonEvent;
+
+/* Set up button handling on pins B0 to B3.
+ * It is assumed that global interrupts are off when this function is called
+ * and are enabled sometime after this function is called. Timer 0 must also
+ * be set up (see init_timer0()) for buttons to be read.
+ */
+void init_button_interrupts(void);
+
+/* Get the next button event from the queue. Returns 1 and fills in *event if
+ * there was one, or returns 0 if the queue is empty.
+ */
+uint8_t button_event_get(ButtonEvent* event);
+
+/* Return the last button pushed (0 to 3) or -1 (NO_BUTTON_PUSHED) if 
+ * there are no button pushes to return. Release and long press events
+ * ahead of the push in the queue are discarded. (A small queue of events
+ * is kept. This function should be called frequently enough to
+ * ensure the queue does not overflow. Excess button pushes are
+ * discarded.) Interrupts are not disabled by this function.
+ */
+
+int8_t button_pushed(void);
+
+/* Return 1 if no button is held or bouncing and there are no events in
+ * the queue - i.e. nothing will happen until a button is next pushed.
+ * Should be called with interrupts disabled so that the answer can't
+ * change before it is acted on (see power_sleep_tickless()).
+ */
+uint8_t button_idle(void);
+
+/* Return the number of button events discarded because the queue was full.
+ */
+uint16_t button_queue_overflows(void);
+
+/* Read and debounce the buttons, queueing any events. now is the current
+ * clock tick. This is called every millisecond by the timer 0 interrupt
+ * handler and should not be called elsewhere.
+ */
+void button_sample(uint32_t now);
+
+
 #endif /* BUTTONS_H_ */
\ No newline at end of file
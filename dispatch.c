@@ -0,0 +1,642 @@
+/*
+ * dispatch.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See dispatch.h. Calls are kept as bit masks (bit n for floor n) so
+ * questions like "is there anything above this floor" are a single
+ * comparison. The parts that differ between dispatch policies are
+ * functions in a DispatchPolicy table - everything else (keeping track of
+ * travellers and calls) is shared.
+ *
+ * Each hall call is assigned to one car, and the policies only see the
+ * hall calls of the car they are deciding for (the car pointer, set by
+ * each of the dispatch_ functions which take a car). With one car this is
+ * every hall call.
+ */
+
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+
+#include "dispatch.h"
+
+// A traveller waiting on a floor or in the elevator. Times are in
+// milliseconds (see get_current_time()).
+typedef struct {
+	uint8_t destination;
+	uint32_t arrival_time;
+	uint32_t board_time;
+} Traveller;
+
+// The state of one car. Direction is kept in a uint8_t as an enum
+// would take two bytes.
+typedef struct {
+	Traveller onboard[CAR_CAPACITY];
+	uint8_t onboard_count;
+	// Floors assigned to this car where someone is waiting to go up or
+	// down, and floors where someone in the car wants to get off
+	FloorMask up_calls;
+	FloorMask down_calls;
+	FloorMask car_calls;
+	uint8_t direction;
+	// The last floor the car was at (see dispatch_should_stop())
+	uint8_t floor;
+	// The destination all travellers in the car share (destination
+	// grouping policy only)
+	uint8_t group_destination;
+} Car;
+
+// The travellers waiting on each floor, in the order they arrived, and
+// the cars
+static Traveller waiting[NUM_FLOORS][WAITING_PER_FLOOR];
+static uint8_t waiting_count[NUM_FLOORS];
+static Car cars[NUM_CARS];
+
+// The car being decided for
+static Car* car = &cars[0];
+
+// The floors below floor, and the floors up to and including floor. (The
+// shifts are unsigned so they are defined for the top floor.)
+#define FLOORS_BELOW(floor) ((FloorMask)(FLOOR_BIT(floor) - 1))
+#define FLOORS_UP_TO(floor) ((FloorMask)((2u << (floor)) - 1))
+
+// A stop takes about as long as moving this many floors (when estimating
+// how soon a car can answer a call)
+#define STOP_COST 2
+
+static DispatchStats stats;
+
+/* The decisions that differ between policies:
+ * should_stop - see dispatch_should_stop()
+ * next_floor - see dispatch_next_floor()
+ * begin_load - called when the doors open at floor (after travellers have
+ *   got off), before may_board() is called for the waiting travellers
+ * may_board - return 1 if the traveller in slot on floor (going to 
+ *   destination) should get on. (The elevator must also have room.)
+ */
+typedef struct {
+	uint8_t (*should_stop)(uint8_t floor);
+	uint8_t (*next_floor)(uint8_t floor);
+	void (*begin_load)(uint8_t floor);
+	uint8_t (*may_board)(uint8_t floor, uint8_t slot, uint8_t destination);
+} DispatchPolicy;
+
+static uint8_t fcfs_should_stop(uint8_t floor);
+static uint8_t fcfs_next_floor(uint8_t floor);
+static uint8_t fcfs_may_board(uint8_t floor, uint8_t slot, uint8_t destination);
+static uint8_t nearest_should_stop(uint8_t floor);
+static uint8_t nearest_next_floor(uint8_t floor);
+static uint8_t look_should_stop(uint8_t floor);
+static uint8_t look_next_floor(uint8_t floor);
+static void look_begin_load(uint8_t floor);
+static uint8_t look_may_board(uint8_t floor, uint8_t slot, uint8_t destination);
+static uint8_t grouping_should_stop(uint8_t floor);
+static uint8_t grouping_next_floor(uint8_t floor);
+static void grouping_begin_load(uint8_t floor);
+static uint8_t grouping_may_board(uint8_t floor, uint8_t slot, uint8_t destination);
+static void update_group(void);
+static void no_begin_load(uint8_t floor);
+static uint8_t always_board(uint8_t floor, uint8_t slot, uint8_t destination);
+
+// Indexed by DispatchPolicyId
+static const DispatchPolicy policies[NUM_DISPATCH_POLICIES] = {
+	{fcfs_should_stop, fcfs_next_floor, no_begin_load, fcfs_may_board},
+	{nearest_should_stop, nearest_next_floor, no_begin_load, always_board},
+	{look_should_stop, look_next_floor, look_begin_load, look_may_board},
+	{grouping_should_stop, grouping_next_floor, grouping_begin_load, grouping_may_board}
+};
+static const char fcfs_name[] PROGMEM = "FCFS";
+static const char nearest_name[] PROGMEM = "Nearest";
+static const char look_name[] PROGMEM = "LOOK";
+static const char grouping_name[] PROGMEM = "Grouping";
+static const char* const policy_names[NUM_DISPATCH_POLICIES] PROGMEM = {
+	fcfs_name, nearest_name, look_name, grouping_name
+};
+
+static const DispatchPolicy* policy = &policies[DISPATCH_POLICY];
+
+static void update_calls(uint8_t floor);
+static uint8_t best_car(uint8_t floor, Direction call_direction);
+static uint8_t estimate_arrival(const Car* c, uint8_t floor, Direction call_direction);
+static uint8_t count_floors(FloorMask floors);
+static Direction direction_from(uint8_t floor, uint8_t destination);
+static uint8_t head_for(uint8_t floor, uint8_t target);
+static uint8_t waiting_for(uint8_t floor, uint8_t destination);
+static uint8_t oldest_waiting_floor(void);
+static uint8_t nearest_floor(uint8_t floor, FloorMask floors);
+static FloorMask floors_above(uint8_t floor);
+static FloorMask floors_below(uint8_t floor);
+static uint8_t lowest_floor(FloorMask floors);
+static uint8_t highest_floor(FloorMask floors);
+
+void dispatch_init(void) {
+	for(uint8_t floor = 0; floor < NUM_FLOORS; floor++) {
+		waiting_count[floor] = 0;
+	}
+	for(uint8_t id = 0; id < NUM_CARS; id++) {
+		cars[id].onboard_count = 0;
+		cars[id].up_calls = 0;
+		cars[id].down_calls = 0;
+		cars[id].car_calls = 0;
+		cars[id].direction = DIRECTION_NONE;
+		cars[id].floor = 0;
+	}
+	stats.delivered = 0;
+	stats.turned_away = 0;
+	stats.total_wait_time = 0;
+	stats.total_ride_time = 0;
+	stats_init(&stats.wait_times);
+	stats_init(&stats.ride_times);
+}
+
+void dispatch_set_policy(uint8_t policy_id) {
+	if(policy_id < NUM_DISPATCH_POLICIES) {
+		policy = &policies[policy_id];
+	}
+}
+
+uint8_t dispatch_get_policy(void) {
+	return policy - policies;
+}
+
+const char* dispatch_policy_name_P(uint8_t policy_id) {
+	return (const char*)pgm_read_word(&policy_names[policy_id]);
+}
+
+uint8_t dispatch_add_traveller(uint8_t floor, uint8_t destination, uint32_t now) {
+	if(floor >= NUM_FLOORS || destination >= NUM_FLOORS || floor == destination) {
+		return 0;
+	}
+	if(waiting_count[floor] >= WAITING_PER_FLOOR) {
+		if(stats.turned_away < UINT16_MAX) {
+			stats.turned_away++;
+		}
+		return 0;
+	}
+	Traveller* traveller = &waiting[floor][waiting_count[floor]++];
+	traveller->destination = destination;
+	traveller->arrival_time = now;
+	update_calls(floor);
+	return 1;
+}
+
+uint8_t dispatch_waiting_count(uint8_t floor) {
+	return waiting_count[floor];
+}
+
+uint8_t dispatch_waiting_destination(uint8_t floor, uint8_t slot) {
+	return waiting[floor][slot].destination;
+}
+
+uint8_t dispatch_onboard_count(uint8_t car_id) {
+	return cars[car_id].onboard_count;
+}
+
+Direction dispatch_direction(uint8_t car_id) {
+	return cars[car_id].direction;
+}
+
+void dispatch_get_stats(DispatchStats* result) {
+	*result = stats;
+}
+
+DispatchStats* dispatch_stats(void) {
+	return &stats;
+}
+
+uint8_t dispatch_should_stop(uint8_t car_id, uint8_t floor) {
+	car = &cars[car_id];
+	car->floor = floor;
+	return policy->should_stop(floor);
+}
+
+uint8_t dispatch_next_floor(uint8_t car_id, uint8_t floor) {
+	car = &cars[car_id];
+	car->floor = floor;
+	return policy->next_floor(floor);
+}
+
+uint8_t dispatch_unload(uint8_t car_id, uint8_t floor, uint32_t now) {
+	car = &cars[car_id];
+	uint8_t count = 0;
+	uint8_t i = 0;
+	while(i < car->onboard_count) {
+		Traveller* traveller = &car->onboard[i];
+		if(traveller->destination == floor) {
+			uint32_t wait_time = traveller->board_time - traveller->arrival_time;
+			uint32_t ride_time = now - traveller->board_time;
+			stats.delivered++;
+			stats.total_wait_time += wait_time;
+			stats.total_ride_time += ride_time;
+			stats_add(&stats.wait_times, wait_time < UINT16_MAX ? wait_time : UINT16_MAX);
+			stats_add(&stats.ride_times, ride_time < UINT16_MAX ? ride_time : UINT16_MAX);
+			// Move the last traveller into this place
+			*traveller = car->onboard[--car->onboard_count];
+			count++;
+		} else {
+			i++;
+		}
+	}
+	car->car_calls &= ~FLOOR_BIT(floor);
+	return count;
+}
+
+uint8_t dispatch_load(uint8_t car_id, uint8_t floor, uint32_t now) {
+	car = &cars[car_id];
+	policy->begin_load(floor);
+	
+	// Take on the travellers the policy picks (in the order they arrived)
+	// and shuffle the rest along to keep the order
+	uint8_t count = 0;
+	uint8_t kept = 0;
+	for(uint8_t slot = 0; slot < waiting_count[floor]; slot++) {
+		Traveller* traveller = &waiting[floor][slot];
+		if(car->onboard_count < CAR_CAPACITY && 
+				policy->may_board(floor, slot, traveller->destination)) {
+			car->onboard[car->onboard_count] = *traveller;
+			car->onboard[car->onboard_count].board_time = now;
+			car->onboard_count++;
+			car->car_calls |= FLOOR_BIT(traveller->destination);
+			count++;
+		} else {
+			waiting[floor][kept++] = *traveller;
+		}
+	}
+	waiting_count[floor] = kept;
+	
+	// Anyone left behind is given to whichever car can now get to them
+	// soonest (which may be this one, e.g. after it turns around)
+	car->up_calls &= ~FLOOR_BIT(floor);
+	car->down_calls &= ~FLOOR_BIT(floor);
+	update_calls(floor);
+	return count;
+}
+
+/*
+ * First come, first served. The elevator takes one traveller at a time,
+ * in the order they arrived.
+ */
+static uint8_t fcfs_should_stop(uint8_t floor) {
+	if(car->car_calls & FLOOR_BIT(floor)) {
+		return 1;
+	}
+	return car->onboard_count == 0 && oldest_waiting_floor() == floor;
+}
+
+static uint8_t fcfs_next_floor(uint8_t floor) {
+	if(car->onboard_count > 0) {
+		return head_for(floor, car->onboard[0].destination);
+	}
+	return head_for(floor, oldest_waiting_floor());
+}
+
+static uint8_t fcfs_may_board(uint8_t floor, uint8_t slot, uint8_t destination) {
+	return car->onboard_count == 0 && slot == 0 && oldest_waiting_floor() == floor;
+}
+
+/*
+ * Nearest call first. The elevator goes to the closest floor where anyone
+ * is waiting or wants to get off, and picks up everyone who fits.
+ */
+static uint8_t nearest_should_stop(uint8_t floor) {
+	FloorMask here = FLOOR_BIT(floor);
+	if(car->car_calls & here) {
+		return 1;
+	}
+	return car->onboard_count < CAR_CAPACITY && ((car->up_calls | car->down_calls) & here);
+}
+
+static uint8_t nearest_next_floor(uint8_t floor) {
+	FloorMask calls = car->car_calls;
+	if(car->onboard_count < CAR_CAPACITY) {
+		calls |= car->up_calls | car->down_calls;
+	}
+	return head_for(floor, nearest_floor(floor, calls));
+}
+
+/*
+ * LOOK. The elevator keeps moving in one direction while there are calls
+ * ahead of it, stopping for travellers who want to get off and for waiting
+ * travellers going the same way, then turns around at the last call.
+ */
+static uint8_t look_should_stop(uint8_t floor) {
+	FloorMask here = FLOOR_BIT(floor);
+	
+	if(car->car_calls & here) {
+		return 1; // someone wants to get off
+	}
+	if(car->onboard_count >= CAR_CAPACITY) {
+		return 0; // no room to pick anyone up
+	}
+	switch(car->direction) {
+		case DIRECTION_NONE:
+			return ((car->up_calls | car->down_calls) & here) != 0;
+		case DIRECTION_UP:
+			// Pick up travellers going up, or turn around here if
+			// there is nothing further up
+			return (car->up_calls & here) ||
+				((car->down_calls & here) && !floors_above(floor));
+		case DIRECTION_DOWN:
+			return (car->down_calls & here) ||
+				((car->up_calls & here) && !floors_below(floor));
+	}
+	return 0;
+}
+
+static uint8_t look_next_floor(uint8_t floor) {
+	FloorMask above = floors_above(floor);
+	FloorMask below = floors_below(floor);
+	
+	if(car->direction == DIRECTION_UP && !above) {
+		car->direction = below ? DIRECTION_DOWN : DIRECTION_NONE;
+	} else if(car->direction == DIRECTION_DOWN && !below) {
+		car->direction = above ? DIRECTION_UP : DIRECTION_NONE;
+	} else if(car->direction == DIRECTION_NONE) {
+		// Head for the nearest call
+		uint8_t nearest = nearest_floor(floor, above | below);
+		if(nearest != NO_FLOOR) {
+			car->direction = direction_from(floor, nearest);
+		}
+	}
+	
+	// The next stop is the nearest floor ahead where someone gets off or
+	// someone is waiting to go our way. If there are none, we go to the
+	// furthest traveller waiting to go the other way (and turn around there).
+	if(car->direction == DIRECTION_UP) {
+		FloorMask stops = (car->car_calls | car->up_calls) & above;
+		if(stops) {
+			return lowest_floor(stops);
+		}
+		return highest_floor(above);
+	} else if(car->direction == DIRECTION_DOWN) {
+		FloorMask stops = (car->car_calls | car->down_calls) & below;
+		if(stops) {
+			return highest_floor(stops);
+		}
+		return lowest_floor(below);
+	}
+	return NO_FLOOR;
+}
+
+static void look_begin_load(uint8_t floor) {
+	FloorMask here = FLOOR_BIT(floor);
+	
+	// Work out which way we will leave. We keep going the same way if
+	// anyone (in the elevator or waiting) needs us to, otherwise we
+	// turn around or, if idle, go the way of the first traveller waiting.
+	if(car->direction == DIRECTION_UP && !floors_above(floor) && !(car->up_calls & here)) {
+		car->direction = DIRECTION_DOWN;
+	} else if(car->direction == DIRECTION_DOWN && !floors_below(floor) && !(car->down_calls & here)) {
+		car->direction = DIRECTION_UP;
+	}
+	if(car->direction == DIRECTION_NONE && waiting_count[floor] > 0) {
+		car->direction = direction_from(floor, waiting[floor][0].destination);
+	}
+}
+
+static uint8_t look_may_board(uint8_t floor, uint8_t slot, uint8_t destination) {
+	return direction_from(floor, destination) == car->direction;
+}
+
+/*
+ * Destination grouping. Everyone in the elevator is going to the same
+ * floor, so each trip has only one drop off. On the way, the elevator
+ * stops for anyone else going to that floor.
+ */
+static uint8_t grouping_should_stop(uint8_t floor) {
+	update_group();
+	if(car->car_calls & FLOOR_BIT(floor)) {
+		return 1;
+	}
+	if(car->onboard_count == 0) {
+		return ((car->up_calls | car->down_calls) & FLOOR_BIT(floor)) != 0;
+	}
+	return car->onboard_count < CAR_CAPACITY && waiting_for(floor, car->group_destination);
+}
+
+static uint8_t grouping_next_floor(uint8_t floor) {
+	update_group();
+	if(car->onboard_count > 0) {
+		return head_for(floor, car->group_destination);
+	}
+	return head_for(floor, nearest_floor(floor, car->up_calls | car->down_calls));
+}
+
+static void grouping_begin_load(uint8_t floor) {
+	// An empty elevator takes the group of the first traveller waiting
+	if(car->onboard_count == 0 && waiting_count[floor] > 0) {
+		car->group_destination = waiting[floor][0].destination;
+	}
+	update_group();
+}
+
+static uint8_t grouping_may_board(uint8_t floor, uint8_t slot, uint8_t destination) {
+	return destination == car->group_destination;
+}
+
+// The travellers in the car may not all be in its group, if they got on
+// under another policy. Once nobody is left for the group's floor, the
+// group becomes the destination of the first traveller in the car.
+static void update_group(void) {
+	if(car->onboard_count > 0 && !(car->car_calls & FLOOR_BIT(car->group_destination))) {
+		car->group_destination = car->onboard[0].destination;
+	}
+}
+
+static void no_begin_load(uint8_t floor) {
+}
+
+static uint8_t always_board(uint8_t floor, uint8_t slot, uint8_t destination) {
+	return 1;
+}
+
+// Recalculate the hall calls for floor from the travellers waiting there.
+// Calls which have gone are taken off the car they were assigned to, and
+// new calls are assigned to the car which can answer them soonest.
+static void update_calls(uint8_t floor) {
+	FloorMask here = FLOOR_BIT(floor);
+	FloorMask up = 0;
+	FloorMask down = 0;
+	for(uint8_t slot = 0; slot < waiting_count[floor]; slot++) {
+		if(waiting[floor][slot].destination > floor) {
+			up = here;
+		} else {
+			down = here;
+		}
+	}
+	
+	FloorMask up_assigned = 0;
+	FloorMask down_assigned = 0;
+	for(uint8_t id = 0; id < NUM_CARS; id++) {
+		cars[id].up_calls &= up | (FloorMask)~here;
+		cars[id].down_calls &= down | (FloorMask)~here;
+		up_assigned |= cars[id].up_calls;
+		down_assigned |= cars[id].down_calls;
+	}
+	if(up & ~up_assigned) {
+		cars[best_car(floor, DIRECTION_UP)].up_calls |= here;
+	}
+	if(down & ~down_assigned) {
+		cars[best_car(floor, DIRECTION_DOWN)].down_calls |= here;
+	}
+}
+
+// Return the car with the lowest estimated time to answer a call on floor
+// (the lowest numbered car if there is a tie)
+static uint8_t best_car(uint8_t floor, Direction call_direction) {
+	uint8_t best = 0;
+	uint8_t best_time = 0xFF;
+	for(uint8_t id = 0; id < NUM_CARS; id++) {
+		uint8_t time = estimate_arrival(&cars[id], floor, call_direction);
+		if(time < best_time) {
+			best = id;
+			best_time = time;
+		}
+	}
+	return best;
+}
+
+// Estimate how long car c would take to reach floor and pick up a traveller
+// going in call_direction, in floors moved. The car is assumed to carry on
+// to the last of its stops before turning around, and each stop it already
+// has to make adds STOP_COST. A full car has to let people off first, so
+// is assumed to take NUM_FLOORS longer.
+static uint8_t estimate_arrival(const Car* c, uint8_t floor, Direction call_direction) {
+	FloorMask stops = c->car_calls | c->up_calls | c->down_calls;
+	uint8_t at = c->floor;
+	uint8_t top = at;
+	uint8_t bottom = at;
+	if(stops) {
+		if(highest_floor(stops) > top) {
+			top = highest_floor(stops);
+		}
+		if(lowest_floor(stops) < bottom) {
+			bottom = lowest_floor(stops);
+		}
+	}
+	if(floor > top) {
+		top = floor;
+	}
+	if(floor < bottom) {
+		bottom = floor;
+	}
+	
+	uint8_t time;
+	if(c->direction == DIRECTION_UP) {
+		if(call_direction == DIRECTION_UP && floor >= at) {
+			time = floor - at;
+		} else if(call_direction == DIRECTION_DOWN) {
+			time = (top - at) + (top - floor);
+		} else {
+			// Up to the top, down to the bottom and back up
+			time = (top - at) + (top - bottom) + (floor - bottom);
+		}
+	} else if(c->direction == DIRECTION_DOWN) {
+		if(call_direction == DIRECTION_DOWN && floor <= at) {
+			time = at - floor;
+		} else if(call_direction == DIRECTION_UP) {
+			time = (at - bottom) + (floor - bottom);
+		} else {
+			time = (at - bottom) + (top - bottom) + (top - floor);
+		}
+	} else {
+		time = floor > at ? floor - at : at - floor;
+	}
+	
+	time += count_floors(stops) * STOP_COST;
+	if(c->onboard_count >= CAR_CAPACITY) {
+		time += NUM_FLOORS;
+	}
+	return time;
+}
+
+static Direction direction_from(uint8_t floor, uint8_t destination) {
+	return destination > floor ? DIRECTION_UP : DIRECTION_DOWN;
+}
+
+// Set the direction for heading from floor to target (which may be NO_FLOOR)
+// and return target
+static uint8_t head_for(uint8_t floor, uint8_t target) {
+	if(target == NO_FLOOR || target == floor) {
+		car->direction = DIRECTION_NONE;
+	} else {
+		car->direction = direction_from(floor, target);
+	}
+	return target;
+}
+
+// Return 1 if anyone waiting on floor is going to destination
+static uint8_t waiting_for(uint8_t floor, uint8_t destination) {
+	for(uint8_t slot = 0; slot < waiting_count[floor]; slot++) {
+		if(waiting[floor][slot].destination == destination) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Return the floor of the traveller who has been waiting longest on the
+// floors with a call assigned to this car, or NO_FLOOR if there are none.
+// (The first traveller on each floor is the longest waiting on that floor.)
+static uint8_t oldest_waiting_floor(void) {
+	FloorMask calls = car->up_calls | car->down_calls;
+	uint8_t oldest = NO_FLOOR;
+	for(uint8_t floor = 0; floor < NUM_FLOORS; floor++) {
+		if((calls & FLOOR_BIT(floor)) && (oldest == NO_FLOOR || 
+				waiting[floor][0].arrival_time < waiting[oldest][0].arrival_time)) {
+			oldest = floor;
+		}
+	}
+	return oldest;
+}
+
+// Return the floor in floors which is closest to floor (the lower one if
+// two are equally close), or NO_FLOOR if floors is empty
+static uint8_t nearest_floor(uint8_t floor, FloorMask floors) {
+	FloorMask above = floors & (FloorMask)~FLOORS_BELOW(floor);
+	FloorMask below = floors & FLOORS_BELOW(floor);
+	uint8_t up_floor = above ? lowest_floor(above) : NO_FLOOR;
+	uint8_t down_floor = below ? highest_floor(below) : NO_FLOOR;
+	if(up_floor == NO_FLOOR) {
+		return down_floor;
+	} else if(down_floor == NO_FLOOR || up_floor - floor < floor - down_floor) {
+		return up_floor;
+	}
+	return down_floor;
+}
+
+// Floors above/below floor which have any call
+static FloorMask floors_above(uint8_t floor) {
+	return (car->up_calls | car->down_calls | car->car_calls) & (FloorMask)~FLOORS_UP_TO(floor);
+}
+
+static FloorMask floors_below(uint8_t floor) {
+	return (car->up_calls | car->down_calls | car->car_calls) & FLOORS_BELOW(floor);
+}
+
+static uint8_t lowest_floor(FloorMask floors) {
+	uint8_t floor = 0;
+	while(!(floors & 1)) {
+		floors >>= 1;
+		floor++;
+	}
+	return floor;
+}
+
+static uint8_t highest_floor(FloorMask floors) {
+	uint8_t floor = 0;
+	while(floors >>= 1) {
+		floor++;
+	}
+	return floor;
+}
+
+static uint8_t count_floors(FloorMask floors) {
+	uint8_t count = 0;
+	while(floors) {
+		floors &= floors - 1;
+		count++;
+	}
+	return count;
+}
@@ -0,0 +1,148 @@
+/*
+ * dispatch.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Keeps track of the travellers waiting on each floor (hall calls) and
+ * the travellers in each car of the elevator (car calls), and decides
+ * where each car should go next. Floors are numbered from 0 (the bottom
+ * floor) and cars from 0. Times are in milliseconds (see
+ * get_current_time()).
+ *
+ * When there is more than one car, each hall call is assigned to the car
+ * with the lowest estimated time to get there (taking into account the
+ * way it is going and the stops it already has to make). Each car then
+ * follows the dispatch policy using only its own calls.
+ *
+ * How calls are served depends on the dispatch policy:
+ * POLICY_FCFS - first come, first served: one traveller at a time, in the
+ *		order they arrived
+ * POLICY_NEAREST - go to the closest floor with any call and pick up
+ *		everyone who fits
+ * POLICY_LOOK - the elevator algorithm: keep moving in one direction while
+ *		there are calls ahead, stopping for travellers who want to get off
+ *		and for waiting travellers going the same way, then turn around at
+ *		the last call
+ * POLICY_GROUPING - destination grouping: everyone in the elevator is
+ *		going to the same floor, and it stops on the way for anyone else
+ *		going there
+ * The policy used at startup can be chosen at compile time by defining
+ * DISPATCH_POLICY, and the number of cars by defining NUM_CARS.
+ */
+
+#ifndef DISPATCH_H_
+#define DISPATCH_H_
+
+#include <stdint.h>
+
+#include "building.h"
+#include "stats.h"
+
+#ifndef NUM_CARS
+#define NUM_CARS 2
+#endif
+
+// Number of travellers that can wait on each floor, and that can be in
+// each car at once
+#define WAITING_PER_FLOOR 3
+#define CAR_CAPACITY 4
+
+// Returned by dispatch_next_floor() when there is nowhere to go
+#define NO_FLOOR 0xFF
+
+typedef enum {
+	POLICY_FCFS,
+	POLICY_NEAREST,
+	POLICY_LOOK,
+	POLICY_GROUPING,
+	NUM_DISPATCH_POLICIES
+} DispatchPolicyId;
+
+#ifndef DISPATCH_POLICY
+#define DISPATCH_POLICY POLICY_LOOK
+#endif
+
+typedef enum {
+	DIRECTION_NONE,
+	DIRECTION_UP,
+	DIRECTION_DOWN
+} Direction;
+
+// Totals and running statistics (see stats.h) for the travellers
+// delivered since dispatch_init(). The wait time is from arriving on a
+// floor to getting on the elevator and the ride time is from getting on to
+// getting off. The statistics count times over 65535ms as 65535ms.
+// Travellers turned away are those who couldn't be added because their
+// floor already had WAITING_PER_FLOOR waiting.
+typedef struct {
+	uint16_t delivered;
+	uint16_t turned_away;
+	uint32_t total_wait_time;
+	uint32_t total_ride_time;
+	RunningStats wait_times;
+	RunningStats ride_times;
+} DispatchStats;
+
+/* Remove all travellers, stop the elevator and reset the statistics. Must
+ * be called before the other functions are used. The policy is not changed.
+ */
+void dispatch_init(void);
+
+/* Choose the dispatch policy (one of the DispatchPolicyId values), get the
+ * one in use, and get a policy's name (a string in program memory).
+ */
+void dispatch_set_policy(uint8_t policy_id);
+uint8_t dispatch_get_policy(void);
+const char* dispatch_policy_name_P(uint8_t policy_id);
+
+/* Add a traveller who arrived on floor at time now, wanting to go to
+ * destination.
+ * Returns 1 if they were added, or 0 if the floor already has
+ * WAITING_PER_FLOOR travellers waiting (counted in the statistics as
+ * turned away) or the floors are invalid.
+ */
+uint8_t dispatch_add_traveller(uint8_t floor, uint8_t destination, uint32_t now);
+
+/* Return the number of travellers waiting on floor, and the destination of
+ * the traveller in the given slot (0 to count-1) - i.e. the order they
+ * arrived in.
+ */
+uint8_t dispatch_waiting_count(uint8_t floor);
+uint8_t dispatch_waiting_destination(uint8_t floor, uint8_t slot);
+
+/* Return the number of travellers in a car.
+ */
+uint8_t dispatch_onboard_count(uint8_t car_id);
+
+/* Return the direction a car is currently serving calls in.
+ */
+Direction dispatch_direction(uint8_t car_id);
+
+/* Get the totals for travellers delivered so far, or the totals themselves
+ * (e.g. to save them, or put back ones which were saved, see persist.h).
+ */
+void dispatch_get_stats(DispatchStats* result);
+DispatchStats* dispatch_stats(void);
+
+/* A car has arrived at (or is stopped at) floor: return 1 if it should
+ * stop and open its doors, i.e. someone wants to get off here or someone
+ * waiting here can be picked up. The floor is also remembered for
+ * estimating when the car can answer new calls, so this should be
+ * called each time a car reaches a floor.
+ */
+uint8_t dispatch_should_stop(uint8_t car_id, uint8_t floor);
+
+/* Choose the floor a car should head to from floor, and update the
+ * direction it is serving. Returns NO_FLOOR if it has no calls.
+ */
+uint8_t dispatch_next_floor(uint8_t car_id, uint8_t floor);
+
+/* A car's doors opened at floor at time now. dispatch_unload() removes
+ * the travellers whose destination is floor and dispatch_load() then
+ * takes on the waiting travellers the policy chooses (as many as will
+ * fit). Each returns the number of travellers that got off or on.
+ */
+uint8_t dispatch_unload(uint8_t car_id, uint8_t floor, uint32_t now);
+uint8_t dispatch_load(uint8_t car_id, uint8_t floor, uint32_t now);
+
+#endif /* DISPATCH_H_ */
@@ -1,129 +1,201 @@
-/*
- * display.c
- *
- * Author: Luke Kamols, Ahmed Baig
- */ 
-
-#include <stdio.h>
-#include <avr/pgmspace.h>
-
-#include "display.h"
-#include "pixel_colour.h"
-#include "ledmatrix.h"
-
-// constant value used to display elevator on launch
-static const uint16_t elevator_display[MATRIX_NUM_COLUMNS] = {
-	(1<<7)|(1<<6)|(1<<5)|(0<<4)|(0<<3)|(1<<2)|(1<<1)|(1<<0) | (1<<8),
-	(0<<7)|(0<<6)|(1<<5)|(0<<4)|(0<<3)|(0<<2)|(0<<1)|(1<<0) | (1<<8),
-	(1<<7)|(1<<6)|(1<<5)|(0<<4)|(0<<3)|(1<<2)|(1<<1)|(1<<0) | (1<<8),
-	(0<<7)|(0<<6)|(1<<5)|(0<<4)|(0<<3)|(0<<2)|(0<<1)|(1<<0) | (1<<8),
-	(1<<7)|(1<<6)|(1<<5)|(0<<4)|(0<<3)|(1<<2)|(1<<1)|(1<<0) | (1<<8),
-	(0<<7)|(0<<6)|(0<<5)|(0<<4)|(0<<3)|(0<<2)|(0<<1)|(0<<0) | (1<<8),
-	
-	(1<<7)|(1<<6)|(1<<5)|(1<<4)|(1<<3)|(1<<2)|(1<<1)|(1<<0) | (0<<8),
-	(1<<7)|(1<<6)|(0<<5)|(0<<4)|(0<<3)|(0<<2)|(1<<1)|(1<<0) | (0<<8),
-	(1<<7)|(1<<6)|(1<<5)|(1<<4)|(1<<3)|(1<<2)|(1<<1)|(1<<0) | (0<<8),
-	(1<<7)|(0<<6)|(0<<5)|(0<<4)|(0<<3)|(0<<2)|(0<<1)|(1<<0) | (0<<8),
-	(1<<7)|(0<<6)|(0<<5)|(0<<4)|(0<<3)|(0<<2)|(0<<1)|(1<<0) | (0<<8),
-	(1<<7)|(0<<6)|(0<<5)|(0<<4)|(0<<3)|(0<<2)|(0<<1)|(1<<0) | (0<<8),
-	(1<<7)|(0<<6)|(0<<5)|(0<<4)|(0<<3)|(0<<2)|(0<<1)|(1<<0) | (0<<8),
-	(1<<7)|(0<<6)|(0<<5)|(0<<4)|(0<<3)|(0<<2)|(0<<1)|(1<<0) | (0<<8),
-	(1<<7)|(0<<6)|(0<<5)|(0<<4)|(0<<3)|(0<<2)|(0<<1)|(1<<0) | (0<<8),
-	(1<<7)|(1<<6)|(1<<5)|(1<<4)|(1<<3)|(1<<2)|(1<<1)|(1<<0) | (0<<8)
-	};
-
-void initialise_display(void) {
-	// clear the LED matrix
-	ledmatrix_clear();
-}
-
-void start_display(void) {
-	PixelColour colour;
-	MatrixColumn column_colour_data;
-	uint16_t col_data;
-		
-	ledmatrix_clear(); // start by clearing the LED matrix
-	for (uint8_t col = 0; col < MATRIX_NUM_COLUMNS; col++) {
-		col_data = elevator_display[col];
-		// using the 9th bit as the colour determining bit, 1 is red, 0 is green
-		if (col_data & 0x0100) {
-			colour = COLOUR_RED;
-		} else {
-			colour = COLOUR_GREEN;
-		}
-		// go through the bottom 8 bits and set any to be the correct colour
-		for(uint8_t i = 0; i < 8; i++) {
-			if(col_data & 0x01) {
-				column_colour_data[i] = colour;
-				} else {
-				column_colour_data[i] = 0;
-			}
-			col_data >>= 1;
-		}
-		//column_colour_data[0] = 0;
-		ledmatrix_update_column(col, column_colour_data);
-	}
-	
-}
-
-void start_display_animation(uint8_t frame) {
-	MatrixColumn column_colour_data;
-	uint16_t col_data;
-		
-	// Doors
-	for (uint8_t col = 9; col < MATRIX_NUM_COLUMNS-1; col++) {
-		col_data = (1<<7)|(1<<(3-frame))|(1<<(4+frame))|(1<<0);
-		// go through the bottom 8 bits and set any to be the correct colour
-		for(uint8_t i = 0; i < 8; i++) {
-			if(col_data & 0x01) {
-				column_colour_data[i] = COLOUR_GREEN;
-				} else {
-				column_colour_data[i] = 0;
-			}
-			col_data >>= 1;
-		}
-		ledmatrix_update_column(col, column_colour_data);
-	}
-}
-
-
-/*
- * This function treats x and y coordinates in some unintuitive ways.
-  * You are not expected to follow all the logic of this.
- */
-void update_square_colour(uint8_t x, uint8_t y, uint8_t object) {
-	
-	// first check that this is a square within the game field
-	// if outside the game field, don't update anything
-	if (x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT) {
-		return;
-	}
-	
-	// determine which colour corresponds to this object
-	PixelColour colour;
-
-	if (object == ELEVATOR) {
-		colour = MATRIX_COLOUR_ELEVATOR;
-	} else if (object == FLOOR) {
-		colour = MATRIX_COLOUR_FLOOR;
-	} else if (object == TRAVELLER_TO_0) {
-		colour = MATRIX_COLOUR_TRAVELLER_0;
-	} else if (object == TRAVELLER_TO_1) {
-	colour = MATRIX_COLOUR_TRAVELLER_1;
-	} else if (object == TRAVELLER_TO_2) {
-	colour = MATRIX_COLOUR_TRAVELLER_2;
-	} else if (object == TRAVELLER_TO_3) {
-	colour = MATRIX_COLOUR_TRAVELLER_3;
-	} else {
-		// anything unexpected (or empty) will be black
-		colour = MATRIX_COLOUR_EMPTY;
-	}
-
-	// update the pixel at the given location with this colour
-	/* x and y are swapped here because the ledmatrix.c code
-	 * treats the matrix as being horizontal, while the elevator
-	 * controller treats the matrix vertically. We also want x
-	 * to be interpreted as from bottom to top, not top to bottom.
-	 */
-	ledmatrix_update_pixel(15 - y, x, colour); 
-}
\ No newline at end of file
+/*
+ * display.c
+ *
+ * Author: Luke Kamols, Ahmed Baig
+ */ 
+
+#include <stdio.h>
+#include <avr/pgmspace.h>
+
+#include "display.h"
+#include "pixel_colour.h"
+#include "ledmatrix.h"
+
+// Sprites for the start screen, kept in program memory. Each is its width,
+// its colour and then a byte for each of its columns (left to right), with
+// bit 0 for the bottom row of the LED matrix. The start screen is drawn
+// with the matrix the way round it is marked on the board, which shows
+// "EC" (in red) and an elevator (in green) when it is turned on its side.
+static const uint8_t logo_sprite[] PROGMEM = {
+	5, COLOUR_RED,
+	0b11100111,
+	0b00100001,
+	0b11100111,
+	0b00100001,
+	0b11100111
+};
+
+static const uint8_t cab_sprite[] PROGMEM = {
+	10, COLOUR_GREEN,
+	0b11111111,
+	0b11000011,
+	0b11111111,
+	0b10000001,
+	0b10000001,
+	0b10000001,
+	0b10000001,
+	0b10000001,
+	0b10000001,
+	0b11111111
+};
+
+// The doors fill the middle of the cab (columns 3 to 8 of it), for each
+// frame of the animation from shut (0) to open (3)
+#define DOOR_X 9
+static const uint8_t door_sprites[4][8] PROGMEM = {
+	{6, COLOUR_GREEN, 0b10011001, 0b10011001, 0b10011001, 0b10011001, 0b10011001, 0b10011001},
+	{6, COLOUR_GREEN, 0b10100101, 0b10100101, 0b10100101, 0b10100101, 0b10100101, 0b10100101},
+	{6, COLOUR_GREEN, 0b11000011, 0b11000011, 0b11000011, 0b11000011, 0b11000011, 0b11000011},
+	{6, COLOUR_GREEN, 0b10000001, 0b10000001, 0b10000001, 0b10000001, 0b10000001, 0b10000001}
+};
+
+// The colour of each object (see display.h)
+const PixelColour object_colours[NUM_OBJECTS] PROGMEM = {
+	[EMPTY_SQUARE] = MATRIX_COLOUR_EMPTY,
+	[ELEVATOR] = MATRIX_COLOUR_ELEVATOR,
+	[FLOOR] = MATRIX_COLOUR_FLOOR,
+	[TRAVELLER_TO_0] = MATRIX_COLOUR_TRAVELLER_0,
+	[TRAVELLER_TO_1] = MATRIX_COLOUR_TRAVELLER_1,
+	[TRAVELLER_TO_2] = MATRIX_COLOUR_TRAVELLER_2,
+	[TRAVELLER_TO_3] = MATRIX_COLOUR_TRAVELLER_3
+};
+
+// The building row shown on the bottom row of the LED matrix
+static uint8_t view_bottom = 0;
+
+static PixelColour object_colour(uint8_t object);
+static void draw_square(uint8_t x, uint8_t y, PixelColour colour);
+
+void initialise_display(void) {
+	// clear the LED matrix
+	ledmatrix_clear();
+}
+
+void start_display(void) {
+	ledmatrix_clear(); // start by clearing the LED matrix
+	display_blit(logo_sprite, 0, 0);
+	display_blit(cab_sprite, 6, 0);
+}
+
+void start_display_animation(uint8_t frame) {
+	// Each frame replaces all of the doors, including the gaps
+	display_blit(door_sprites[frame], DOOR_X, 1);
+}
+
+void display_blit(const uint8_t* sprite, uint8_t x, uint8_t opaque) {
+	uint8_t width = pgm_read_byte(&sprite[0]);
+	PixelColour colour = pgm_read_byte(&sprite[1]);
+	MatrixColumn column;
+	
+	for (uint8_t i = 0; i < width && x + i < MATRIX_NUM_COLUMNS; i++) {
+		// combine the sprite's column with what is already there, and only
+		// send the column if that changes it
+		uint8_t bits = pgm_read_byte(&sprite[2 + i]);
+		uint8_t changed = 0;
+		ledmatrix_get_column(x + i, column);
+		for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			PixelColour pixel = column[y];
+			if (bits & 0x01) {
+				pixel = colour;
+			} else if (opaque) {
+				pixel = COLOUR_BLACK;
+			}
+			if (pixel != column[y]) {
+				column[y] = pixel;
+				changed = 1;
+			}
+			bits >>= 1;
+		}
+		if (changed) {
+			ledmatrix_update_column(x + i, column);
+		}
+	}
+}
+
+
+/*
+ * This function treats x and y coordinates in some unintuitive ways.
+  * You are not expected to follow all the logic of this.
+ */
+void update_square_colour(uint8_t x, uint8_t y, uint8_t object) {
+	draw_square(x, y, object_colour(object));
+}
+
+void update_squares(uint8_t x, uint8_t y, uint8_t count, uint8_t object) {
+	// the squares are all in one column of the LED matrix (see
+	// draw_square()), so they are either all in view or all out of it
+	uint8_t matrix_x = display_matrix_column(y);
+	if (matrix_x >= MATRIX_NUM_COLUMNS) {
+		return;
+	}
+	PixelColour colour = object_colour(object);
+	for (uint8_t i = 0; i < count && x + i < WIDTH; i++) {
+		ledmatrix_draw_pixel(matrix_x, x + i, colour);
+	}
+}
+
+void update_square_brightness(uint8_t x, uint8_t y, uint8_t object, uint8_t brightness) {
+	PixelColour colour = object_colour(object);
+	
+	// scale the green (high 4 bits) and red (low 4 bits) separately,
+	// rounding to the nearest level
+	uint8_t green = ((colour >> 4) * brightness + FULL_BRIGHTNESS / 2) / FULL_BRIGHTNESS;
+	uint8_t red = ((colour & 0x0F) * brightness + FULL_BRIGHTNESS / 2) / FULL_BRIGHTNESS;
+	draw_square(x, y, (green << 4) | red);
+}
+
+static PixelColour object_colour(uint8_t object) {
+	// look up which colour corresponds to this object. Anything
+	// unexpected will be black (as empty squares are)
+	if (object >= NUM_OBJECTS) {
+		return MATRIX_COLOUR_EMPTY;
+	}
+	return OBJECT_COLOUR(object);
+}
+
+static void draw_square(uint8_t x, uint8_t y, PixelColour colour) {
+	
+	// first check that this is a square that can currently be seen
+	// if outside the view, don't update anything
+	uint8_t matrix_x = display_matrix_column(y);
+	if (x >= WIDTH || matrix_x >= MATRIX_NUM_COLUMNS) {
+		return;
+	}
+
+	// update the pixel at the given location with this colour
+	/* x and y are swapped here because the ledmatrix.c code
+	 * treats the matrix as being horizontal, while the elevator
+	 * controller treats the matrix vertically (see
+	 * display_matrix_column()).
+	 * The pixel is only drawn into the RAM copy of the display here,
+	 * it is sent to the matrix by the next ledmatrix_flush().
+	 */
+	ledmatrix_draw_pixel(matrix_x, x, colour);
+}
+
+void display_set_view(uint8_t bottom_row) {
+	// moving the view by one row shifts the LED matrix, so only the new
+	// row has to be sent. The matrix is on its side, so moving the view
+	// up the field shifts the display right.
+	if (bottom_row == view_bottom + 1) {
+		ledmatrix_shift_display_right();
+	} else if (bottom_row + 1 == view_bottom) {
+		ledmatrix_shift_display_left();
+	} else if (bottom_row != view_bottom) {
+		ledmatrix_clear();
+	}
+	view_bottom = bottom_row;
+}
+
+uint8_t display_view_bottom(void) {
+	return view_bottom;
+}
+
+uint8_t display_matrix_column(uint8_t y) {
+	// we want rows to go from bottom to top, i.e. from the right of the
+	// matrix to the left
+	if (y < view_bottom || y - view_bottom >= HEIGHT) {
+		return MATRIX_NUM_COLUMNS;
+	}
+	return (MATRIX_NUM_COLUMNS - 1) - (y - view_bottom);
+}
@@ -1,67 +1,129 @@
-/*
- * display.h
- *
- * Author: Luke Kamols
- */ 
-
-#ifndef DISPLAY_H_
-#define DISPLAY_H_
-
-#include "pixel_colour.h"
-
-// display dimensions, these match the size of the playing field
-#define WIDTH  8
-#define HEIGHT 16
-
-// object definitions
-
-#define PLAYER			1
-#define FACING			2
-#define BREAKABLE	 	3
-#define UNBREAKABLE		4
-#define DIAMOND			5
-#define UNDISCOVERED	6
-
-#define EMPTY_SQUARE    0
-#define ELEVATOR		1
-#define FLOOR			2
-#define TRAVELLER_TO_0	3
-#define TRAVELLER_TO_1	4
-#define TRAVELLER_TO_2	5
-#define TRAVELLER_TO_3	6
-
-// matrix colour definitions
-
-#define MATRIX_COLOUR_EMPTY			COLOUR_BLACK
-#define MATRIX_COLOUR_ELEVATOR		COLOUR_RED
-#define MATRIX_COLOUR_FLOOR			COLOUR_GREEN
-#define MATRIX_COLOUR_TRAVELLER_0	COLOUR_LIGHT_RED
-#define MATRIX_COLOUR_TRAVELLER_1	COLOUR_LIGHT_GREEN
-#define MATRIX_COLOUR_TRAVELLER_2	COLOUR_LIGHT_YELLOW
-#define MATRIX_COLOUR_TRAVELLER_3	COLOUR_LIGHT_ORANGE
-
-/*
- * initialise the display for the playing field
- */
-void initialise_display(void);
-
-/*
- * display a start screen
- */
-void start_display(void);
-
-
-/*
- * animates start screen
- */
-void start_display_animation(uint8_t frame);
-
-/*
- * updates the colour at square (x, y) to be the colour
- * of the object 'object'
- * 'object' is expected to be EMPTY_SQUARE, PLAYER, FACING, 
- * BREAKABLE, UNBREAKABLE, DIAMOND or UNDISCOVERED
- */
-void update_square_colour(uint8_t x, uint8_t y, uint8_t object);
-
+/*
+ * display.h
+ *
+ * Author: Luke Kamols
+ */ 
+
+#ifndef DISPLAY_H_
+#define DISPLAY_H_
+
+#include <avr/pgmspace.h>
+
+#include "pixel_colour.h"
+#include "ledmatrix.h"
+
+// display dimensions, these match the size of the playing field
+#define WIDTH  8
+#define HEIGHT 16
+
+// object definitions
+
+#define PLAYER			1
+#define FACING			2
+#define BREAKABLE	 	3
+#define UNBREAKABLE		4
+#define DIAMOND			5
+#define UNDISCOVERED	6
+
+#define EMPTY_SQUARE    0
+#define ELEVATOR		1
+#define FLOOR			2
+#define TRAVELLER_TO_0	3
+#define TRAVELLER_TO_1	4
+#define TRAVELLER_TO_2	5
+#define TRAVELLER_TO_3	6
+#define NUM_OBJECTS		7
+
+// matrix colour definitions
+
+#define MATRIX_COLOUR_EMPTY			COLOUR_BLACK
+#define MATRIX_COLOUR_ELEVATOR		COLOUR_RED
+#define MATRIX_COLOUR_FLOOR			COLOUR_GREEN
+#define MATRIX_COLOUR_TRAVELLER_0	COLOUR_LIGHT_RED
+#define MATRIX_COLOUR_TRAVELLER_1	COLOUR_LIGHT_GREEN
+#define MATRIX_COLOUR_TRAVELLER_2	COLOUR_LIGHT_YELLOW
+#define MATRIX_COLOUR_TRAVELLER_3	COLOUR_LIGHT_ORANGE
+
+/*
+ * the colour of each object, in program memory, and the colour of object
+ * (which must be less than NUM_OBJECTS)
+ */
+extern const PixelColour object_colours[NUM_OBJECTS] PROGMEM;
+#define OBJECT_COLOUR(object) ((PixelColour)pgm_read_byte(&object_colours[(object)]))
+
+/*
+ * initialise the display for the playing field
+ */
+void initialise_display(void);
+
+/*
+ * display a start screen
+ */
+void start_display(void);
+
+
+/*
+ * animates start screen
+ */
+void start_display_animation(uint8_t frame);
+
+/*
+ * draws a sprite from program memory (see display.c for the format) with
+ * its left column at column x of the LED matrix, the way round the
+ * matrix is marked on the board (not on its side, as for the elevator).
+ * The sprite's pixels are drawn in its colour over what is already shown,
+ * and if opaque is non-zero its other pixels are cleared. Columns which
+ * change are sent to the matrix straight away
+ */
+void display_blit(const uint8_t* sprite, uint8_t x, uint8_t opaque);
+
+/*
+ * updates the colour at square (x, y) to be the colour
+ * of the object 'object'
+ * 'object' is expected to be EMPTY_SQUARE, PLAYER, FACING, 
+ * BREAKABLE, UNBREAKABLE, DIAMOND or UNDISCOVERED
+ * The change is buffered - call ledmatrix_flush() to show it
+ */
+void update_square_colour(uint8_t x, uint8_t y, uint8_t object);
+
+/*
+ * as update_square_colour(), for count squares in a row from (x, y) to
+ * (x+count-1, y), all with the same object. Cheaper than drawing them one
+ * at a time
+ */
+void update_squares(uint8_t x, uint8_t y, uint8_t count, uint8_t object);
+
+/*
+ * the fast path, for code which already has LED matrix coordinates (see
+ * ledmatrix.h) of a square in view: the field's (x, y) is the matrix's
+ * (display_matrix_column(y), x). object must be less than NUM_OBJECTS.
+ * The change is buffered as for update_square_colour()
+ */
+#define UPDATE_MATRIX_SQUARE(matrix_x, matrix_y, object) \
+	ledmatrix_draw_pixel((matrix_x), (matrix_y), OBJECT_COLOUR(object))
+
+/*
+ * as update_square_colour(), but with the object's colour dimmed to
+ * brightness (0 for off, up to FULL_BRIGHTNESS for the object's own colour)
+ */
+#define FULL_BRIGHTNESS 15
+void update_square_brightness(uint8_t x, uint8_t y, uint8_t object, uint8_t brightness);
+
+/*
+ * the field can be taller than the LED matrix, in which case only HEIGHT
+ * rows of it are shown, starting from row bottom_row. Squares outside the
+ * view are not drawn by update_square_colour()
+ * when the view moves, the squares that come into view are blank and
+ * must be drawn again
+ */
+void display_set_view(uint8_t bottom_row);
+uint8_t display_view_bottom(void);
+
+/*
+ * the LED matrix column which shows row y of the field (the matrix is on
+ * its side, with the bottom of the view on the right), or
+ * MATRIX_NUM_COLUMNS if the row is out of view
+ */
+uint8_t display_matrix_column(uint8_t y);
+
 #endif 
\ No newline at end of file
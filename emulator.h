@@ -0,0 +1,29 @@
+/*
+ * emulator.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * The parts of the main file (Elevator-Emulator.c) that the host
+ * simulation (see sim/sim.c) runs in place of main(). On the board, main()
+ * calls initialise_hardware(), shows the start screen and then calls
+ * setup_elevator_emulator() and run_elevator_emulator() forever.
+ */
+
+#ifndef EMULATOR_H_
+#define EMULATOR_H_
+
+/* Set up the hardware and turn interrupts on.
+ */
+void initialise_hardware(void);
+
+/* Clear the terminal and LED matrix, park the cars at floor 0 and start
+ * the timed tasks.
+ */
+void setup_elevator_emulator(void);
+
+/* One pass of the main loop. Returns after sleeping until the next
+ * interrupt (or until there is input, when the cars are parked).
+ */
+void run_elevator_emulator(void);
+
+#endif /* EMULATOR_H_ */
@@ -0,0 +1,152 @@
+/*
+ * eventlog.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See eventlog.h. Events can be recorded from the main loop and from
+ * interrupt handlers, so recording turns interrupts off while it adds to
+ * the queue. Only the main loop takes events off the queue. As with the
+ * button queue (see buttons.c) the positions are free-running 8 bit
+ * counters, and the number of events waiting is head - tail.
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "eventlog.h"
+#include "timer0.h"
+#include "serialio.h"
+
+// The flow control characters (see serialio.h), which are escaped
+#define XON 0x11
+#define XOFF 0x13
+
+#define EVENT_LOG_MASK (EVENT_LOG_SIZE - 1)
+#if (EVENT_LOG_SIZE & EVENT_LOG_MASK) != 0 || EVENT_LOG_SIZE > 128
+#error "EVENT_LOG_SIZE must be a power of two no larger than 128"
+#endif
+
+// Sent as it is in the frame (after the sync and before the check)
+typedef struct {
+	uint8_t type_car;
+	uint8_t data;
+	uint16_t time;
+} EventRecord;
+
+static volatile EventRecord events[EVENT_LOG_SIZE];
+static volatile uint8_t head;
+static volatile uint8_t tail;
+static volatile uint8_t streaming;
+
+// Events lost since the last one queued, and the high 16 bits of the clock
+// the queued events are for
+static volatile uint8_t lost;
+static volatile uint16_t clock_high;
+
+static void put(uint8_t type_car, uint8_t data, uint16_t time);
+static uint8_t add_byte(char* frame, uint8_t length, uint8_t value);
+
+void eventlog_set_streaming(uint8_t on) {
+	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+	cli();
+	if(on && !streaming) {
+		head = 0;
+		tail = 0;
+		lost = 0;
+		clock_high = get_current_time() >> 16;
+		put(EVENT_CLOCK << 4, 0, clock_high);
+	} else if(!on) {
+		tail = head;
+	}
+	streaming = on;
+	if(interrupts_on) {
+		sei();
+	}
+}
+
+uint8_t eventlog_streaming(void) {
+	return streaming;
+}
+
+void eventlog_record(uint8_t type, uint8_t car, uint8_t data) {
+	if(!streaming) {
+		return;
+	}
+	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+	cli();
+	uint32_t now = get_current_time();
+	uint16_t high = now >> 16;
+	// The event may need the clock and the number lost sent before it,
+	// and either all of them go in the queue or none do
+	uint8_t needed = 1 + (high != clock_high) + (lost != 0);
+	if((uint8_t)(EVENT_LOG_SIZE - (uint8_t)(head - tail)) < needed) {
+		if(lost < UINT8_MAX) {
+			lost++;
+		}
+	} else {
+		if(high != clock_high) {
+			clock_high = high;
+			put(EVENT_CLOCK << 4, 0, high);
+		}
+		if(lost) {
+			put(EVENT_LOST << 4, lost, now);
+			lost = 0;
+		}
+		put((type << 4) | car, data, now);
+	}
+	if(interrupts_on) {
+		sei();
+	}
+}
+
+void eventlog_drain(void) {
+	while(head != tail && serial_output_space() >= EVENT_LOG_DRAIN_SPACE) {
+		// The entry must be copied before tail is moved on, as it can be
+		// reused as soon as it is
+		volatile EventRecord* entry = &events[tail & EVENT_LOG_MASK];
+		uint8_t bytes[5];
+		bytes[0] = entry->type_car;
+		bytes[1] = entry->data;
+		bytes[2] = entry->time & 0xFF;
+		bytes[3] = entry->time >> 8;
+		bytes[4] = -(bytes[0] + bytes[1] + bytes[2] + bytes[3]);
+		tail++;
+
+		// The sync and, at most, every byte after it escaped
+		char frame[1 + 2 * sizeof(bytes)];
+		uint8_t length = 0;
+		frame[length++] = EVENT_LOG_SYNC;
+		for(uint8_t i = 0; i < sizeof(bytes); i++) {
+			length = add_byte(frame, length, bytes[i]);
+		}
+		serial_write_raw(frame, length);
+	}
+}
+
+uint8_t eventlog_pending(void) {
+	return head != tail;
+}
+
+// Add a byte of a frame after the sync (escaped if it has to be, see
+// eventlog.h) and return the frame's new length
+static uint8_t add_byte(char* frame, uint8_t length, uint8_t value) {
+	if(value == EVENT_LOG_SYNC || value == EVENT_LOG_ESCAPE
+			|| value == XON || value == XOFF) {
+		frame[length++] = EVENT_LOG_ESCAPE;
+		value ^= EVENT_LOG_ESCAPE_XOR;
+	}
+	frame[length++] = value;
+	return length;
+}
+
+// Add an event to the queue, which must have room for it (called with
+// interrupts off)
+static void put(uint8_t type_car, uint8_t data, uint16_t time) {
+	volatile EventRecord* entry = &events[head & EVENT_LOG_MASK];
+	entry->type_car = type_car;
+	entry->data = data;
+	entry->time = time;
+	head++;
+}
@@ -0,0 +1,92 @@
+/*
+ * eventlog.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * A log of what the controller does (travellers placed, picked up and
+ * dropped off, the doors and the cars' directions), kept as small binary
+ * records and sent over the serial port in the background, for decoding on
+ * the host (see sim/eventdump.c). Unlike printing messages this hardly
+ * changes the timing of what is being watched: recording an event just
+ * copies four bytes into a queue (safe from interrupt handlers too), and
+ * the queue is only sent while there is little terminal output waiting.
+ *
+ * Nothing is recorded until the log is turned on with
+ * eventlog_set_streaming(). Each event is then sent as a frame in the same
+ * form as the traffic commands (see traffic.h):
+ *
+ *	EVENT_LOG_SYNC, type_car, data, time (2 bytes), check
+ *
+ * where type_car is (type << 4) | car, time is the low 16 bits of
+ * get_current_time() and check makes the bytes after the sync add up to 0
+ * (mod 256). Any of those bytes which is EVENT_LOG_SYNC, EVENT_LOG_ESCAPE
+ * or one of the flow control characters XON (0x11) and XOFF (0x13) is
+ * sent as EVENT_LOG_ESCAPE and then the byte XOR EVENT_LOG_ESCAPE_XOR, so
+ * a host using XON/XOFF (see serialio.h) never mistakes it for one, and
+ * the check is of the bytes before they are escaped. An XON or XOFF in a
+ * frame is one we sent part way through it, and isn't part of the frame.
+ *
+ * The frames are mixed in with the terminal output, which never contains
+ * EVENT_LOG_SYNC, so they are found by looking for it and checking the
+ * check. The types, and what is in the data, are:
+ * EVENT_CLOCK - 0. The time is the high 16 bits of the clock, which apply
+ *		to the events that follow. Sent first and whenever they change.
+ * EVENT_LOST - the number of events lost (up to 255) because the queue
+ *		was full, just before this
+ * EVENT_PLACED - (floor << 4) | destination of a new traveller (car 0)
+ * EVENT_PICKUP - (floor << 4) | number of travellers picked up
+ * EVENT_DROPOFF - (floor << 4) | number of travellers dropped off
+ * EVENT_DOOR - the car's new door phase (0 shut, 1 arriving, 2 open,
+ *		3 closing)
+ * EVENT_DIRECTION - the car's new direction (a Direction, see dispatch.h)
+ */
+
+#ifndef EVENTLOG_H_
+#define EVENTLOG_H_
+
+#include <stdint.h>
+
+#define EVENT_LOG_SYNC		0xA5
+#define EVENT_LOG_ESCAPE	0x7D
+#define EVENT_LOG_ESCAPE_XOR	0x20
+
+#define EVENT_CLOCK			0
+#define EVENT_LOST			1
+#define EVENT_PLACED		2
+#define EVENT_PICKUP		3
+#define EVENT_DROPOFF		4
+#define EVENT_DOOR			5
+#define EVENT_DIRECTION		6
+
+/* Number of events which can be waiting to be sent. Must be a power of two
+ * no larger than 128. Can be changed at compile time.
+ */
+#ifndef EVENT_LOG_SIZE
+#define EVENT_LOG_SIZE 16
+#endif
+
+/* Events are only sent while at least this much of the serial output
+ * buffer is free, so that terminal output always comes first.
+ */
+#define EVENT_LOG_DRAIN_SPACE 192
+
+/* Turn the log on or off. Turning it off throws away anything not yet sent.
+ */
+void eventlog_set_streaming(uint8_t on);
+uint8_t eventlog_streaming(void);
+
+/* Record an event (type and data as above) for a car (0 to 15). Does
+ * nothing unless the log is on.
+ */
+void eventlog_record(uint8_t type, uint8_t car, uint8_t data);
+
+/* Send as many waiting events as there is room for (see
+ * EVENT_LOG_DRAIN_SPACE). Called from the main loop.
+ */
+void eventlog_drain(void);
+
+/* Return 1 if any events are waiting to be sent.
+ */
+uint8_t eventlog_pending(void);
+
+#endif /* EVENTLOG_H_ */
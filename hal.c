@@ -0,0 +1,99 @@
+/*
+ * hal.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See hal.h.
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "hal.h"
+
+void hal_init(void) {
+	// Set Pin C7, C6, and C5 as inputs
+	DDRC &= ~((1 << PC7)|(1 << PC6)|(1 << PC5));
+
+	// Set Pin C4 as an output, to control the CC, and C0 to C3 for the
+	// door LEDs
+	DDRC |= (1 << PC4)|(1 << PC3)|(1 << PC2)|(1 << PC1)|(1 << PC0);
+
+	// Set port A pins to be outputs, for the seven segment display
+	DDRA = 0xFF;
+
+	/* Initialise timer/counter 1 so that it reaches the output compare
+	** register value every 0.5 milliseconds, then resets. The timer isn't
+	** divided down, so that it counts clock cycles (8000 ticks per ms) for
+	** the profiler (see profile.h).
+	*/
+	OCR1A = 3999;
+	TCCR1A = 0; // Normal operation, no PWM
+	TCCR1B = (0 << WGM13) | (1 << WGM12) // Two most significant WGM bits
+	| (0 << CS12) | (0 << CS11) | (1 <<CS10); // Don't divide the clock
+
+	// Enable timer/counter1 Output Compare A Match
+	TIMSK1 = (1 << OCIE1A);
+
+	// Clear the flag value
+	TIFR1 = (1 << OCF1A);
+
+	// Configure OC2B, with prescalar 64, Fast PWM mode with OCR2A as the
+	// top value. The overflow interrupt comes each time it reaches the top.
+	TCCR2A = (1 << COM2B1)|(1 << WGM21)|(1 << WGM20);
+	TCCR2B = (1 << WGM22)|(1 << CS22);
+}
+
+uint8_t hal_switches(void) {
+	return (PINC >> PC5) & (HAL_SWITCH_FLOOR_MASK | HAL_SWITCH_SLOW);
+}
+
+void hal_door_leds(uint8_t on, uint8_t off) {
+	// The timer 1 interrupt handler also writes to port C (for the digit
+	// select), so make sure it doesn't in the middle of this
+	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+	cli();
+	PORTC = (PORTC | (on & 0x0F)) & ~(off & 0x0F);
+	if (interrupts_on) {
+		sei();
+	}
+}
+
+void hal_seven_seg(uint8_t digit, uint8_t segments) {
+	if (digit == 0) {
+		PORTC &= ~(1 << PC4);  // C4 = 0, enable right SSD
+	} else {
+		PORTC |= (1 << PC4);   // C4 = 1, enable left SSD
+	}
+	PORTA = segments;
+}
+
+void hal_buzzer(uint8_t top, uint8_t sound) {
+	OCR2A = top;
+	OCR2B = top / 2; // divide by 2 to get 50% duty cycle
+	if (top && sound) {
+		// Set Pin D6 as an output, to control the piezo buzzer.
+		DDRD |= (1 << PD6);
+	} else {
+		// Turn pin D6 off to fully silence it
+		DDRD &= ~(1 << PD6);
+	}
+}
+
+uint8_t hal_buzzer_on(void) {
+	// The buzzer pin is only an output while a tone is playing
+	return (DDRD & (1 << PD6)) != 0;
+}
+
+void hal_buzzer_interrupt(uint8_t on) {
+	if (on) {
+		// Clear the flag first, so the first interrupt is a whole period
+		// from now
+		TIFR2 = (1 << TOV2);
+		TIMSK2 |= (1 << TOIE2);
+	} else {
+		TIMSK2 &= ~(1 << TOIE2);
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ * hal.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * The board's switches, door LEDs, seven segment display and buzzer, so
+ * that the main file doesn't use the I/O registers directly. hal.c drives
+ * the real hardware and sim/hal_sim.c stands in for it in the host
+ * simulation (see sim/sim.c).
+ *
+ * Switches S0 and S1 are on C5 and C6 and choose the destination floor,
+ * and S2 on C7 slows the cars down. The door LEDs are on C0 to C3. The
+ * seven segment display's segments are on port A, with its digit select
+ * (CC) on C4. The buzzer is on D6 (OC2B).
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+
+/* The switches, as returned by hal_switches().
+ */
+#define HAL_SWITCH_FLOOR_MASK	0x03 // S0 and S1, as a floor number 0 to 3
+#define HAL_SWITCH_SLOW			0x04 // S2
+
+/* The buzzer timer top value for a tone of hz Hz (timer 2 runs at clock/64).
+ */
+#define HAL_BUZZER_TOP(hz) ((uint8_t)((125000UL + (hz) / 2) / (hz) - 1))
+
+/* Set up the switch, door LED, seven segment display and buzzer pins, the
+ * timer 1 interrupt every 0.5ms and timer 2 for the buzzer. Called with
+ * interrupts off.
+ */
+void hal_init(void);
+
+/* Read the switches.
+ */
+uint8_t hal_switches(void);
+
+/* Turn on the door LEDs in on and off those in off (bit n for LED n).
+ */
+void hal_door_leds(uint8_t on, uint8_t off);
+
+/* Show segments on a seven segment digit (0 is the right digit). Only one
+ * digit is lit at a time.
+ */
+void hal_seven_seg(uint8_t digit, uint8_t segments);
+
+/* Run timer 2 with the given top value (see HAL_BUZZER_TOP()), playing
+ * that tone on the buzzer if sound is non-zero or keeping the buzzer
+ * silent if it is 0 (so that the timer keeps time through a rest), and
+ * check whether a tone is playing. A top of 0 silences the buzzer.
+ */
+void hal_buzzer(uint8_t top, uint8_t sound);
+uint8_t hal_buzzer_on(void);
+
+/* Turn the timer 2 overflow interrupt, which comes once per period of the
+ * tone, on or off (see sound.h). It must be off while top is 0.
+ */
+void hal_buzzer_interrupt(uint8_t on);
+
+#endif /* HAL_H_ */
@@ -0,0 +1,196 @@
+/*
+ * latency.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See latency.h. A time on the cycle clock is the number of timer 1
+ * periods so far (counted by latency_tick()) times LATENCY_PERIOD_CYCLES,
+ * plus the timer's count.
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "latency.h"
+#include "scheduler.h"
+#include "timer0.h"
+#include "serialio.h"
+#include "terminalio.h"
+
+// The loop histogram is only changed by the main loop and the timer 1
+// histogram only by its interrupt handler
+static volatile uint16_t histograms[NUM_LATENCY_HISTOGRAMS][LATENCY_BUCKETS];
+static volatile uint32_t periods;
+
+// When the last main loop pass started, and whether there was one
+static uint32_t last_loop;
+static uint8_t loop_seen;
+
+// When each task is due (low 16 bits of the clock, see
+// get_current_time16()) and which tasks are expected (one bit each)
+#if SCHEDULER_MAX_TASKS > 8
+#error "SCHEDULER_MAX_TASKS is too large for the expected task bits"
+#endif
+static uint16_t due[SCHEDULER_MAX_TASKS];
+static uint8_t expected;
+static uint16_t misses;
+static uint16_t worst_miss;
+
+static uint8_t bucket(uint16_t value);
+static void count(uint8_t histogram, uint16_t value);
+
+void latency_tick(void) {
+	// The timer was reset when the interrupt was raised, so its count is
+	// how long ago that was
+	uint16_t late = TCNT1;
+	periods++;
+	count(LATENCY_TIMER1_ENTRY, late);
+}
+
+uint32_t latency_now(void) {
+	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+	cli();
+	uint16_t timer_count = TCNT1;
+	uint32_t now = periods;
+	// If the timer has been reset but its interrupt hasn't been handled
+	// yet (because interrupts are off), count that period
+	if((TIFR1 & (1 << OCF1A)) && timer_count < LATENCY_PERIOD_CYCLES / 2) {
+		now++;
+	}
+	if(interrupts_on) {
+		sei();
+	}
+	return now * LATENCY_PERIOD_CYCLES + timer_count;
+}
+
+void latency_loop(void) {
+	uint32_t now = latency_now();
+	if(loop_seen) {
+		// Cycles to microseconds (8 cycles each), up to the last bucket
+		uint32_t us = (now - last_loop) >> 3;
+		count(LATENCY_LOOP, us > UINT16_MAX ? UINT16_MAX : us);
+	}
+	last_loop = now;
+	loop_seen = 1;
+}
+
+void latency_expect(uint8_t task, uint16_t delay_ms) {
+	if(task < SCHEDULER_MAX_TASKS) {
+		due[task] = get_current_time16() + delay_ms;
+		expected |= (1 << task);
+	}
+}
+
+void latency_check(uint8_t task) {
+	if(task >= SCHEDULER_MAX_TASKS || !(expected & (1 << task))) {
+		return;
+	}
+	expected &= ~(1 << task);
+	// Signed, as a task can run a little early (see scheduler_start())
+	int16_t late = get_current_time16() - due[task];
+	if(late > LATENCY_DEADLINE_SLACK_MS) {
+		if(misses < UINT16_MAX) {
+			misses++;
+		}
+		if(late > worst_miss) {
+			worst_miss = late;
+		}
+	}
+}
+
+void latency_forget(void) {
+	expected = 0;
+	loop_seen = 0;
+}
+
+uint16_t latency_misses(void) {
+	return misses;
+}
+
+uint16_t latency_worst_miss(void) {
+	return worst_miss;
+}
+
+void latency_histogram(uint8_t histogram, uint16_t* counts) {
+	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+	cli();
+	for(uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+		counts[i] = histograms[histogram][i];
+	}
+	if(interrupts_on) {
+		sei();
+	}
+}
+
+void latency_dump(uint8_t y) {
+	uint16_t loop[LATENCY_BUCKETS];
+	uint16_t entry[LATENCY_BUCKETS];
+	latency_histogram(LATENCY_LOOP, loop);
+	latency_histogram(LATENCY_TIMER1_ENTRY, entry);
+	uint8_t last = 0;
+	for(uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+		if(loop[i] || entry[i]) {
+			last = i;
+		}
+	}
+
+	move_terminal_cursor(10, y);
+	serial_write_P_str("Up to     Loop (us)  Timer 1 late (cycles)");
+	clear_to_end_of_line();
+	for(uint8_t i = 0; i <= last; i++) {
+		move_terminal_cursor(10, y + 1 + i);
+		clear_to_end_of_line();
+		if(i == LATENCY_BUCKETS - 1) {
+			serial_write_P_str("more");
+		} else {
+			print_number((2UL << i) - 1);
+		}
+		move_terminal_cursor(20, y + 1 + i);
+		print_number(loop[i]);
+		move_terminal_cursor(31, y + 1 + i);
+		print_number(entry[i]);
+	}
+	move_terminal_cursor(10, y + 2 + last);
+	serial_write_P_str("Deadlines missed: ");
+	print_number(misses);
+	serial_write_P_str(", worst by ");
+	print_number(worst_miss);
+	serial_write_P_str("ms");
+	clear_to_end_of_line();
+}
+
+// The bucket for a value: the position of its highest set bit, found by
+// halving the number of bits to look at each step
+static uint8_t bucket(uint16_t value) {
+	uint8_t b = 0;
+	if(value >= 0x100) {
+		value >>= 8;
+		b = 8;
+	}
+	if(value >= 0x10) {
+		value >>= 4;
+		b += 4;
+	}
+	if(value >= 0x4) {
+		value >>= 2;
+		b += 2;
+	}
+	if(value >= 0x2) {
+		b++;
+	}
+	return b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1;
+}
+
+static void count(uint8_t histogram, uint16_t value) {
+	volatile uint16_t* counts = histograms[histogram];
+	uint8_t b = bucket(value);
+	if(counts[b] == UINT16_MAX) {
+		for(uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+			counts[i] /= 2;
+		}
+	}
+	counts[b]++;
+}
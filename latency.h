@@ -0,0 +1,95 @@
+/*
+ * latency.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Keeps track of how long each pass of the main loop takes and how late
+ * the timer 1 interrupt handler starts, as histograms with a bucket for
+ * each power of two, and of tasks which run more than
+ * LATENCY_DEADLINE_SLACK_MS after they were due (deadline misses). This is
+ * always on - it takes a few tens of cycles per loop pass and per timer 1
+ * interrupt.
+ *
+ * Times are measured with a cycle clock (see latency_now()) made from
+ * timer 1, which counts clock cycles and is reset every
+ * LATENCY_PERIOD_CYCLES (the 0.5ms seven segment interrupt, see hal.c).
+ * How late the interrupt handler is is the timer's count when the handler
+ * starts, so it includes the cycles the compiler adds to enter the handler.
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+
+/* Clock cycles between timer 1 compare matches.
+ */
+#define LATENCY_PERIOD_CYCLES 4000
+
+/* Number of buckets in each histogram. Bucket 0 counts times of 0 or 1,
+ * and bucket n times from 2^n up to 2^(n+1)-1. The last bucket also counts
+ * anything longer.
+ */
+#define LATENCY_BUCKETS 16
+
+/* How late (ms) a task can be before it counts as a deadline miss. Can be
+ * changed at compile time.
+ */
+#ifndef LATENCY_DEADLINE_SLACK_MS
+#define LATENCY_DEADLINE_SLACK_MS 10
+#endif
+
+/* The histograms: the time between the starts of main loop passes
+ * (microseconds), and how late the timer 1 interrupt handler starts
+ * (cycles).
+ */
+typedef enum {
+	LATENCY_LOOP,
+	LATENCY_TIMER1_ENTRY,
+	NUM_LATENCY_HISTOGRAMS
+} LatencyHistogram;
+
+/* Called at the start of the timer 1 compare match interrupt handler.
+ */
+void latency_tick(void);
+
+/* The cycle clock. It wraps around every 2^32 cycles but the difference
+ * between two times is right as long as they are less than that (about
+ * 9 minutes) apart. Stops while the timers are stopped (see
+ * power_sleep_tickless()).
+ */
+uint32_t latency_now(void);
+
+/* Called at the start of each pass of the main loop.
+ */
+void latency_loop(void);
+
+/* Deadlines, for tasks numbered 0 to 7 (e.g. scheduler tasks). Call
+ * latency_expect() when a task is started to run delay_ms from now, and
+ * latency_check() when it runs. latency_forget() forgets every expected
+ * task and the last main loop pass, e.g. after the timers have been
+ * stopped.
+ */
+void latency_expect(uint8_t task, uint16_t delay_ms);
+void latency_check(uint8_t task);
+void latency_forget(void);
+
+/* Number of deadline misses (stops at 65535), and the latest a task has
+ * been (ms past its due time).
+ */
+uint16_t latency_misses(void);
+uint16_t latency_worst_miss(void);
+
+/* Copy a histogram into counts (LATENCY_BUCKETS of them). When a bucket
+ * would overflow, every bucket in that histogram is halved, so the counts
+ * show the shape of the histogram rather than totals.
+ */
+void latency_histogram(uint8_t histogram, uint16_t* counts);
+
+/* Print the histograms and the worst deadline miss on the terminal,
+ * starting at row y. Only the buckets up to the last non-empty one are
+ * shown.
+ */
+void latency_dump(uint8_t y);
+
+#endif /* LATENCY_H_ */
@@ -1,116 +1,415 @@
-/*
- * ledmatrix.c
- *
- * Author: Peter Sutton
- * 
- * See the LED matrix Reference for details of the SPI commands used.
- */ 
-
-#include <avr/io.h>
-#include "ledmatrix.h"
-#include "spi.h"
-
-#define CMD_UPDATE_ALL 0x00
-#define CMD_UPDATE_PIXEL 0x01
-#define CMD_UPDATE_ROW 0x02
-#define CMD_UPDATE_COL 0x03
-#define CMD_SHIFT_DISPLAY 0x04
-#define CMD_CLEAR_SCREEN 0x0F
-
-void ledmatrix_setup(void) {
-	// Setup SPI - we divide the clock by 128.
-	// (This speed guarantees the SPI buffer will never overflow on
-	// the LED matrix.)
-	spi_setup_master(128);
-}
-
-void ledmatrix_update_all(MatrixData data) {
-	(void)spi_send_byte(CMD_UPDATE_ALL);
-	for(uint8_t y=0; y<MATRIX_NUM_ROWS; y++) {
-		for(uint8_t x=0; x<MATRIX_NUM_COLUMNS; x++) {
-			(void)spi_send_byte(data[x][y]);
-		}
-	}
-}
-
-void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
-	if(x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS) {
-		// Position isn't valid - we ignore the request.
-		return;
-	}
-	(void)spi_send_byte(CMD_UPDATE_PIXEL);
-	(void)spi_send_byte( ((y & 0x07)<<4) | (x & 0x0F));
-	(void)spi_send_byte(pixel);
-}
-
-void ledmatrix_update_row(uint8_t y, MatrixRow row) {
-	if(y >= MATRIX_NUM_ROWS) {
-		// y value is too large - we ignore the request
-		return;
-	}
-	(void)spi_send_byte(CMD_UPDATE_ROW);
-	(void)spi_send_byte(y & 0x07);	// row number
-	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
-		(void)spi_send_byte(row[x]);
-	}
-}
-
-void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
-	if(x >= MATRIX_NUM_COLUMNS) {
-		// x value is too large - we ignore the request
-		return;
-	}
-	(void)spi_send_byte(CMD_UPDATE_COL);
-	(void)spi_send_byte(x & 0x0F); // column number
-	for(uint8_t y = 0; y<MATRIX_NUM_ROWS; y++) {
-		(void)spi_send_byte(col[y]);
-	}
-}
-
-void ledmatrix_shift_display_left(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x02);
-}
-
-void ledmatrix_shift_display_right(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x01);
-}
-
-void ledmatrix_shift_display_up(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x08);
-}
-
-void ledmatrix_shift_display_down(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x04);
-}
-
-void ledmatrix_clear(void) {
-	(void)spi_send_byte(CMD_CLEAR_SCREEN);
-}
-
-void copy_matrix_column(MatrixColumn from, MatrixColumn to) {
-	for(uint8_t row = 0; row <MATRIX_NUM_ROWS; row++) {
-		to[row] = from[row];
-	}
-}
-
-void copy_matrix_row(MatrixRow from, MatrixRow to) {
-	for(uint8_t col = 0; col < MATRIX_NUM_COLUMNS; col++) {
-		to[col] = from[col];
-	}
-}
-
-void set_matrix_column_to_colour(MatrixColumn matrix_column, PixelColour colour) {
-	for(uint8_t row = 0; row < MATRIX_NUM_ROWS; row++) {
-		matrix_column[row] = colour;
-	}
-}
-
-void set_matrix_row_to_colour(MatrixRow matrix_row, PixelColour colour) {
-	for(uint8_t column = 0; column < MATRIX_NUM_COLUMNS; column++) {
-		matrix_row[column] = colour;
-	}
-}
+/*
+ * ledmatrix.c
+ *
+ * Author: Peter Sutton
+ * 
+ * See the LED matrix Reference for details of the SPI commands used.
+ * Commands are queued for the SPI interrupt handler to send so these
+ * functions return before the matrix has been updated.
+ */ 
+
+#ifndef F_CPU
+#define F_CPU 8000000L
+#endif
+
+#include <avr/io.h>
+#include <util/delay.h>
+#include "ledmatrix.h"
+#include "spi.h"
+
+#define CMD_UPDATE_ALL 0x00
+#define CMD_UPDATE_PIXEL 0x01
+#define CMD_UPDATE_ROW 0x02
+#define CMD_UPDATE_COL 0x03
+#define CMD_SHIFT_DISPLAY 0x04
+#define CMD_CLEAR_SCREEN 0x0F
+
+/* RAM copy of what is currently shown on (or queued for) the LED matrix.
+ * Every command sent to the matrix also updates this copy, so writes which
+ * would not change a pixel can be skipped. dirty[x] has bit y set if
+ * shadow[x][y] has been changed by ledmatrix_draw_pixel() but not yet sent
+ * to the matrix - ledmatrix_flush() sends these.
+ */
+static MatrixData shadow;
+static uint8_t dirty[MATRIX_NUM_COLUMNS];
+
+/* Number of bytes each command takes to send. ledmatrix_flush() uses these
+ * to pick the cheapest way of sending the dirty pixels.
+ */
+#define PIXEL_COST 3
+#define ROW_COST (2 + MATRIX_NUM_COLUMNS)
+#define COLUMN_COST (2 + MATRIX_NUM_ROWS)
+#define ALL_COST (1 + MATRIX_NUM_COLUMNS * MATRIX_NUM_ROWS)
+
+/* Bytes sent to the matrix, and bytes we avoided sending (compared to
+ * sending every pixel write individually as it was made).
+ */
+static uint32_t bytes_sent;
+static uint32_t bytes_saved;
+
+/* Microseconds to wait (after the previous command has been sent) before
+ * starting each command. This is only needed when the SPI clock is faster
+ * than the default - it gives the matrix time to deal with one command
+ * before the next arrives. 0 means no pacing.
+ */
+static uint8_t command_gap_us;
+
+#ifdef LEDMATRIX_FAST_CLOCK
+/* Clock dividers tried by ledmatrix_select_fastest_clock(), fastest first,
+ * and the number of times the test pattern is sent at each.
+ */
+static const uint8_t test_dividers[] = {2, 4, 8, 16, 32, 64};
+#define CLOCK_TEST_REPEATS 4
+#endif
+
+static void send_command(uint8_t command);
+static void send_byte(uint8_t byte);
+#ifdef LEDMATRIX_FAST_CLOCK
+static uint8_t clock_test_passes(void);
+static void resync(void);
+#endif
+static void send_pixel(uint8_t x, uint8_t y, PixelColour pixel);
+static uint8_t count_bits(uint8_t value);
+
+void ledmatrix_setup(void) {
+	// Setup SPI - we divide the clock by 128.
+	// (This speed guarantees the SPI buffer will never overflow on
+	// the LED matrix.) A faster speed can be chosen afterwards with
+	// ledmatrix_set_clock_divider() or ledmatrix_select_fastest_clock().
+	spi_setup_master(LEDMATRIX_DEFAULT_DIVIDER);
+	command_gap_us = 0;
+}
+
+void ledmatrix_set_clock_divider(uint8_t clockdivider) {
+	spi_set_clock_divider(clockdivider);
+	if(spi_get_clock_divider() < LEDMATRIX_DEFAULT_DIVIDER) {
+		command_gap_us = LEDMATRIX_COMMAND_GAP_US;
+	} else {
+		command_gap_us = 0;
+	}
+}
+
+void ledmatrix_set_command_gap(uint8_t gap_us) {
+	command_gap_us = gap_us;
+}
+
+uint8_t ledmatrix_select_fastest_clock(void) {
+#ifndef LEDMATRIX_FAST_CLOCK
+	// The default clock is slow enough for the matrix to keep up with
+	// everything we send, and passing the test doesn't prove that a
+	// faster one is (see ledmatrix.h)
+	return LEDMATRIX_DEFAULT_DIVIDER;
+#else
+	// Anything waiting to be drawn is sent first, so the test pattern
+	// (which resends pixels from our RAM copy) doesn't change the display
+	ledmatrix_flush();
+	uint8_t divider = LEDMATRIX_DEFAULT_DIVIDER;
+	for(uint8_t i = 0; i < sizeof(test_dividers); i++) {
+		ledmatrix_set_clock_divider(test_dividers[i]);
+		if(clock_test_passes()) {
+			divider = test_dividers[i];
+			break;
+		}
+	}
+	ledmatrix_set_clock_divider(divider);
+	resync();
+	return divider;
+#endif
+}
+
+#ifdef LEDMATRIX_FAST_CLOCK
+
+// A test which failed may have left the matrix part way through a command
+// (so it would take the next command's bytes the wrong way) or showing
+// stray pixels. No command is longer than ALL_COST bytes, so after ALL_COST
+// clear screen commands any command in progress has been finished and the
+// screen has then been cleared. Everything is marked as changed, so the
+// next flush sends the whole of the RAM copy again.
+static void resync(void) {
+	for(uint8_t i = 0; i < ALL_COST; i++) {
+		send_command(CMD_CLEAR_SCREEN);
+	}
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		dirty[x] = (1 << MATRIX_NUM_ROWS) - 1;
+	}
+}
+
+// Check that the matrix receives bytes correctly at the current clock speed.
+// While a byte is sent, the matrix's SPI hardware shifts back the last byte
+// it received, so each byte we get back should be the one we sent before
+// it. We send whole display updates which repeat what is already displayed,
+// so the test is not visible. Like ledmatrix_update_all() these are paced
+// before the command but send the display's bytes back to back, as the
+// longest burst ledmatrix_flush() ever sends. (If the matrix doesn't send
+// anything back, this test fails at every speed.)
+static uint8_t clock_test_passes(void) {
+	uint8_t last_sent = 0;
+	uint8_t first = 1;
+	
+	for(uint8_t repeat = 0; repeat < CLOCK_TEST_REPEATS; repeat++) {
+		// Keep to the same pacing as normal commands
+		for(uint8_t gap = 0; gap < command_gap_us; gap++) {
+			_delay_us(1);
+		}
+		for(uint8_t i = 0; i < ALL_COST; i++) {
+			uint8_t byte = CMD_UPDATE_ALL;
+			if(i > 0) {
+				uint8_t offset = i - 1;
+				byte = shadow[offset % MATRIX_NUM_COLUMNS][offset / MATRIX_NUM_COLUMNS];
+			}
+			uint8_t received = spi_send_byte(byte);
+			if(!first && received != last_sent) {
+				return 0;
+			}
+			first = 0;
+			last_sent = byte;
+		}
+	}
+	return 1;
+}
+#endif
+
+void ledmatrix_update_all(MatrixData data) {
+	send_command(CMD_UPDATE_ALL);
+	for(uint8_t y=0; y<MATRIX_NUM_ROWS; y++) {
+		for(uint8_t x=0; x<MATRIX_NUM_COLUMNS; x++) {
+			send_byte(data[x][y]);
+			shadow[x][y] = data[x][y];
+		}
+	}
+	for(uint8_t x=0; x<MATRIX_NUM_COLUMNS; x++) {
+		dirty[x] = 0;
+	}
+}
+
+void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
+	if(x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS) {
+		// Position isn't valid - we ignore the request.
+		return;
+	}
+	if(shadow[x][y] == pixel && !(dirty[x] & (1<<y))) {
+		// The matrix already shows this colour - nothing to send
+		bytes_saved += PIXEL_COST;
+		return;
+	}
+	send_pixel(x, y, pixel);
+}
+
+void ledmatrix_draw_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
+	if(x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS) {
+		// Position isn't valid - we ignore the request.
+		return;
+	}
+	if(shadow[x][y] != pixel) {
+		shadow[x][y] = pixel;
+		dirty[x] |= (1<<y);
+	} else {
+		bytes_saved += PIXEL_COST;
+	}
+}
+
+// Send the dirty pixels using as few bytes as we can. If enough pixels have
+// changed we send the whole display. Otherwise we send each column which
+// has enough dirty pixels to make a column update cheaper than separate
+// pixel updates, then do the same for rows, and then send what is left as
+// pixel updates.
+void ledmatrix_flush(void) {
+	uint8_t dirty_count = 0;
+	uint32_t start_bytes = bytes_sent;
+	
+	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
+		dirty_count += count_bits(dirty[x]);
+	}
+	if(dirty_count == 0) {
+		return;
+	}
+	
+	if(dirty_count * PIXEL_COST >= ALL_COST) {
+		ledmatrix_update_all(shadow);
+	} else {
+		for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
+			if(count_bits(dirty[x]) * PIXEL_COST > COLUMN_COST) {
+				ledmatrix_update_column(x, shadow[x]);
+			}
+		}
+		for(uint8_t y = 0; y<MATRIX_NUM_ROWS; y++) {
+			uint8_t row_count = 0;
+			for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
+				if(dirty[x] & (1<<y)) {
+					row_count++;
+				}
+			}
+			if(row_count * PIXEL_COST > ROW_COST) {
+				MatrixRow row;
+				for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
+					row[x] = shadow[x][y];
+				}
+				ledmatrix_update_row(y, row);
+			}
+		}
+		for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
+			if(dirty[x] == 0) {
+				continue;
+			}
+			for(uint8_t y = 0; y<MATRIX_NUM_ROWS; y++) {
+				if(dirty[x] & (1<<y)) {
+					send_pixel(x, y, shadow[x][y]);
+				}
+			}
+		}
+	}
+	bytes_saved += dirty_count * PIXEL_COST - (bytes_sent - start_bytes);
+}
+
+uint32_t ledmatrix_bytes_sent(void) {
+	return bytes_sent;
+}
+
+uint32_t ledmatrix_bytes_saved(void) {
+	return bytes_saved;
+}
+
+static void send_command(uint8_t command) {
+	if(command_gap_us) {
+		spi_wait_idle();
+		for(uint8_t gap = 0; gap < command_gap_us; gap++) {
+			_delay_us(1);
+		}
+	}
+	send_byte(command);
+}
+
+static void send_byte(uint8_t byte) {
+	spi_queue_byte(byte);
+	bytes_sent++;
+}
+
+static uint8_t count_bits(uint8_t value) {
+	uint8_t count = 0;
+	while(value) {
+		value &= value - 1; // clear the lowest set bit
+		count++;
+	}
+	return count;
+}
+
+static void send_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
+	send_command(CMD_UPDATE_PIXEL);
+	send_byte( ((y & 0x07)<<4) | (x & 0x0F));
+	send_byte(pixel);
+	shadow[x][y] = pixel;
+	dirty[x] &= ~(1<<y);
+}
+
+void ledmatrix_update_row(uint8_t y, MatrixRow row) {
+	if(y >= MATRIX_NUM_ROWS) {
+		// y value is too large - we ignore the request
+		return;
+	}
+	send_command(CMD_UPDATE_ROW);
+	send_byte(y & 0x07);	// row number
+	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
+		send_byte(row[x]);
+		shadow[x][y] = row[x];
+		dirty[x] &= ~(1<<y);
+	}
+}
+
+void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
+	if(x >= MATRIX_NUM_COLUMNS) {
+		// x value is too large - we ignore the request
+		return;
+	}
+	send_command(CMD_UPDATE_COL);
+	send_byte(x & 0x0F); // column number
+	for(uint8_t y = 0; y<MATRIX_NUM_ROWS; y++) {
+		send_byte(col[y]);
+		shadow[x][y] = col[y];
+	}
+	dirty[x] = 0;
+}
+
+// The shift commands move the whole display by one pixel and blank the
+// column or row that is shifted in. Any pixels not yet flushed are sent
+// first so that they get shifted along with everything else.
+void ledmatrix_shift_display_left(void) {
+	ledmatrix_flush();
+	send_command(CMD_SHIFT_DISPLAY);
+	send_byte(0x02);
+	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS-1; x++) {
+		copy_matrix_column(shadow[x+1], shadow[x]);
+	}
+	set_matrix_column_to_colour(shadow[MATRIX_NUM_COLUMNS-1], COLOUR_BLACK);
+}
+
+void ledmatrix_shift_display_right(void) {
+	ledmatrix_flush();
+	send_command(CMD_SHIFT_DISPLAY);
+	send_byte(0x01);
+	for(uint8_t x = MATRIX_NUM_COLUMNS-1; x>0; x--) {
+		copy_matrix_column(shadow[x-1], shadow[x]);
+	}
+	set_matrix_column_to_colour(shadow[0], COLOUR_BLACK);
+}
+
+void ledmatrix_shift_display_up(void) {
+	ledmatrix_flush();
+	send_command(CMD_SHIFT_DISPLAY);
+	send_byte(0x08);
+	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
+		for(uint8_t y = MATRIX_NUM_ROWS-1; y>0; y--) {
+			shadow[x][y] = shadow[x][y-1];
+		}
+		shadow[x][0] = COLOUR_BLACK;
+	}
+}
+
+void ledmatrix_shift_display_down(void) {
+	ledmatrix_flush();
+	send_command(CMD_SHIFT_DISPLAY);
+	send_byte(0x04);
+	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
+		for(uint8_t y = 0; y<MATRIX_NUM_ROWS-1; y++) {
+			shadow[x][y] = shadow[x][y+1];
+		}
+		shadow[x][MATRIX_NUM_ROWS-1] = COLOUR_BLACK;
+	}
+}
+
+void ledmatrix_clear(void) {
+	send_command(CMD_CLEAR_SCREEN);
+	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
+		set_matrix_column_to_colour(shadow[x], COLOUR_BLACK);
+		dirty[x] = 0;
+	}
+}
+
+void ledmatrix_get_column(uint8_t x, MatrixColumn col) {
+	if(x < MATRIX_NUM_COLUMNS) {
+		copy_matrix_column(shadow[x], col);
+	}
+}
+
+void copy_matrix_column(MatrixColumn from, MatrixColumn to) {
+	for(uint8_t row = 0; row <MATRIX_NUM_ROWS; row++) {
+		to[row] = from[row];
+	}
+}
+
+void copy_matrix_row(MatrixRow from, MatrixRow to) {
+	for(uint8_t col = 0; col < MATRIX_NUM_COLUMNS; col++) {
+		to[col] = from[col];
+	}
+}
+
+void set_matrix_column_to_colour(MatrixColumn matrix_column, PixelColour colour) {
+	for(uint8_t row = 0; row < MATRIX_NUM_ROWS; row++) {
+		matrix_column[row] = colour;
+	}
+}
+
+void set_matrix_row_to_colour(MatrixRow matrix_row, PixelColour colour) {
+	for(uint8_t column = 0; column < MATRIX_NUM_COLUMNS; column++) {
+		matrix_row[column] = colour;
+	}
+}
@@ -1,50 +1,98 @@
-/*
- * ledmatrix.h
- *
- * Author: Peter Sutton
- */ 
-
-
-#ifndef LEDMATRIX_H_
-#define LEDMATRIX_H_
-
-#include <stdint.h>
-#include "pixel_colour.h"
-
-// The matrix has 16 columns (x ranges from 0 to 15, left to right) and 
-// 8 rows (y ranges from 0 to 7, bottom to top) - as per the X,Y
-// coordinates marked on the board.
-#define MATRIX_NUM_COLUMNS 16
-#define MATRIX_NUM_ROWS 8
-
-// Data types which can be used to store display information
-typedef PixelColour MatrixData[MATRIX_NUM_COLUMNS][MATRIX_NUM_ROWS];
-typedef PixelColour MatrixRow[MATRIX_NUM_COLUMNS];
-typedef PixelColour MatrixColumn[MATRIX_NUM_ROWS];
-
-// Setup SPI communication with the LED matrix.
-// This function must be called before the LED matrix functions
-// below are used.
-void ledmatrix_setup(void);
-
-// Functions to update the display
-// For those functions which take an x or a y value, the value must be valid
-// or the request will be ignored. (i.e. x must be < MATRIX_NUM_COLUMNS
-// and y must be < MATRIX_NUM_ROWS)
-void ledmatrix_update_all(MatrixData data);
-void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel);
-void ledmatrix_update_row(uint8_t y, MatrixRow row);
-void ledmatrix_update_column(uint8_t x, MatrixColumn col);
-void ledmatrix_shift_display_left(void);
-void ledmatrix_shift_display_right(void);
-void ledmatrix_shift_display_up(void);
-void ledmatrix_shift_display_down(void);
-void ledmatrix_clear(void);
-
-// Functions to operate on MatrixRow and MatrixColumn data structures
-void copy_matrix_column(MatrixColumn from, MatrixColumn to);
-void copy_matrix_row(MatrixRow from, MatrixRow to);
-void set_matrix_column_to_colour(MatrixColumn matrix_column, PixelColour colour);
-void set_matrix_row_to_colour(MatrixRow matrix_row, PixelColour colour);
-
-#endif /* LEDMATRIX_H_ */
+/*
+ * ledmatrix.h
+ *
+ * Author: Peter Sutton
+ */ 
+
+
+#ifndef LEDMATRIX_H_
+#define LEDMATRIX_H_
+
+#include <stdint.h>
+#include "pixel_colour.h"
+
+// The matrix has 16 columns (x ranges from 0 to 15, left to right) and 
+// 8 rows (y ranges from 0 to 7, bottom to top) - as per the X,Y
+// coordinates marked on the board.
+#define MATRIX_NUM_COLUMNS 16
+#define MATRIX_NUM_ROWS 8
+
+// Data types which can be used to store display information
+typedef PixelColour MatrixData[MATRIX_NUM_COLUMNS][MATRIX_NUM_ROWS];
+typedef PixelColour MatrixRow[MATRIX_NUM_COLUMNS];
+typedef PixelColour MatrixColumn[MATRIX_NUM_ROWS];
+
+// The default SPI clock divider (slow enough that the matrix never misses
+// data) and the gap between commands used when the clock is faster.
+#define LEDMATRIX_DEFAULT_DIVIDER 128
+#ifndef LEDMATRIX_COMMAND_GAP_US
+#define LEDMATRIX_COMMAND_GAP_US 20
+#endif
+
+// Setup SPI communication with the LED matrix.
+// This function must be called before the LED matrix functions
+// below are used. The SPI clock is set to LEDMATRIX_DEFAULT_DIVIDER.
+void ledmatrix_setup(void);
+
+// Change the SPI clock divider (2, 4, 8, 16, 32, 64 or 128). Dividers below
+// LEDMATRIX_DEFAULT_DIVIDER also turn on a LEDMATRIX_COMMAND_GAP_US pause
+// before each command; ledmatrix_set_command_gap() can change this pause
+// (in microseconds, 0 turns it off).
+void ledmatrix_set_clock_divider(uint8_t clockdivider);
+void ledmatrix_set_command_gap(uint8_t gap_us);
+
+// Only built with LEDMATRIX_FAST_CLOCK defined (otherwise this just returns
+// LEDMATRIX_DEFAULT_DIVIDER and changes nothing). Try each clock divider
+// from fastest to slowest, sending whole display updates (the longest
+// commands, with no gaps between their bytes) and checking the bytes
+// echoed back, and keep the fastest that works. Returns the divider chosen
+// (LEDMATRIX_DEFAULT_DIVIDER if none pass). The matrix is then cleared,
+// and the whole display is sent again at the next ledmatrix_flush().
+// Intended to be called once at startup, after ledmatrix_setup().
+// The echo comes from the matrix's SPI hardware, not its firmware, so it
+// only shows that the bytes get there - not that the matrix keeps up with
+// them. A fast clock should only be turned on for a matrix which has been
+// seen to show frames correctly at it.
+uint8_t ledmatrix_select_fastest_clock(void);
+
+// Functions to update the display
+// For those functions which take an x or a y value, the value must be valid
+// or the request will be ignored. (i.e. x must be < MATRIX_NUM_COLUMNS
+// and y must be < MATRIX_NUM_ROWS)
+// A copy of the display is kept in RAM. ledmatrix_update_pixel() sends
+// nothing if the pixel already has the given colour.
+void ledmatrix_update_all(MatrixData data);
+void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel);
+void ledmatrix_update_row(uint8_t y, MatrixRow row);
+void ledmatrix_update_column(uint8_t x, MatrixColumn col);
+void ledmatrix_shift_display_left(void);
+void ledmatrix_shift_display_right(void);
+void ledmatrix_shift_display_up(void);
+void ledmatrix_shift_display_down(void);
+void ledmatrix_clear(void);
+
+// Copy column x of the RAM copy of the display (including any pixels drawn
+// but not yet flushed) into col.
+void ledmatrix_get_column(uint8_t x, MatrixColumn col);
+
+// Deferred drawing. ledmatrix_draw_pixel() only changes the RAM copy of the
+// display; ledmatrix_flush() then sends every pixel that has changed since
+// it was last sent, using pixel, row, column or whole display updates
+// (whichever needs the fewest bytes). Drawing the same colour again
+// costs nothing.
+void ledmatrix_draw_pixel(uint8_t x, uint8_t y, PixelColour pixel);
+void ledmatrix_flush(void);
+
+// Total bytes sent to the matrix, and total bytes not sent because of the
+// RAM copy and flush batching (compared with sending every pixel change
+// as its own pixel update).
+uint32_t ledmatrix_bytes_sent(void);
+uint32_t ledmatrix_bytes_saved(void);
+
+// Functions to operate on MatrixRow and MatrixColumn data structures
+void copy_matrix_column(MatrixColumn from, MatrixColumn to);
+void copy_matrix_row(MatrixRow from, MatrixRow to);
+void set_matrix_column_to_colour(MatrixColumn matrix_column, PixelColour colour);
+void set_matrix_row_to_colour(MatrixRow matrix_row, PixelColour colour);
+
+#endif /* LEDMATRIX_H_ */
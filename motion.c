@@ -0,0 +1,77 @@
+/*
+ * motion.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See motion.h. Each step the car speeds up if it could still stop in time
+ * after doing so, keeps its speed if it could stop in time at that speed,
+ * and otherwise slows down. It never goes slower than one
+ * MOTION_ACCELERATION per step, so it always reaches the target - the
+ * last step just stops it there.
+ */
+
+#include <stdint.h>
+
+#include "motion.h"
+
+#if MOTION_ACCELERATION < 1 || MOTION_ACCELERATION > 63
+#error "MOTION_ACCELERATION must be between 1 and 63"
+#endif
+
+static uint16_t distance_to(const Motion* motion, uint16_t target);
+static uint16_t stopping_distance(uint8_t speed);
+static uint8_t can_stop_after_step(uint8_t speed, uint16_t distance);
+
+uint8_t motion_step(Motion* motion, uint16_t target, uint8_t top_speed) {
+	uint16_t distance = distance_to(motion, target);
+	if(distance == 0) {
+		motion->speed = 0;
+		return 1;
+	}
+
+	uint8_t speed = motion->speed;
+	uint8_t faster = (speed + MOTION_ACCELERATION > top_speed) ?
+			top_speed : speed + MOTION_ACCELERATION;
+	if(faster > speed && can_stop_after_step(faster, distance)) {
+		speed = faster;
+	} else if(speed > top_speed || !can_stop_after_step(speed, distance)) {
+		speed = (speed > 2 * MOTION_ACCELERATION) ?
+				speed - MOTION_ACCELERATION : MOTION_ACCELERATION;
+	}
+
+	if(speed >= distance) {
+		motion->position = target;
+		motion->speed = 0;
+		return 1;
+	}
+	if(target > motion->position) {
+		motion->position += speed;
+	} else {
+		motion->position -= speed;
+	}
+	motion->speed = speed;
+	return 0;
+}
+
+uint8_t motion_can_stop(const Motion* motion, uint16_t target) {
+	return stopping_distance(motion->speed) <= distance_to(motion, target);
+}
+
+static uint16_t distance_to(const Motion* motion, uint16_t target) {
+	if(target > motion->position) {
+		return target - motion->position;
+	}
+	return motion->position - target;
+}
+
+// The distance covered while slowing down from speed to a stop (this is
+// slightly more than the car really needs, which leaves a little creeping
+// at the end rather than an overshoot)
+static uint16_t stopping_distance(uint8_t speed) {
+	return ((uint16_t)speed * speed) / (2 * MOTION_ACCELERATION);
+}
+
+// Whether moving distance at speed this step still leaves room to stop
+static uint8_t can_stop_after_step(uint8_t speed, uint16_t distance) {
+	return speed + stopping_distance(speed) <= distance;
+}
@@ -0,0 +1,63 @@
+/*
+ * motion.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Moves a car smoothly between rows, speeding up and slowing down at a
+ * steady rate (a trapezoidal speed profile, or a triangular one if the
+ * trip is too short to reach top speed).
+ *
+ * Positions are fixed point: the row (see building.h) in the high byte and
+ * how far the car is towards the next row up, in 1/256ths of a row, in the
+ * low byte. Speeds are in 1/256ths of a row per step and motion_step() is
+ * called every MOTION_STEP_MS, so everything is done with small integer
+ * additions and one multiply per step.
+ */
+
+#ifndef MOTION_H_
+#define MOTION_H_
+
+#include <stdint.h>
+
+/* How often motion_step() is called (milliseconds).
+ */
+#define MOTION_STEP_MS 20
+
+/* How much the speed changes by each step (1/256ths of a row per step).
+ */
+#ifndef MOTION_ACCELERATION
+#define MOTION_ACCELERATION 4
+#endif
+
+/* The position of a row, and the row a position is on (rounding down or to
+ * the nearest row) and how far past that row it is.
+ */
+#define MOTION_ONE_ROW 256
+#define motion_row_position(row) ((uint16_t)(row) << 8)
+#define motion_row(position) ((uint8_t)((position) >> 8))
+#define motion_nearest_row(position) ((uint8_t)(((position) + MOTION_ONE_ROW / 2) >> 8))
+#define motion_fraction(position) ((uint8_t)(position))
+
+/* The top speed (for motion_step()) which moves one row every ms_per_row
+ * milliseconds.
+ */
+#define MOTION_SPEED(ms_per_row) \
+	((uint8_t)((MOTION_ONE_ROW * MOTION_STEP_MS + (ms_per_row) / 2) / (ms_per_row)))
+
+typedef struct {
+	uint16_t position;
+	uint8_t speed; // Always moving towards the target given to motion_step()
+} Motion;
+
+/* Take one step towards target, speeding up to top_speed (at most a row per
+ * step) and slowing down in time to stop at the target. Returns 1 once the
+ * car is stopped at the target.
+ */
+uint8_t motion_step(Motion* motion, uint16_t target, uint8_t top_speed);
+
+/* Return 1 if the car can still slow down in time to stop at target, which
+ * must be ahead of it (or where it is).
+ */
+uint8_t motion_can_stop(const Motion* motion, uint16_t target);
+
+#endif /* MOTION_H_ */
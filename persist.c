@@ -0,0 +1,212 @@
+/*
+ * persist.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See persist.h. Records are saved to the slots in turn, so the record
+ * before the newest one is in the slot before it. A record is written in
+ * order: the sequence number, the sections and then the CRC, which is
+ * worked out as the bytes go out. Each byte is found from its position in
+ * the record, so nothing is copied.
+ */
+
+#include <stdint.h>
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#include "persist.h"
+#include "timer0.h"
+
+// Most bytes dealt with (written, or checked and found to be right
+// already) in one main loop pass, so a pass never takes long
+#define BYTES_PER_PASS 16
+
+static const PersistSection* sections;
+static uint8_t section_count;
+static uint16_t record_size; // Including the sequence number and CRC
+static uint8_t slot_count;
+
+// The slot and sequence number of the newest record
+static uint8_t newest_slot;
+static uint16_t newest_sequence;
+
+// Whether there are unsaved changes, and when the last save started
+static uint8_t dirty;
+static uint32_t last_save;
+
+// Whether a record is being written, and the position reached and CRC so
+// far
+static uint8_t writing;
+static uint16_t position;
+static uint16_t crc;
+
+static uint8_t* slot_address(uint8_t slot);
+static uint16_t read_sequence(uint8_t slot);
+static uint8_t record_is_valid(uint8_t slot);
+static uint8_t record_byte(uint16_t offset, uint16_t sequence);
+static uint16_t start_crc(void);
+
+uint8_t persist_load(const PersistSection* list, uint8_t count) {
+	sections = list;
+	section_count = count;
+	record_size = 4;
+	for(uint8_t i = 0; i < count; i++) {
+		record_size += list[i].size;
+	}
+	slot_count = PERSIST_EEPROM_SIZE / record_size;
+	dirty = 0;
+	writing = 0;
+	// Save as soon as there is anything to save
+	last_save = get_current_time() - PERSIST_INTERVAL_MS;
+
+	// Find the newest record from the sequence numbers (which wrap
+	// around, so they are compared by their difference)
+	uint8_t slot = 0;
+	uint16_t sequence = read_sequence(0);
+	for(uint8_t i = 1; i < slot_count; i++) {
+		uint16_t next = read_sequence(i);
+		if((int16_t)(next - sequence) > 0) {
+			slot = i;
+			sequence = next;
+		}
+	}
+
+	// Go back from it, slot by slot (the order they were written in; the
+	// sequence number of a record which was only partly written can't be
+	// trusted), until a record is complete
+	for(uint8_t tried = 0; tried < slot_count; tried++) {
+		if(record_is_valid(slot)) {
+			newest_slot = slot;
+			newest_sequence = sequence;
+			uint8_t* address = slot_address(slot) + 2;
+			for(uint8_t i = 0; i < count; i++) {
+				uint8_t* data = list[i].data;
+				for(uint8_t j = 0; j < list[i].size; j++) {
+					data[j] = eeprom_read_byte(address++);
+				}
+			}
+			return 1;
+		}
+		slot = (slot == 0 ? slot_count : slot) - 1;
+		sequence = read_sequence(slot);
+	}
+
+	// Nothing saved (or nothing we can use), so start again from slot 0
+	newest_slot = slot_count - 1;
+	newest_sequence = UINT16_MAX;
+	return 0;
+}
+
+void persist_changed(void) {
+	if(writing) {
+		// Some of the record may have the old value, so start it again.
+		// The bytes already written which haven't changed are skipped, so
+		// this doesn't take long.
+		position = 0;
+		crc = start_crc();
+	} else {
+		dirty = 1;
+	}
+}
+
+void persist_run(uint8_t idle) {
+	if(!writing) {
+		if(persist_time_to_save(idle) != 0) {
+			return;
+		}
+		writing = 1;
+		dirty = 0;
+		position = 0;
+		crc = start_crc();
+		last_save = get_current_time();
+	}
+
+	uint8_t slot = newest_slot + 1;
+	if(slot == slot_count) {
+		slot = 0;
+	}
+	uint16_t sequence = newest_sequence + 1;
+	uint8_t* address = slot_address(slot);
+	for(uint8_t i = 0; i < BYTES_PER_PASS && position < record_size; i++) {
+		// Wait (until the next pass) for the last byte to be written
+		if(!eeprom_is_ready()) {
+			return;
+		}
+		uint8_t value;
+		if(position < record_size - 2) {
+			value = record_byte(position, sequence);
+			crc = _crc_ccitt_update(crc, value);
+		} else if(position == record_size - 2) {
+			value = crc & 0xFF;
+		} else {
+			value = crc >> 8;
+		}
+		if(eeprom_read_byte(address + position) != value) {
+			eeprom_write_byte(address + position, value);
+		}
+		position++;
+	}
+	if(position == record_size) {
+		writing = 0;
+		newest_slot = slot;
+		newest_sequence = sequence;
+	}
+}
+
+uint8_t persist_busy(void) {
+	return writing;
+}
+
+uint32_t persist_time_to_save(uint8_t idle) {
+	if(writing) {
+		return 0;
+	}
+	if(!dirty) {
+		return UINT32_MAX;
+	}
+	uint32_t since_last_save = get_current_time() - last_save;
+	uint32_t interval = idle ? PERSIST_IDLE_MS : PERSIST_INTERVAL_MS;
+	return since_last_save >= interval ? 0 : interval - since_last_save;
+}
+
+static uint8_t* slot_address(uint8_t slot) {
+	return (uint8_t*)(uintptr_t)(PERSIST_EEPROM_START + slot * record_size);
+}
+
+static uint16_t read_sequence(uint8_t slot) {
+	uint8_t* address = slot_address(slot);
+	return eeprom_read_byte(address) | (eeprom_read_byte(address + 1) << 8);
+}
+
+static uint8_t record_is_valid(uint8_t slot) {
+	uint8_t* address = slot_address(slot);
+	uint16_t check = start_crc();
+	for(uint16_t i = 0; i < record_size - 2; i++) {
+		check = _crc_ccitt_update(check, eeprom_read_byte(address + i));
+	}
+	return (check & 0xFF) == eeprom_read_byte(address + record_size - 2)
+			&& (check >> 8) == eeprom_read_byte(address + record_size - 1);
+}
+
+// The byte at offset in a record, before the CRC
+static uint8_t record_byte(uint16_t offset, uint16_t sequence) {
+	if(offset < 2) {
+		return offset == 0 ? sequence & 0xFF : sequence >> 8;
+	}
+	offset -= 2;
+	for(uint8_t i = 0; i < section_count; i++) {
+		if(offset < sections[i].size) {
+			return ((const uint8_t*)sections[i].data)[offset];
+		}
+		offset -= sections[i].size;
+	}
+	return 0;
+}
+
+// The CRC starts with the record size, so that a record of a different
+// size (saved by a program keeping different sections) is never valid
+static uint16_t start_crc(void) {
+	uint16_t check = _crc_ccitt_update(0xFFFF, record_size & 0xFF);
+	return _crc_ccitt_update(check, record_size >> 8);
+}
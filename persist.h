@@ -0,0 +1,94 @@
+/*
+ * persist.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Keeps settings and statistics in the EEPROM, so that they survive a
+ * reset or power cycle. What is kept is a list of sections of RAM (e.g.
+ * structures), which are saved together as one record and put back by
+ * persist_load() at startup.
+ *
+ * The EEPROM is divided into as many slots as there are room for, and each
+ * save goes to the slot after the newest record, so the writes are spread
+ * over the whole EEPROM (each byte can only be written about 100,000
+ * times). A record is:
+ *
+ *	sequence (2 bytes), the sections' bytes, CRC (2 bytes)
+ *
+ * where the sequence number goes up by one with each save and the CRC (the
+ * CCITT CRC-16 of the record size, the sequence number and the sections'
+ * bytes) shows that the record was written completely. At startup only the
+ * sequence numbers are read to find the newest record, and then the CRCs
+ * of the newest records until one is right. A record that was being
+ * written when the power went off is never the only copy, as the slot it
+ * was in held the oldest record; the record before it is used instead.
+ *
+ * Saving is done a byte at a time by persist_run() in the main loop,
+ * never waiting for the EEPROM (which takes about 3.4ms to write a byte),
+ * and bytes which are already right aren't written again. Nothing is saved
+ * until persist_changed() says something has changed, and then not until
+ * PERSIST_IDLE_MS after the last save if the controller is idle, or
+ * PERSIST_INTERVAL_MS if it stays busy (the first change after startup is
+ * saved straight away). If something changes while a record is being
+ * written, the record is started again, so it never mixes old and new
+ * values. The time doesn't move on while the board sleeps with its timers
+ * stopped, so a sleep is cut short when a save comes due (see
+ * persist_time_to_save()) rather than leaving the changes unsaved until
+ * something wakes it.
+ */
+
+#ifndef PERSIST_H_
+#define PERSIST_H_
+
+#include <stdint.h>
+
+#include <avr/eeprom.h>
+
+/* The part of the EEPROM used (all of it; the ATmega324A has 1KB), and the
+ * shortest time between saves when idle and when busy (ms). The intervals
+ * can be changed at compile time.
+ */
+#define PERSIST_EEPROM_START 0
+#define PERSIST_EEPROM_SIZE (E2END + 1)
+#ifndef PERSIST_IDLE_MS
+#define PERSIST_IDLE_MS 300000UL
+#endif
+#ifndef PERSIST_INTERVAL_MS
+#define PERSIST_INTERVAL_MS 900000UL
+#endif
+
+/* A section of RAM to keep.
+ */
+typedef struct {
+	void* data;
+	uint8_t size;
+} PersistSection;
+
+/* Set the sections which are kept (count of them, in RAM, which must stay
+ * where they are) and put back the newest valid record into them. Returns
+ * 1 if one was found, or 0 (leaving the sections as they are) if there
+ * isn't one, e.g. the first time or when the sections have changed size.
+ */
+uint8_t persist_load(const PersistSection* sections, uint8_t count);
+
+/* Say that something in the sections has changed and needs saving.
+ */
+void persist_changed(void);
+
+/* Carry on saving, if there is anything to save. Called on each pass of
+ * the main loop, with idle non-zero if nothing much is happening (so now
+ * is a good time to save).
+ */
+void persist_run(uint8_t idle);
+
+/* Return 1 if a record is being written.
+ */
+uint8_t persist_busy(void);
+
+/* Return how long (ms) it will be until persist_run(idle) starts saving
+ * the changes made so far: 0 if it is saving or would start now, or
+ * UINT32_MAX if there is nothing to save.
+ */
+uint32_t persist_time_to_save(uint8_t idle);
+
+#endif /* PERSIST_H_ */
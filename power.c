@@ -0,0 +1,109 @@
+/*
+ * power.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See power.h. While tickless, timer 1 counts at clock/1024 (7812.5 Hz)
+ * and interrupts once a second (on compare match B) so that we can count
+ * whole seconds asleep. The part of a second left over is read from the
+ * counter when we wake.
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/power.h>
+
+#include "power.h"
+#include "timer0.h"
+#include "serialio.h"
+#include "buttons.h"
+
+// Timer 1 counts per second at clock/1024, and the time per count (in
+// 1/1000ths of a millisecond)
+#define TICKLESS_COUNTS_PER_SECOND 7812
+#define TICKLESS_US_PER_COUNT 128
+
+// Set by the interrupt handlers below
+static volatile uint8_t button_changed;
+static volatile uint16_t seconds_asleep;
+
+void power_init(void) {
+	// The ADC, analog comparator, TWI and second USART aren't used
+	ACSR |= (1 << ACD);
+	power_adc_disable();
+	power_twi_disable();
+	power_usart1_disable();
+}
+
+void power_idle(void) {
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_mode();
+}
+
+void power_sleep_tickless(uint16_t max_seconds) {
+	// Save the timer set up so we can put it back
+	uint8_t saved_timsk0 = TIMSK0;
+	uint8_t saved_timsk1 = TIMSK1;
+	uint8_t saved_tccr1b = TCCR1B;
+	uint16_t saved_ocr1a = OCR1A;
+
+	// Stop the timer interrupts and count seconds with timer 1 (still in
+	// CTC mode, so it restarts from 0 each second)
+	TIMSK0 &= ~(1 << OCIE0A);
+	TCCR1B = (1 << WGM12) | (1 << CS12) | (1 << CS10); // Divide clock by 1024
+	OCR1A = TICKLESS_COUNTS_PER_SECOND - 1;
+	OCR1B = TICKLESS_COUNTS_PER_SECOND - 1;
+	TCNT1 = 0;
+	TIFR1 = (1 << OCF1A) | (1 << OCF1B);
+	TIMSK1 = (1 << OCIE1B);
+	seconds_asleep = 0;
+
+	// Wake on a change of any button input
+	button_changed = 0;
+	PCMSK1 = (1 << PCINT8) | (1 << PCINT9) | (1 << PCINT10) | (1 << PCINT11);
+	PCIFR = (1 << PCIF1);
+	PCICR |= (1 << PCIE1);
+
+	// Other interrupts (e.g. serial output) also wake us, so go back to
+	// sleep until it is a button or serial input (or the time is up, which
+	// is checked each second when timer 1 wakes us). The buttons are checked
+	// again now the pin change interrupt is on, in case one changed just
+	// before. Interrupts are enabled by the instruction before the sleep,
+	// so one can't sneak in between.
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	while(!button_changed && button_idle() && !serial_input_available()
+			&& (max_seconds == 0 || seconds_asleep < max_seconds)) {
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+
+	uint32_t slept = seconds_asleep * 1000UL +
+			((uint32_t)TCNT1 * TICKLESS_US_PER_COUNT) / 1000;
+
+	// Put everything back
+	PCICR &= ~(1 << PCIE1);
+	PCMSK1 = 0;
+	TCCR1B = saved_tccr1b;
+	OCR1A = saved_ocr1a;
+	TCNT1 = 0;
+	TIFR1 = (1 << OCF1A) | (1 << OCF1B);
+	TIMSK1 = saved_timsk1;
+	TIFR0 = (1 << OCF0A);
+	TIMSK0 = saved_timsk0;
+	add_to_current_time(slept);
+	sei();
+}
+
+ISR(TIMER1_COMPB_vect) {
+	seconds_asleep++;
+}
+
+ISR(PCINT1_vect) {
+	button_changed = 1;
+}
@@ -0,0 +1,42 @@
+/*
+ * power.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Sleep modes for saving power when there is nothing to do.
+ *
+ * power_idle() stops the CPU until the next interrupt. The timer
+ * interrupts keep running, so this is used at the end of each pass of a
+ * main loop instead of spinning.
+ *
+ * power_sleep_tickless() also stops the timer 0 and timer 1 interrupts,
+ * so the CPU only wakes when a button is pushed (a pin change on B0 to
+ * B3, i.e. the PCINT1 interrupt), a character is received or the time it
+ * was given is up. Timer 1 is
+ * borrowed to measure how long we slept, and that time is added to the
+ * clock (see timer0.h) when we wake. Both use IDLE mode, since the deeper
+ * modes stop the clock timer 1 and the USART run from.
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+/* Turn off the peripherals which aren't used.
+ */
+void power_init(void);
+
+/* Sleep (IDLE mode) until any interrupt.
+ */
+void power_idle(void);
+
+/* Sleep until a button is pushed or a character is received, or (if
+ * max_seconds isn't 0) until max_seconds have gone by. Must be called with
+ * interrupts disabled, after checking that nothing needs to be done - so
+ * that nothing can happen between the check and going to sleep. Returns straight away if a button is held or bouncing (see
+ * button_idle()). While asleep, nothing driven by the timer 0 or timer 1
+ * interrupts happens (e.g. seven segment display multiplexing). Returns
+ * with the timers as they were and interrupts enabled.
+ */
+void power_sleep_tickless(uint16_t max_seconds);
+
+#endif /* POWER_H_ */
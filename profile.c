@@ -0,0 +1,149 @@
+/*
+ * profile.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See profile.h. The sum of the cycles for each counter is kept so the
+ * mean can be found. Before it would overflow, the sum and the count are
+ * both halved, so the mean carries on being right (but the older times
+ * count for less).
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "profile.h"
+
+#ifdef PROFILE
+
+#include "serialio.h"
+#include "terminalio.h"
+
+typedef struct {
+	uint32_t min;
+	uint32_t max;
+	uint32_t sum;
+	uint16_t count;
+} ProfileStats;
+
+// Counters for interrupt handlers are only changed by their handler (which
+// can't be interrupted) and the others only by the main loop
+static volatile ProfileStats stats[NUM_PROFILE_COUNTERS];
+
+// Cycles taken by the PROFILE_ISR_ and PROFILE_ macros themselves
+static uint16_t isr_overhead;
+static uint16_t overhead;
+
+// The names in the table, each printed in a column 16 wide
+static const char names[NUM_PROFILE_COUNTERS][16] PROGMEM = {
+	"Timer 1 ISR",
+	"Timer 0 ISR",
+	"UDR empty ISR",
+	"RX ISR",
+	"Timer 2 ISR",
+	"Scheduler",
+	"Inputs",
+	"LED flush",
+	"Draw cars",
+	"Status lines"
+};
+
+static void record(uint8_t counter, uint32_t cycles);
+static void reset(uint8_t counter);
+
+void profile_init(void) {
+	// Time nothing, with no overhead taken off, to find the overhead
+	isr_overhead = 0;
+	overhead = 0;
+	reset(0);
+	PROFILE_ISR_BEGIN();
+	PROFILE_ISR_END(0);
+	isr_overhead = stats[0].min;
+	reset(0);
+	PROFILE_BEGIN(0);
+	PROFILE_END(0);
+	overhead = stats[0].min;
+	for(uint8_t counter = 0; counter < NUM_PROFILE_COUNTERS; counter++) {
+		reset(counter);
+	}
+}
+
+void profile_isr_end(uint8_t counter, uint16_t start) {
+	// Timer 1 only counts cycles when it isn't divided down
+	if((TCCR1B & ((1 << CS12) | (1 << CS11) | (1 << CS10))) != (1 << CS10)) {
+		return;
+	}
+	int16_t cycles = TCNT1 - start;
+	if(cycles < 0) {
+		// The timer was reset in between
+		cycles += LATENCY_PERIOD_CYCLES;
+	}
+	cycles -= isr_overhead;
+	record(counter, cycles < 0 ? 0 : cycles);
+}
+
+void profile_end(uint8_t counter, uint32_t start) {
+	uint32_t cycles = latency_now() - start;
+	record(counter, cycles > overhead ? cycles - overhead : 0);
+}
+
+void profile_dump(uint8_t y) {
+	move_terminal_cursor(10, y);
+	serial_write_P_str("Cycles          Count   Min     Mean    Max");
+	clear_to_end_of_line();
+	for(uint8_t counter = 0; counter < NUM_PROFILE_COUNTERS; counter++) {
+		// Copy the counts and start again, without an interrupt handler
+		// changing them part way through
+		ProfileStats copy;
+		uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+		cli();
+		copy = stats[counter];
+		reset(counter);
+		if(interrupts_on) {
+			sei();
+		}
+
+		move_terminal_cursor(10, y + 1 + counter);
+		clear_to_end_of_line();
+		serial_write_P(names[counter], strlen_P(names[counter]));
+		if(copy.count == 0) {
+			continue;
+		}
+		move_terminal_cursor(26, y + 1 + counter);
+		print_number(copy.count);
+		move_terminal_cursor(34, y + 1 + counter);
+		print_number(copy.min);
+		move_terminal_cursor(42, y + 1 + counter);
+		print_number(copy.sum / copy.count);
+		move_terminal_cursor(50, y + 1 + counter);
+		print_number(copy.max);
+	}
+}
+
+static void record(uint8_t counter, uint32_t cycles) {
+	volatile ProfileStats* s = &stats[counter];
+	if(cycles < s->min) {
+		s->min = cycles;
+	}
+	if(cycles > s->max) {
+		s->max = cycles;
+	}
+	if(s->sum + cycles < s->sum || s->count == UINT16_MAX) {
+		s->sum /= 2;
+		s->count /= 2;
+	}
+	s->sum += cycles;
+	s->count++;
+}
+
+static void reset(uint8_t counter) {
+	stats[counter].min = UINT32_MAX;
+	stats[counter].max = 0;
+	stats[counter].sum = 0;
+	stats[counter].count = 0;
+}
+
+#endif /* PROFILE */
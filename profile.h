@@ -0,0 +1,91 @@
+/*
+ * profile.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Counts how many clock cycles the interrupt handlers and the stages of
+ * the main loop take, keeping the minimum, maximum and mean for each. The
+ * cycles are counted with the cycle clock (see latency_now()).
+ *
+ * Profiling is only compiled in when PROFILE is defined (e.g. with
+ * -DPROFILE), and not in the host simulation. Otherwise all of the macros
+ * below do nothing.
+ *
+ * An interrupt handler is timed by starting it with PROFILE_ISR_BEGIN()
+ * and ending it with PROFILE_ISR_END(counter). These only count cycles
+ * within one timer period, which an interrupt handler should never take,
+ * and only while timer 1 is counting cycles: not during tickless sleep
+ * (see power.h), when it counts at clock/1024. So the pin change handler,
+ * which only runs then, isn't timed.
+ * Anything else is timed by putting it between PROFILE_BEGIN(counter) and
+ * PROFILE_END(counter), which can be used in the same function for
+ * different counters. The time taken by the macros themselves is measured
+ * at startup and left out, but the cycles the compiler adds to enter and
+ * leave an interrupt handler (saving and restoring registers) aren't
+ * counted. Times in the main loop include any interrupts handled during
+ * them.
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+
+#ifdef HOST_SIM
+#undef PROFILE
+#endif
+
+/* What is timed.
+ */
+typedef enum {
+	PROFILE_TIMER1_ISR,
+	PROFILE_TIMER0_ISR,
+	PROFILE_UDRE_ISR,
+	PROFILE_RX_ISR,
+	PROFILE_TIMER2_ISR,
+	PROFILE_SCHEDULER,
+	PROFILE_INPUTS,
+	PROFILE_FLUSH,
+	PROFILE_DRAW,
+	PROFILE_INFORMATION,
+	NUM_PROFILE_COUNTERS
+} ProfileCounter;
+
+#ifdef PROFILE
+
+#include <avr/io.h>
+
+#include "latency.h"
+
+#define PROFILE_ISR_BEGIN() uint16_t profile_isr_start = TCNT1
+#define PROFILE_ISR_END(counter) profile_isr_end((counter), profile_isr_start)
+#define PROFILE_BEGIN(counter) uint32_t profile_start_##counter = latency_now()
+#define PROFILE_END(counter) profile_end((counter), profile_start_##counter)
+
+/* Measure how long the macros take. Called with interrupts off, once
+ * timer 1 is running.
+ */
+void profile_init(void);
+
+/* Print a table of the counts (in cycles) on the terminal, starting at row
+ * y, and start counting again.
+ */
+void profile_dump(uint8_t y);
+
+/* Used by the macros above.
+ */
+void profile_isr_end(uint8_t counter, uint16_t start);
+void profile_end(uint8_t counter, uint32_t start);
+
+#else
+
+#define PROFILE_ISR_BEGIN()
+#define PROFILE_ISR_END(counter)
+#define PROFILE_BEGIN(counter)
+#define PROFILE_END(counter)
+#define profile_init()
+#define profile_dump(y)
+
+#endif /* PROFILE */
+
+#endif /* PROFILE_H_ */
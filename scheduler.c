@@ -0,0 +1,120 @@
+/*
+ * scheduler.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See scheduler.h. Each slot of the wheel is a bit mask of the tasks due
+ * when the wheel reaches it. A task which is due more than one turn of
+ * the wheel away also has a count of the turns left, which scheduler_run()
+ * counts down each time the task comes up.
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "scheduler.h"
+
+#if SCHEDULER_MAX_TASKS > 8
+#error "SCHEDULER_MAX_TASKS must be no more than 8"
+#endif
+
+#define WHEEL_MASK (SCHEDULER_WHEEL_SIZE - 1)
+#define CALLS_PER_TICK (SCHEDULER_TICK_MS * 1000 / SCHEDULER_CALL_PERIOD_US)
+
+// Shared with the interrupt handler
+static volatile uint8_t wheel[SCHEDULER_WHEEL_SIZE];
+static volatile uint8_t wheel_position;
+static volatile uint8_t ready;
+
+// Only used by the main loop
+static SchedulerTask functions[SCHEDULER_MAX_TASKS];
+static uint8_t task_slot[SCHEDULER_MAX_TASKS];
+static uint8_t turns_left[SCHEDULER_MAX_TASKS];
+
+void scheduler_add_task(uint8_t task, SchedulerTask function) {
+	if(task < SCHEDULER_MAX_TASKS) {
+		functions[task] = function;
+	}
+}
+
+void scheduler_start(uint8_t task, uint16_t delay_ms) {
+	if(task >= SCHEDULER_MAX_TASKS) {
+		return;
+	}
+	// Rounded to the nearest tick, so on average tasks run on time
+	uint16_t ticks = (delay_ms + SCHEDULER_TICK_MS / 2) / SCHEDULER_TICK_MS;
+	if(ticks == 0) {
+		ticks = 1;
+	}
+	uint8_t bit = (1 << task);
+
+	// A delay of a whole number of turns lands on the current slot, which
+	// comes up again at the end of the first turn
+	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+	cli();
+	wheel[task_slot[task]] &= ~bit;
+	ready &= ~bit;
+	task_slot[task] = (wheel_position + ((ticks - 1) & WHEEL_MASK) + 1) & WHEEL_MASK;
+	turns_left[task] = (ticks - 1) / SCHEDULER_WHEEL_SIZE;
+	wheel[task_slot[task]] |= bit;
+	if(interrupts_on) {
+		sei();
+	}
+}
+
+void scheduler_cancel(uint8_t task) {
+	if(task >= SCHEDULER_MAX_TASKS) {
+		return;
+	}
+	uint8_t bit = (1 << task);
+	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+	cli();
+	wheel[task_slot[task]] &= ~bit;
+	ready &= ~bit;
+	turns_left[task] = 0;
+	if(interrupts_on) {
+		sei();
+	}
+}
+
+void scheduler_tick(void) {
+	static uint8_t calls = 0;
+	if(++calls < CALLS_PER_TICK) {
+		return;
+	}
+	calls = 0;
+	uint8_t position = (wheel_position + 1) & WHEEL_MASK;
+	wheel_position = position;
+	ready |= wheel[position];
+	wheel[position] = 0;
+}
+
+void scheduler_run(void) {
+	if(!ready) {
+		return;
+	}
+	for(uint8_t task = 0; task < SCHEDULER_MAX_TASKS; task++) {
+		uint8_t bit = (1 << task);
+
+		// The interrupt handler only sets bits in ready, so we can test
+		// the bit without disabling interrupts
+		if(!(ready & bit)) {
+			continue;
+		}
+		cli();
+		ready &= ~bit;
+		if(turns_left[task] > 0) {
+			// Not due yet - wait for the slot to come round again
+			turns_left[task]--;
+			wheel[task_slot[task]] |= bit;
+			sei();
+			continue;
+		}
+		sei();
+		if(functions[task]) {
+			functions[task](task);
+		}
+	}
+}
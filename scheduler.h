@@ -0,0 +1,66 @@
+/*
+ * scheduler.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * A timer wheel for running tasks after a delay, without doing the work
+ * in an interrupt handler. scheduler_tick() is called from the timer 1
+ * interrupt and only moves the wheel on and marks the tasks in the new
+ * slot as ready. The main loop calls scheduler_run(), which runs the
+ * ready tasks.
+ *
+ * Each task is started with scheduler_start() and runs once when its
+ * delay is up. A task which should run regularly starts itself again.
+ * Delays are rounded to scheduler ticks of SCHEDULER_TICK_MS, and a task
+ * runs within a tick of its delay being up (later if the main loop is
+ * busy). Delays longer than the wheel are handled by going round the
+ * wheel more than once.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+
+/* Number of tasks (the tasks are numbered from 0). No more than 8.
+ */
+#define SCHEDULER_MAX_TASKS 8
+
+/* How often scheduler_tick() is called (microseconds), and the length of
+ * a scheduler tick (milliseconds).
+ */
+#define SCHEDULER_CALL_PERIOD_US 500
+#define SCHEDULER_TICK_MS 10
+
+/* Number of slots in the wheel. Must be a power of two.
+ */
+#define SCHEDULER_WHEEL_SIZE 64
+
+/* A task's function is passed its task number, so that one function can
+ * be used for several tasks.
+ */
+typedef void (*SchedulerTask)(uint8_t task);
+
+/* Set up task number task (0 to SCHEDULER_MAX_TASKS-1) to call function.
+ * The task isn't started.
+ */
+void scheduler_add_task(uint8_t task, SchedulerTask function);
+
+/* Run a task once, delay_ms milliseconds from now. If the task had
+ * already been started, it will only run at the new time.
+ */
+void scheduler_start(uint8_t task, uint16_t delay_ms);
+
+/* Stop a task which has been started from running.
+ */
+void scheduler_cancel(uint8_t task);
+
+/* Called every SCHEDULER_CALL_PERIOD_US from an interrupt handler.
+ */
+void scheduler_tick(void);
+
+/* Run any tasks which are due. Called from the main loop.
+ */
+void scheduler_run(void);
+
+#endif /* SCHEDULER_H_ */
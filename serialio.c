@@ -1,333 +1,617 @@
-/*
- * FILE: serialio.c
- *
- * Written by Peter Sutton.
- * 
- * Module to allow standard input/output routines to be used via 
- * serial port 0. The init_serial_stdio() method must be called before
- * any standard IO methods (e.g. printf). We use interrupt-based output
- * and a circular buffer to store output messages. (This allows us 
- * to print many characters at once to the buffer and have them 
- * output by the UART as speed permits.) If the buffer fills up, the
- * put method will either
- * (1) if interrupts are enabled, block until there is room in it, or
- * (2) if interrupts are disabled, will discard the character.
- * Input is blocking - requesting input from stdin will block
- * until a character is available. If interrupts are disabled when 
- * input is sought, then this will block forever.
- * The function input_available() can be used to test whether there is
- * input available to read from stdin.
- *
- */
-
-#include <stdio.h>
-#include <stdint.h>
-
-#include <avr/io.h>
-#include <avr/interrupt.h>
-
-/* System clock rate in Hz. (L at the end indicates this is a long constant) */
-#define SYSCLK 8000000L
-
-/* Global variables */
-/* Circular buffer to hold outgoing characters. The insert_pos variable
- * keeps track of the position (0 to OUTPUT_BUFFER_SIZE-1) that the next
- * outgoing character should be written to. bytes_in_buffer keeps
- * count of the number of characters currently stored in the buffer 
- * (ranging from 0 to OUTPUT_BUFFER_SIZE). This number of bytes immediately
- * prior to the current insert_pos are the bytes waiting to be output.
- * If the insert_pos reaches the end of the buffer it will wrap around
- * to the beginning (assuming those bytes have been output).
- * NOTE - OUTPUT_BUFFER_SIZE can not be larger than 255 without changing
- * the type of the variables below (currently defined as 8 bit unsigned ints).
- */
-#define OUTPUT_BUFFER_SIZE 255
-volatile char out_buffer[OUTPUT_BUFFER_SIZE];
-volatile uint8_t out_insert_pos;
-volatile uint8_t bytes_in_out_buffer;
-
-/* Circular buffer to hold incoming characters. Works on same principle
- * as output buffer
- */
-#define INPUT_BUFFER_SIZE 16
-volatile char input_buffer[INPUT_BUFFER_SIZE];
-volatile uint8_t input_insert_pos;
-volatile uint8_t bytes_in_input_buffer;
-volatile uint8_t input_overrun;
-
-/* Variable to keep track of whether incoming characters are to be echoed
- * back or not.
- */
-static int8_t do_echo;
-
-/* Function prototypes 
- */
-void init_serial_stdio(long baudrate, int8_t echo);
-static int uart_put_char(char, FILE*);
-static int uart_get_char(FILE*);
-
-/* Setup a stream that uses the uart get and put functions. We will
- * make standard input and output use this stream below.
- */
-static FILE myStream = FDEV_SETUP_STREAM(uart_put_char, uart_get_char,
-		_FDEV_SETUP_RW);
-
-void init_serial_stdio(long baudrate, int8_t echo) {
-	uint16_t ubrr;
-	/*
-	 * Initialise our buffers
-	*/
-	out_insert_pos = 0;
-	bytes_in_out_buffer = 0;
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
-	input_overrun = 0;
-	
-	/*
-	 * Record whether we're going to echo characters or not
-	*/
-	do_echo = echo;
-	
-	/* Configure the serial port baud rate */
-	/* (This differs from the datasheet formula so that we get 
-	 * rounding to the nearest integer while using integer division
-	 * (which truncates)).
-	*/
-	ubrr = ((SYSCLK / (8 * baudrate)) + 1)/2 - 1;
-	UBRR0 = ubrr;
-	
-	/*
-	 * Enable transmission and receiving via UART. We don't enable
-	 * the UDR empty interrupt here (we wait until we've got a
-	 * character to transmit).
-	 * NOTE: Interrupts must be enabled globally for this
-	 * library to work, but we do not do this here.
-	*/
-	UCSR0B = (1<<RXEN0)|(1<<TXEN0);
-	
-	/*
-	 * Enable receive complete interrupt 
-	*/
-	UCSR0B  |= (1 <<RXCIE0);
-
-	/* Set up our stream so the put and get functions below are used 
-	 * to write/read characters via the serial port when we use
-	 * stdio functions
-	*/
-	stdout = &myStream;
-	stdin = &myStream;
-}
-
-int8_t serial_input_available(void) {
-	return (bytes_in_input_buffer != 0);
-}
-
-void clear_serial_input_buffer(void) {
-	/* Just adjust our buffer data so it looks empty */
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
-}
-
-static int uart_put_char(char c, FILE* stream) {
-	uint8_t interrupts_enabled;
-	
-	/* Add the character to the buffer for transmission (if there 
-	 * is space to do so). If not we wait until the buffer has space.
-	 * If the character is \n, we output \r (carriage return)
-	 * also.
-	*/
-	if(c == '\n') {
-		uart_put_char('\r', stream);
-	}
-	
-	/* If the buffer is full and interrupts are disabled then we
-	 * abort - we don't output the character since the buffer will
-	 * never be emptied if interrupts are disabled. If the buffer is full
-	 * and interrupts are enabled then we loop until the buffer has 
-	 * enough space. The bytes_in_buffer variable will get modified by the
-	 * ISR which extracts bytes from the buffer.
-	*/
-	interrupts_enabled = bit_is_set(SREG, SREG_I);
-	while(bytes_in_out_buffer >= OUTPUT_BUFFER_SIZE) {
-		if(!interrupts_enabled) {
-			return 1;
-		}		
-		/* else do nothing */
-	}
-	
-	/* Add the character to the buffer for transmission if there
-	 * is space to do so. We advance the insert_pos to the next
-	 * character position. If this is beyond the end of the buffer
-	 * we wrap around back to the beginning of the buffer 
-	 * NOTE: we disable interrupts before modifying the buffer. This
-	 * prevents the ISR from modifying the buffer at the same time.
-	 * We reenable them if they were enabled when we entered the
-	 * function.
-	*/	
-	cli();
-	out_buffer[out_insert_pos++] = c;
-	bytes_in_out_buffer++;
-	if(out_insert_pos == OUTPUT_BUFFER_SIZE) {
-		/* Wrap around buffer pointer if necessary */
-		out_insert_pos = 0;
-	}
-	/* Reenable interrupts (UDR Empty interrupt may have been
-	 * disabled) - we ensure it is now enabled so that it will
-	 * fire and deal with the next character in the buffer. */
-	UCSR0B |= (1 << UDRIE0);
-	if(interrupts_enabled) {
-		sei();
-	}
-	return 0;
-}
-
-int uart_get_char(FILE* stream) {
-	/* Wait until we've received a character */
-	while(bytes_in_input_buffer == 0) {
-		/* do nothing */
-	}
-	
-	/*
-	 * Turn interrupts off and remove a character from the input
-	 * buffer. We reenable interrupts if they were on.
-	 * The pending character is the one which is byte_in_input_buffer
-	 * characters before the insert position (taking into account
-	 * that we may need to wrap around).
-	 */
-	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
-	cli();
-	char c;
-	if(input_insert_pos - bytes_in_input_buffer < 0) {
-		/* Need to wrap around */
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer
-				+ INPUT_BUFFER_SIZE];
-	} else {
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer];
-	}
-	
-	/* Decrement our count of bytes in the input buffer */
-	bytes_in_input_buffer--;
-	if(interrupts_enabled) {
-		sei();
-	}	
-	return c;
-}
-
-/*
- * Define the interrupt handler for UART Data Register Empty (i.e. 
- * another character can be taken from our buffer and written out)
- */
-ISR(USART0_UDRE_vect) 
-{
-	/* Check if we have data in our buffer */
-	if(bytes_in_out_buffer > 0) {
-		/* Yes we do - remove the pending byte and output it
-		 * via the UART. The pending byte (character) is the
-		 * one which is "bytes_in_buffer" characters before the 
-		 * insert_pos (taking into account that we may 
-		 * need to wrap around to the end of the buffer).
-		 */
-		char c;
-		if(out_insert_pos - bytes_in_out_buffer < 0) {
-			/* Need to wrap around */
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer
-				+ OUTPUT_BUFFER_SIZE];
-		} else {
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer];
-		}
-		/* Decrement our count of the number of bytes in the 
-		 * buffer 
-		 */
-		bytes_in_out_buffer--;
-		
-		/* Output the character via the UART */
-		UDR0 = c;
-	} else {
-		/* No data in the buffer. We disable the UART Data
-		 * Register Empty interrupt because otherwise it 
-		 * will trigger again immediately this ISR exits. 
-		 * The interrupt is reenabled when a character is
-		 * placed in the buffer.
-		 */
-		UCSR0B &= ~(1<<UDRIE0);
-	}
-}
-
-/*
- * Define the interrupt handler for UART Receive Complete (i.e. 
- * we can read a character. The character is read and placed in
- * the input buffer.
- */
-
-ISR(USART0_RX_vect) 
-{
-	/* Read the character - we ignore the possibility of overrun. */
-	char c;
-	c = UDR0;
-		
-	if(do_echo && bytes_in_out_buffer < OUTPUT_BUFFER_SIZE) {
-		/* If echoing is enabled and there is output buffer
-		 * space, echo the received character back to the UART.
-		 * (If there is no output buffer space, characters
-		 * will be lost.)
-		 */
-		uart_put_char(c, 0);
-	}
-	
-	/* 
-	 * Check if we have space in our buffer. If not, set the overrun
-	 * flag and throw away the character. (We never clear the 
-	 * overrun flag - it's up to the programmer to check/clear
-	 * this flag if desired.)
-	 */
-	if(bytes_in_input_buffer >= INPUT_BUFFER_SIZE) {
-		input_overrun = 1;
-	} else {
-		/* If the character is a carriage return, turn it into a
-		 * linefeed 
-		*/
-		if (c == '\r') {
-			c = '\n';
-		}
-		
-		/* 
-		 * There is room in the input buffer 
-		 */
-		input_buffer[input_insert_pos++] = c;
-		bytes_in_input_buffer++;
-		if(input_insert_pos == INPUT_BUFFER_SIZE) {
-			/* Wrap around buffer pointer if necessary */
-			input_insert_pos = 0;
-		}
-	}
-}
-
-
-/*
-
- ??????????????????????????????
- ????????? ?????????? ???????????
- ??????????????????????????????
- ??????????????????????????????
- ?????????????? ???? ??????????????
- ????????????? ?????? ?????????????
- ???????????? ???????? ????????????
- ??????????? ?????????? ???????????
- ?????????? ???????????? ??????????
- ????????? ?????????????? ?????????
- ???????? ???????????????? ????????
- ?????????????? ??????????? ???????
- ????????????? ???????????? ???????
- ???????????? ????????????? ???????
- ??????????????????????????????
-
-
- * Deep within the mechanism the engineer works tirelessly.
- * This machine... this beast... its workings so intricate...
- * The clicking of relays echoes through its chambers and
- * the sounds of gears grinding sends shivers down the
- * engineers spine.
- * 
- * "Just one more floor" the engineer whispers, "just one more..."
- 
- */
+/*
+ * FILE: serialio.c
+ *
+ * Written by Peter Sutton.
+ * 
+ * Module to allow standard input/output routines to be used via 
+ * serial port 0. The init_serial_stdio() method must be called before
+ * any standard IO methods (e.g. printf). We use interrupt-based output
+ * and a circular buffer to store output messages. (This allows us 
+ * to print many characters at once to the buffer and have them 
+ * output by the UART as speed permits.) If the buffer fills up, the
+ * put method will either
+ * (1) if interrupts are enabled, follow the output policy (by default
+ *     block until there is room in it - see serial_set_output_policy()), or
+ * (2) if interrupts are disabled, will discard the character.
+ * Input is blocking - requesting input from stdin will block
+ * until a character is available. If interrupts are disabled when 
+ * input is sought, then this will block forever.
+ * The function input_available() can be used to test whether there is
+ * input available to read from stdin.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "serialio.h"
+#include "profile.h"
+
+/* System clock rate in Hz. (L at the end indicates this is a long constant) */
+#define SYSCLK 8000000L
+
+/* Global variables */
+/* Circular buffer to hold outgoing characters. The insert_pos variable
+ * keeps track of the position (0 to OUTPUT_BUFFER_SIZE-1) that the next
+ * outgoing character should be written to. bytes_in_buffer keeps
+ * count of the number of characters currently stored in the buffer 
+ * (ranging from 0 to OUTPUT_BUFFER_SIZE). This number of bytes immediately
+ * prior to the current insert_pos are the bytes waiting to be output.
+ * The extract_pos variable is the position of the first of these (i.e. the
+ * next character the ISR will output).
+ * If the insert_pos reaches the end of the buffer it will wrap around
+ * to the beginning (assuming those bytes have been output).
+ * NOTE - OUTPUT_BUFFER_SIZE can not be larger than 255 without changing
+ * the type of the variables below (currently defined as 8 bit unsigned ints).
+ */
+#define OUTPUT_BUFFER_SIZE 255
+volatile char out_buffer[OUTPUT_BUFFER_SIZE];
+volatile uint8_t out_insert_pos;
+volatile uint8_t out_extract_pos;
+volatile uint8_t bytes_in_out_buffer;
+
+/* What to do when the output buffer is full (see make_room()), whether we
+ * are currently discarding output up to the next escape sequence (for the
+ * COALESCE policy), whether any output has been lost since the last call
+ * to serial_output_was_lost(), the total number of characters discarded
+ * and the largest number of characters there has been in the buffer.
+ */
+static SerialOutputPolicy output_policy;
+static volatile uint8_t coalescing;
+static volatile uint8_t output_lost;
+static volatile uint32_t out_dropped;
+static volatile uint8_t out_high_watermark;
+
+/* Circular buffer to hold incoming characters. Works on same principle
+ * as output buffer. It is big enough to hold a burst of binary commands
+ * (see serial_set_binary_input()). With flow control on, we ask the
+ * sender to stop (XOFF) once the buffer is INPUT_XOFF_LEVEL full, which
+ * leaves room for what was already on its way, and to carry on (XON) once
+ * it is down to INPUT_XON_LEVEL.
+ */
+#define INPUT_BUFFER_SIZE 64
+#define INPUT_XOFF_LEVEL (INPUT_BUFFER_SIZE - 24)
+#define INPUT_XON_LEVEL 16
+#define XON 0x11
+#define XOFF 0x13
+volatile char input_buffer[INPUT_BUFFER_SIZE];
+volatile uint8_t input_insert_pos;
+volatile uint8_t bytes_in_input_buffer;
+volatile uint8_t input_overrun;
+
+/* Whether input is binary (not translated or echoed), whether flow control
+ * is on, whether we have asked the sender to stop, and an XON or XOFF
+ * waiting to be sent ahead of the output buffer (0 if none).
+ */
+static volatile uint8_t binary_input;
+static volatile uint8_t flow_control;
+static volatile uint8_t input_stopped;
+static volatile char flow_char;
+
+/* Variable to keep track of whether incoming characters are to be echoed
+ * back or not.
+ */
+static int8_t do_echo;
+
+/* Function prototypes 
+ */
+void init_serial_stdio(long baudrate, int8_t echo);
+static int uart_put_char(char, FILE*);
+static int uart_get_char(FILE*);
+static void write_block(const char* data, uint8_t len, uint8_t in_flash, uint8_t raw);
+static uint8_t make_room(uint8_t needed, char c);
+static void count_dropped(uint8_t count);
+static void send_flow_char(char c);
+
+/* Setup a stream that uses the uart get and put functions. We will
+ * make standard input and output use this stream below.
+ */
+static FILE myStream = FDEV_SETUP_STREAM(uart_put_char, uart_get_char,
+		_FDEV_SETUP_RW);
+
+void init_serial_stdio(long baudrate, int8_t echo) {
+	uint16_t ubrr;
+	/*
+	 * Initialise our buffers
+	*/
+	out_insert_pos = 0;
+	out_extract_pos = 0;
+	bytes_in_out_buffer = 0;
+	output_policy = SERIAL_OUTPUT_BLOCK;
+	coalescing = 0;
+	output_lost = 0;
+	out_dropped = 0;
+	out_high_watermark = 0;
+	input_insert_pos = 0;
+	bytes_in_input_buffer = 0;
+	input_overrun = 0;
+	binary_input = 0;
+	flow_control = 0;
+	input_stopped = 0;
+	flow_char = 0;
+	
+	/*
+	 * Record whether we're going to echo characters or not
+	*/
+	do_echo = echo;
+	
+	/* Configure the serial port baud rate */
+	/* (This differs from the datasheet formula so that we get 
+	 * rounding to the nearest integer while using integer division
+	 * (which truncates)).
+	*/
+	ubrr = ((SYSCLK / (8 * baudrate)) + 1)/2 - 1;
+	UBRR0 = ubrr;
+	
+	/*
+	 * Enable transmission and receiving via UART. We don't enable
+	 * the UDR empty interrupt here (we wait until we've got a
+	 * character to transmit).
+	 * NOTE: Interrupts must be enabled globally for this
+	 * library to work, but we do not do this here.
+	*/
+	UCSR0B = (1<<RXEN0)|(1<<TXEN0);
+	
+	/*
+	 * Enable receive complete interrupt 
+	*/
+	UCSR0B  |= (1 <<RXCIE0);
+
+	/* Set up our stream so the put and get functions below are used 
+	 * to write/read characters via the serial port when we use
+	 * stdio functions
+	*/
+	stdout = &myStream;
+	stdin = &myStream;
+}
+
+int8_t serial_input_available(void) {
+	return (bytes_in_input_buffer != 0);
+}
+
+void clear_serial_input_buffer(void) {
+	/* Just adjust our buffer data so it looks empty */
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	input_insert_pos = 0;
+	bytes_in_input_buffer = 0;
+	if(input_stopped) {
+		input_stopped = 0;
+		send_flow_char(XON);
+	}
+	if(interrupts_enabled) {
+		sei();
+	}
+}
+
+void serial_set_binary_input(uint8_t on) {
+	binary_input = on;
+}
+
+void serial_set_flow_control(uint8_t on) {
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	flow_control = on;
+	if(!on && input_stopped) {
+		input_stopped = 0;
+		send_flow_char(XON);
+	}
+	if(interrupts_enabled) {
+		sei();
+	}
+}
+
+uint8_t serial_input_was_lost(void) {
+	uint8_t lost = input_overrun;
+	input_overrun = 0;
+	return lost;
+}
+
+static int uart_put_char(char c, FILE* stream) {
+	uint8_t interrupts_enabled;
+	
+	/* Add the character to the buffer for transmission (if there 
+	 * is space to do so). If not we follow the output policy.
+	 * If the character is \n, we output \r (carriage return)
+	 * also.
+	*/
+	if(c == '\n') {
+		uart_put_char('\r', stream);
+	}
+	
+	/* Make sure there is room for the character (or find out that
+	 * it is to be discarded).
+	*/
+	if(!make_room(1, c)) {
+		return 1;
+	}
+	
+	/* Add the character to the buffer for transmission. We advance 
+	 * the insert_pos to the next character position. If this is 
+	 * beyond the end of the buffer we wrap around back to the 
+	 * beginning of the buffer 
+	 * NOTE: we disable interrupts before modifying the buffer. This
+	 * prevents the ISR from modifying the buffer at the same time.
+	 * We reenable them if they were enabled when we entered the
+	 * function.
+	*/	
+	interrupts_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	out_buffer[out_insert_pos++] = c;
+	bytes_in_out_buffer++;
+	if(out_insert_pos == OUTPUT_BUFFER_SIZE) {
+		/* Wrap around buffer pointer if necessary */
+		out_insert_pos = 0;
+	}
+	if(bytes_in_out_buffer > out_high_watermark) {
+		out_high_watermark = bytes_in_out_buffer;
+	}
+	/* Reenable interrupts (UDR Empty interrupt may have been
+	 * disabled) - we ensure it is now enabled so that it will
+	 * fire and deal with the next character in the buffer. */
+	UCSR0B |= (1 << UDRIE0);
+	if(interrupts_enabled) {
+		sei();
+	}
+	return 0;
+}
+
+/* Make sure there is room in the output buffer for needed characters,
+ * the first of which is c. Returns 1 if there is now room, or 0 if the
+ * character(s) are to be discarded (in which case they are counted as
+ * dropped). What happens when the buffer is full depends on the output
+ * policy:
+ * BLOCK - wait until the ISR has output enough characters.
+ * DROP_NEWEST - discard the new character(s).
+ * DROP_OLDEST - discard the oldest characters still waiting to be output.
+ * COALESCE - discard the new character(s), and everything after them up
+ *   to the start of the next escape sequence. Terminal output is normally
+ *   a cursor movement followed by some text, so this means that the
+ *   terminal skips whole updates rather than having the end of one update
+ *   appear somewhere it shouldn't.
+ * Whatever the policy, if the buffer is full and interrupts are disabled
+ * then we discard the character(s) since the buffer will never be emptied.
+ */
+static uint8_t make_room(uint8_t needed, char c) {
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	
+	if(coalescing) {
+		if(c != '\x1b' || OUTPUT_BUFFER_SIZE - bytes_in_out_buffer < needed) {
+			count_dropped(needed);
+			return 0;
+		}
+		/* Start of an escape sequence that fits - start outputting
+		 * again */
+		coalescing = 0;
+	}
+	if(OUTPUT_BUFFER_SIZE - bytes_in_out_buffer >= needed) {
+		return 1;
+	}
+	
+	if(!interrupts_enabled) {
+		count_dropped(needed);
+		return 0;
+	}
+	switch(output_policy) {
+		case SERIAL_OUTPUT_BLOCK:
+		default:
+			/* The bytes_in_buffer variable will get modified by the
+			 * ISR which extracts bytes from the buffer. */
+			while(OUTPUT_BUFFER_SIZE - bytes_in_out_buffer < needed) {
+				/* do nothing */
+			}
+			return 1;
+		case SERIAL_OUTPUT_DROP_NEWEST:
+			count_dropped(needed);
+			return 0;
+		case SERIAL_OUTPUT_DROP_OLDEST:
+			cli();
+			/* (The ISR may have made some room since we checked) */
+			while(OUTPUT_BUFFER_SIZE - bytes_in_out_buffer < needed) {
+				if(++out_extract_pos == OUTPUT_BUFFER_SIZE) {
+					out_extract_pos = 0;
+				}
+				bytes_in_out_buffer--;
+				count_dropped(1);
+			}
+			sei();
+			return 1;
+		case SERIAL_OUTPUT_COALESCE:
+			coalescing = 1;
+			count_dropped(needed);
+			return 0;
+	}
+}
+
+static void count_dropped(uint8_t count) {
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	out_dropped += count;
+	output_lost = 1;
+	if(interrupts_enabled) {
+		sei();
+	}
+}
+
+void serial_write(const char* data, uint8_t len) {
+	write_block(data, len, 0, 0);
+}
+
+void serial_write_P(const char* data, uint8_t len) {
+	write_block(data, len, 1, 0);
+}
+
+void serial_write_raw(const char* data, uint8_t len) {
+	write_block(data, len, 0, 1);
+}
+
+uint8_t serial_output_space(void) {
+	return OUTPUT_BUFFER_SIZE - bytes_in_out_buffer;
+}
+
+/* Add a block of characters to the output buffer. As many characters as
+ * will fit are copied in one go (with interrupts disabled just once). If
+ * they don't all fit, the output policy is followed (see make_room())
+ * just as for uart_put_char(). As with uart_put_char(), \n is output 
+ * as \r\n (unless raw is set).
+ */
+static void write_block(const char* data, uint8_t len, uint8_t in_flash, uint8_t raw) {
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	
+	while(len > 0) {
+		/* Make sure there is room for the next character (two in 
+		 * case we need to insert a \r), or skip it if it is to be
+		 * discarded. */
+		char c = in_flash ? pgm_read_byte(data) : *data;
+		if(!make_room(2, c)) {
+			data++;
+			len--;
+			continue;
+		}
+		
+		cli();
+		uint8_t insert_pos = out_insert_pos;
+		uint8_t space = OUTPUT_BUFFER_SIZE - bytes_in_out_buffer;
+		uint8_t count = 0;
+		while(len > 0 && space >= 2) {
+			c = in_flash ? pgm_read_byte(data) : *data;
+			if(c == '\n' && !raw) {
+				out_buffer[insert_pos] = '\r';
+				if(++insert_pos == OUTPUT_BUFFER_SIZE) {
+					insert_pos = 0;
+				}
+				count++;
+				space--;
+			}
+			out_buffer[insert_pos] = c;
+			if(++insert_pos == OUTPUT_BUFFER_SIZE) {
+				insert_pos = 0;
+			}
+			count++;
+			space--;
+			data++;
+			len--;
+		}
+		out_insert_pos = insert_pos;
+		bytes_in_out_buffer += count;
+		if(bytes_in_out_buffer > out_high_watermark) {
+			out_high_watermark = bytes_in_out_buffer;
+		}
+		/* Make sure the UDR Empty interrupt is enabled so the ISR
+		 * deals with the characters we've added */
+		UCSR0B |= (1 << UDRIE0);
+		if(interrupts_enabled) {
+			sei();
+		}
+	}
+}
+
+void serial_set_output_policy(SerialOutputPolicy policy) {
+	output_policy = policy;
+	coalescing = 0;
+}
+
+uint32_t serial_output_dropped(void) {
+	uint32_t return_value;
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	return_value = out_dropped;
+	if(interrupts_enabled) {
+		sei();
+	}
+	return return_value;
+}
+
+uint8_t serial_output_high_watermark(void) {
+	return out_high_watermark;
+}
+
+uint8_t serial_output_was_lost(void) {
+	uint8_t lost = output_lost;
+	output_lost = 0;
+	return lost;
+}
+
+int uart_get_char(FILE* stream) {
+	/* Wait until we've received a character */
+	while(bytes_in_input_buffer == 0) {
+		/* do nothing */
+	}
+	
+	/*
+	 * Turn interrupts off and remove a character from the input
+	 * buffer. We reenable interrupts if they were on.
+	 * The pending character is the one which is byte_in_input_buffer
+	 * characters before the insert position (taking into account
+	 * that we may need to wrap around).
+	 */
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	char c;
+	if(input_insert_pos - bytes_in_input_buffer < 0) {
+		/* Need to wrap around */
+		c = input_buffer[input_insert_pos - bytes_in_input_buffer
+				+ INPUT_BUFFER_SIZE];
+	} else {
+		c = input_buffer[input_insert_pos - bytes_in_input_buffer];
+	}
+	
+	/* Decrement our count of bytes in the input buffer, and let the
+	 * sender carry on once there is plenty of room */
+	bytes_in_input_buffer--;
+	if(input_stopped && bytes_in_input_buffer <= INPUT_XON_LEVEL) {
+		input_stopped = 0;
+		send_flow_char(XON);
+	}
+	if(interrupts_enabled) {
+		sei();
+	}	
+	return c;
+}
+
+/* Send an XON or XOFF as soon as possible, ahead of anything in the output
+ * buffer. Must be called with interrupts disabled.
+ */
+static void send_flow_char(char c) {
+	if(UCSR0A & (1 << UDRE0)) {
+		UDR0 = c;
+	} else {
+		/* The UDR Empty interrupt sends it next */
+		flow_char = c;
+		UCSR0B |= (1 << UDRIE0);
+	}
+}
+
+/*
+ * Define the interrupt handler for UART Data Register Empty (i.e. 
+ * another character can be taken from our buffer and written out)
+ */
+ISR(USART0_UDRE_vect) 
+{
+	PROFILE_ISR_BEGIN();
+	/* Flow control characters go first. Otherwise check if we
+	 * have data in our buffer */
+	if(flow_char) {
+		UDR0 = flow_char;
+		flow_char = 0;
+	} else if(bytes_in_out_buffer > 0) {
+		/* Yes we do - remove the pending byte (at the
+		 * extract_pos) and output it via the UART. We advance
+		 * the extract_pos, wrapping around to the beginning of
+		 * the buffer if necessary.
+		 */
+		uint8_t extract_pos = out_extract_pos;
+		char c = out_buffer[extract_pos];
+		if(++extract_pos == OUTPUT_BUFFER_SIZE) {
+			extract_pos = 0;
+		}
+		out_extract_pos = extract_pos;
+		/* Decrement our count of the number of bytes in the 
+		 * buffer 
+		 */
+		bytes_in_out_buffer--;
+		
+		/* Output the character via the UART */
+		UDR0 = c;
+	} else {
+		/* No data in the buffer. We disable the UART Data
+		 * Register Empty interrupt because otherwise it 
+		 * will trigger again immediately this ISR exits. 
+		 * The interrupt is reenabled when a character is
+		 * placed in the buffer.
+		 */
+		UCSR0B &= ~(1<<UDRIE0);
+	}
+	PROFILE_ISR_END(PROFILE_UDRE_ISR);
+}
+
+/*
+ * Define the interrupt handler for UART Receive Complete (i.e. 
+ * we can read a character. The character is read and placed in
+ * the input buffer.
+ */
+
+ISR(USART0_RX_vect) 
+{
+	PROFILE_ISR_BEGIN();
+	/* Read the character - we ignore the possibility of overrun. */
+	char c;
+	c = UDR0;
+		
+	if(do_echo && !binary_input && bytes_in_out_buffer < OUTPUT_BUFFER_SIZE) {
+		/* If echoing is enabled and there is output buffer
+		 * space, echo the received character back to the UART.
+		 * (If there is no output buffer space, characters
+		 * will be lost.)
+		 */
+		uart_put_char(c, 0);
+	}
+	
+	/* 
+	 * Check if we have space in our buffer. If not, set the overrun
+	 * flag and throw away the character. (We never clear the 
+	 * overrun flag - it's up to the programmer to check/clear
+	 * this flag if desired.)
+	 */
+	if(bytes_in_input_buffer >= INPUT_BUFFER_SIZE) {
+		input_overrun = 1;
+	} else {
+		/* If the character is a carriage return, turn it into a
+		 * linefeed (unless the input is binary)
+		*/
+		if (c == '\r' && !binary_input) {
+			c = '\n';
+		}
+		
+		/* 
+		 * There is room in the input buffer 
+		 */
+		input_buffer[input_insert_pos++] = c;
+		bytes_in_input_buffer++;
+		if(input_insert_pos == INPUT_BUFFER_SIZE) {
+			/* Wrap around buffer pointer if necessary */
+			input_insert_pos = 0;
+		}
+		/* Ask the sender to stop before the buffer fills */
+		if(flow_control && !input_stopped &&
+				bytes_in_input_buffer >= INPUT_XOFF_LEVEL) {
+			input_stopped = 1;
+			send_flow_char(XOFF);
+		}
+	}
+	PROFILE_ISR_END(PROFILE_RX_ISR);
+}
+
+
+/*
+
+ ??????????????????????????????
+ ????????? ?????????? ???????????
+ ??????????????????????????????
+ ??????????????????????????????
+ ?????????????? ???? ??????????????
+ ????????????? ?????? ?????????????
+ ???????????? ???????? ????????????
+ ??????????? ?????????? ???????????
+ ?????????? ???????????? ??????????
+ ????????? ?????????????? ?????????
+ ???????? ???????????????? ????????
+ ?????????????? ??????????? ???????
+ ????????????? ???????????? ???????
+ ???????????? ????????????? ???????
+ ??????????????????????????????
+
+
+ * Deep within the mechanism the engineer works tirelessly.
+ * This machine... this beast... its workings so intricate...
+ * The clicking of relays echoes through its chambers and
+ * the sounds of gears grinding sends shivers down the
+ * engineers spine.
+ * 
+ * "Just one more floor" the engineer whispers, "just one more..."
+ 
+ */
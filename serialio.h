@@ -1,39 +1,110 @@
-/*
- * serialio.h
- *
- * Author: Peter Sutton
- * 
- * Module to allow standard input/output routines to be used via 
- * serial port 0. The init_serial_stdio() method must be called before
- * any standard IO methods (e.g. printf). We use interrupt-based serial
- * IO and a circular buffer to store output messages. (This allows us 
- * to print many characters at once to the buffer and have them 
- * output by the UART as speed permits.) Interrupts must be enabled 
- * globally for this module to work (after init_serial_stdio() is called).
- *
- */
-
-#ifndef SERIALIO_H_
-#define SERIALIO_H_
-
-#include <stdint.h>
-
-/* Initialise serial IO using the UART. baudrate specifies the desired
- * baud rate (e.g. 19200) and echo determines whether incoming characters
- * are echoed back to the UART output as they are received (zero means no
- * echo, non-zero means echo)
- */
-void init_serial_stdio(long baudrate, int8_t echo);
-
-/* Test if input is available from the serial port. Return 0 if not,
- * non-zero otherwise. If there is input available then it can be read
- * with a suitable standard IO library function, e.g. fgetc().
- */
-int8_t serial_input_available(void);
-
-/* Discard any input waiting to be read from the serial port. (Characters may
- * have been typed when we didn't want them - clear them.
- */
-void clear_serial_input_buffer(void);
-
+/*
+ * serialio.h
+ *
+ * Author: Peter Sutton
+ * 
+ * Module to allow standard input/output routines to be used via 
+ * serial port 0. The init_serial_stdio() method must be called before
+ * any standard IO methods (e.g. printf). We use interrupt-based serial
+ * IO and a circular buffer to store output messages. (This allows us 
+ * to print many characters at once to the buffer and have them 
+ * output by the UART as speed permits.) Interrupts must be enabled 
+ * globally for this module to work (after init_serial_stdio() is called).
+ *
+ */
+
+#ifndef SERIALIO_H_
+#define SERIALIO_H_
+
+#include <stdint.h>
+
+/* Initialise serial IO using the UART. baudrate specifies the desired
+ * baud rate (e.g. 19200) and echo determines whether incoming characters
+ * are echoed back to the UART output as they are received (zero means no
+ * echo, non-zero means echo)
+ */
+void init_serial_stdio(long baudrate, int8_t echo);
+
+/* Test if input is available from the serial port. Return 0 if not,
+ * non-zero otherwise. If there is input available then it can be read
+ * with a suitable standard IO library function, e.g. fgetc().
+ */
+int8_t serial_input_available(void);
+
+/* Discard any input waiting to be read from the serial port. (Characters may
+ * have been typed when we didn't want them - clear them.
+ */
+void clear_serial_input_buffer(void);
+
+/* Binary input: when on, characters are passed on exactly as received
+ * (carriage returns aren't turned into linefeeds and nothing is echoed),
+ * for binary commands such as those in traffic.h.
+ */
+void serial_set_binary_input(uint8_t on);
+
+/* XON/XOFF flow control: when on, we send XOFF (0x13) when the input buffer
+ * is nearly full and XON (0x11) once it has room again. The sender must stop
+ * within 24 characters of an XOFF for no input to be lost.
+ */
+void serial_set_flow_control(uint8_t on);
+
+/* Return non-zero if any input has been lost because the input buffer was
+ * full since this function was last called.
+ */
+uint8_t serial_input_was_lost(void);
+
+/* Output len characters from data (in RAM) or from data_P (in program
+ * memory, e.g. a PSTR() string). The characters are copied into the
+ * output buffer as a block, which is much cheaper than outputting them one
+ * at a time with printf or putchar. As with stdout, \n is sent as \r\n.
+ * serial_write_P_str() outputs a string literal from program memory.
+ */
+void serial_write(const char* data, uint8_t len);
+void serial_write_P(const char* data_P, uint8_t len);
+#define serial_write_P_str(literal) serial_write_P(PSTR(literal), sizeof(literal) - 1)
+
+/* As serial_write(), but for binary data: every byte is sent exactly as it
+ * is (\n isn't turned into \r\n).
+ */
+void serial_write_raw(const char* data, uint8_t len);
+
+/* Return how many characters can be added to the output buffer without
+ * waiting (out of 255).
+ */
+uint8_t serial_output_space(void);
+
+/* What to do with output when the output buffer is full (and interrupts
+ * are enabled):
+ * SERIAL_OUTPUT_BLOCK - wait until there is room (the default)
+ * SERIAL_OUTPUT_DROP_NEWEST - discard the new output
+ * SERIAL_OUTPUT_DROP_OLDEST - discard the oldest output still waiting to
+ *		be sent, to make room for the new output
+ * SERIAL_OUTPUT_COALESCE - discard the new output up to the start of the
+ *		next escape sequence (e.g. the next cursor movement), so that
+ *		terminal updates are skipped whole rather than cut short
+ * Apart from SERIAL_OUTPUT_BLOCK, output never waits for the UART.
+ */
+typedef enum {
+	SERIAL_OUTPUT_BLOCK,
+	SERIAL_OUTPUT_DROP_NEWEST,
+	SERIAL_OUTPUT_DROP_OLDEST,
+	SERIAL_OUTPUT_COALESCE
+} SerialOutputPolicy;
+
+void serial_set_output_policy(SerialOutputPolicy policy);
+
+/* Return the total number of characters discarded because the output
+ * buffer was full, and the largest number of characters that have been
+ * waiting in the output buffer at once (out of 255).
+ */
+uint32_t serial_output_dropped(void);
+uint8_t serial_output_high_watermark(void);
+
+/* Return non-zero if any output has been discarded since this function
+ * was last called. Code which
+ * only sends changes to the terminal can use this to know when to redraw
+ * everything.
+ */
+uint8_t serial_output_was_lost(void);
+
 #endif /* SERIALIO_H_ */
\ No newline at end of file
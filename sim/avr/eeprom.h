@@ -0,0 +1,25 @@
+/*
+ * sim/avr/eeprom.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Stands in for avr-libc's <avr/eeprom.h> in the host simulation. The
+ * EEPROM is an array (defined in hal_sim.c) which starts erased at the
+ * start of each run, and writes finish straight away.
+ */
+
+#ifndef SIM_AVR_EEPROM_H_
+#define SIM_AVR_EEPROM_H_
+
+#include <stdint.h>
+
+#define E2END 1023
+
+extern uint8_t sim_eeprom[E2END + 1];
+
+#define eeprom_is_ready() 1
+#define eeprom_read_byte(address) (sim_eeprom[(uintptr_t)(address)])
+#define eeprom_write_byte(address, value) ((void)(sim_eeprom[(uintptr_t)(address)] = (value)))
+#define eeprom_update_byte(address, value) eeprom_write_byte(address, value)
+
+#endif /* SIM_AVR_EEPROM_H_ */
@@ -0,0 +1,21 @@
+/*
+ * sim/avr/interrupt.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Stands in for avr-libc's <avr/interrupt.h> in the host simulation.
+ * Interrupt handlers become ordinary functions, which the simulation calls
+ * as time passes (see timer0_sim.c). Nothing runs at the same time as the
+ * main loop, so cli() and sei() only keep SREG's I bit up to date.
+ */
+
+#ifndef SIM_AVR_INTERRUPT_H_
+#define SIM_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+#define cli() (SREG &= (uint8_t)~_BV(SREG_I))
+#define sei() (SREG |= _BV(SREG_I))
+
+#endif /* SIM_AVR_INTERRUPT_H_ */
@@ -0,0 +1,47 @@
+/*
+ * sim/avr/io.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Stands in for avr-libc's <avr/io.h> in the host simulation (see sim.c).
+ * Only the registers used by the modules the simulation builds from the
+ * real source are given, as plain variables (defined in hal_sim.c). The
+ * simulation sets PINB to push the buttons. The timers don't count (the
+ * simulation has no clock cycles), so TCNT1 and TIFR1 are always 0, and
+ * the timer 0 set up registers are only written.
+ */
+
+#ifndef SIM_AVR_IO_H_
+#define SIM_AVR_IO_H_
+
+#include <stdint.h>
+
+extern volatile uint8_t SREG;
+extern volatile uint8_t PINB;
+extern volatile uint8_t DDRB;
+extern volatile uint16_t TCNT1;
+extern volatile uint8_t TIFR1;
+extern volatile uint8_t TCNT0;
+extern volatile uint8_t OCR0A;
+extern volatile uint8_t TCCR0A;
+extern volatile uint8_t TCCR0B;
+extern volatile uint8_t TIMSK0;
+extern volatile uint8_t TIFR0;
+
+#define SREG_I 7
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define OCF1A 1
+#define OCF0A 1
+#define OCIE0A 1
+#define WGM01 1
+#define CS01 1
+#define CS00 0
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+#endif /* SIM_AVR_IO_H_ */
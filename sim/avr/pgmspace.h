@@ -0,0 +1,25 @@
+/*
+ * sim/avr/pgmspace.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Stands in for avr-libc's <avr/pgmspace.h> in the host simulation. There
+ * is only one address space on the host, so program memory is just
+ * ordinary (constant) memory.
+ */
+
+#ifndef SIM_AVR_PGMSPACE_H_
+#define SIM_AVR_PGMSPACE_H_
+
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(address))
+#define pgm_read_word(address) (*(address))
+#define pgm_read_ptr(address) (*(address))
+#define strlen_P strlen
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+
+#endif /* SIM_AVR_PGMSPACE_H_ */
@@ -0,0 +1,122 @@
+/*
+ * sim/eventdump.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * Decodes the event log frames (see eventlog.h) in serial output, either
+ * from the simulated controller or from a capture of the board's serial
+ * port, and prints each event as a line like
+ *
+ *	12.345 car 0 door open
+ *
+ * (the time in seconds). Everything between the frames (the terminal
+ * output) is skipped, and so are XON and XOFF, which the controller may
+ * have sent part way through a frame. Escaped bytes are put back before
+ * the check is checked. As a sync byte is always escaped inside a frame,
+ * one which isn't starts a new frame, even if the last one wasn't
+ * finished (it lost some of its bytes). A frame which is cut short or has
+ * the wrong check is counted as bad.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "sim.h"
+#include "eventlog.h"
+#include "dispatch.h"
+
+#define FRAME_LENGTH 5 // After the sync, once the escaped bytes are put back
+
+#define XON 0x11
+#define XOFF 0x13
+
+static uint8_t frame[FRAME_LENGTH];
+static uint8_t frame_length;
+static uint8_t in_frame;
+static uint8_t escaped;
+static uint32_t clock_high;
+static uint32_t bad_frames;
+
+static void print_event(FILE* out);
+
+void sim_event_byte(uint8_t c, FILE* out) {
+	if (c == XON || c == XOFF) {
+		return;
+	}
+	if (c == EVENT_LOG_SYNC) {
+		if (in_frame) {
+			bad_frames++;
+		}
+		in_frame = 1;
+		escaped = 0;
+		frame_length = 0;
+		return;
+	}
+	if (!in_frame) {
+		return;
+	}
+	if (c == EVENT_LOG_ESCAPE) {
+		escaped = 1;
+		return;
+	}
+	if (escaped) {
+		c ^= EVENT_LOG_ESCAPE_XOR;
+		escaped = 0;
+	}
+	frame[frame_length++] = c;
+	if (frame_length < FRAME_LENGTH) {
+		return;
+	}
+	in_frame = 0;
+	uint8_t sum = 0;
+	for (uint8_t i = 0; i < FRAME_LENGTH; i++) {
+		sum += frame[i];
+	}
+	if (sum == 0) {
+		print_event(out);
+	} else {
+		bad_frames++;
+	}
+}
+
+uint32_t sim_event_bad_frames(void) {
+	return bad_frames;
+}
+
+static void print_event(FILE* out) {
+	static const char* const door_phases[4] = {"shut", "arriving", "open", "closing"};
+	uint8_t type = frame[0] >> 4;
+	uint8_t car = frame[0] & 0x0F;
+	uint8_t data = frame[1];
+	uint16_t time = frame[2] | (frame[3] << 8);
+	if (type == EVENT_CLOCK) {
+		clock_high = time;
+		return;
+	}
+	uint32_t ms = (clock_high << 16) | time;
+	fprintf(out, "%lu.%03lu ", (unsigned long)(ms / 1000), (unsigned long)(ms % 1000));
+	switch (type) {
+		case EVENT_LOST:
+			fprintf(out, "%u events lost\n", data);
+			break;
+		case EVENT_PLACED:
+			fprintf(out, "traveller placed on floor %u for floor %u\n", data >> 4, data & 0x0F);
+			break;
+		case EVENT_PICKUP:
+			fprintf(out, "car %u picked up %u on floor %u\n", car, data & 0x0F, data >> 4);
+			break;
+		case EVENT_DROPOFF:
+			fprintf(out, "car %u dropped off %u on floor %u\n", car, data & 0x0F, data >> 4);
+			break;
+		case EVENT_DOOR:
+			fprintf(out, "car %u door %s\n", car, door_phases[data & 3]);
+			break;
+		case EVENT_DIRECTION:
+			fprintf(out, "car %u %s\n", car, data == DIRECTION_UP ? "going up"
+					: data == DIRECTION_DOWN ? "going down" : "stationary");
+			break;
+		default:
+			fprintf(out, "unknown event %u (car %u, data %u)\n", type, car, data);
+			break;
+	}
+}
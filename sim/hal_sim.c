@@ -0,0 +1,100 @@
+/*
+ * sim/hal_sim.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * The board for the host simulation (see hal.h and sim.h). The outputs
+ * are kept in variables for the simulation to look at, and the registers
+ * declared in sim/avr/io.h and the EEPROM live here.
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "hal.h"
+#include "sim.h"
+
+volatile uint8_t SREG;
+volatile uint8_t PINB;
+volatile uint8_t DDRB;
+volatile uint16_t TCNT1;
+volatile uint8_t TIFR1;
+volatile uint8_t TCNT0;
+volatile uint8_t OCR0A;
+volatile uint8_t TCCR0A;
+volatile uint8_t TCCR0B;
+volatile uint8_t TIMSK0;
+volatile uint8_t TIFR0;
+
+// The EEPROM (see sim/avr/eeprom.h), erased
+uint8_t sim_eeprom[E2END + 1] = {[0 ... E2END] = 0xFF};
+
+static uint8_t switches;
+static uint8_t door_leds;
+static uint8_t buzzer_top;
+static uint8_t buzzer_sound;
+static uint8_t buzzer_interrupt;
+static uint16_t timer2_counts;
+
+void hal_init(void) {
+	switches = 0;
+	door_leds = 0;
+	buzzer_top = 0;
+	buzzer_sound = 0;
+	buzzer_interrupt = 0;
+}
+
+uint8_t hal_switches(void) {
+	return switches;
+}
+
+void hal_door_leds(uint8_t on, uint8_t off) {
+	door_leds = (door_leds | (on & 0x0F)) & ~(off & 0x0F);
+}
+
+void hal_seven_seg(uint8_t digit, uint8_t segments) {
+	// Nothing to show
+}
+
+void hal_buzzer(uint8_t top, uint8_t sound) {
+	buzzer_top = top;
+	buzzer_sound = sound;
+}
+
+uint8_t hal_buzzer_on(void) {
+	return buzzer_top != 0 && buzzer_sound;
+}
+
+void hal_buzzer_interrupt(uint8_t on) {
+	if (on && !buzzer_interrupt) {
+		timer2_counts = 0;
+	}
+	buzzer_interrupt = on;
+}
+
+void sim_timer2_ms(void) {
+	// Timer 2 counts 125 times a millisecond and interrupts each time it
+	// has counted to the top value and back to 0
+	if (!buzzer_interrupt) {
+		return;
+	}
+	timer2_counts += 125;
+	while (buzzer_interrupt && timer2_counts > buzzer_top) {
+		timer2_counts -= buzzer_top + 1;
+		TIMER2_OVF_vect();
+	}
+}
+
+void sim_set_switches(uint8_t value) {
+	switches = value & (HAL_SWITCH_FLOOR_MASK | HAL_SWITCH_SLOW);
+}
+
+uint8_t sim_door_leds(void) {
+	return door_leds;
+}
+
+uint8_t sim_buzzer_top(void) {
+	return hal_buzzer_on() ? buzzer_top : 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * sim/ledmatrix_sim.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * The LED matrix for the host simulation (see ledmatrix.h). Only the RAM
+ * copy of the display is kept - nothing is sent anywhere, so flushing
+ * costs nothing.
+ */
+
+#include <stdint.h>
+
+#include "ledmatrix.h"
+
+static MatrixData display;
+
+void ledmatrix_setup(void) {
+	ledmatrix_clear();
+}
+
+void ledmatrix_set_clock_divider(uint8_t clockdivider) {
+}
+
+void ledmatrix_set_command_gap(uint8_t gap_us) {
+}
+
+uint8_t ledmatrix_select_fastest_clock(void) {
+	return 2;
+}
+
+void ledmatrix_update_all(MatrixData data) {
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		copy_matrix_column(data[x], display[x]);
+	}
+}
+
+void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
+	ledmatrix_draw_pixel(x, y, pixel);
+}
+
+void ledmatrix_update_row(uint8_t y, MatrixRow row) {
+	if (y >= MATRIX_NUM_ROWS) {
+		return;
+	}
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		display[x][y] = row[x];
+	}
+}
+
+void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
+	if (x < MATRIX_NUM_COLUMNS) {
+		copy_matrix_column(col, display[x]);
+	}
+}
+
+void ledmatrix_shift_display_left(void) {
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS - 1; x++) {
+		copy_matrix_column(display[x + 1], display[x]);
+	}
+	set_matrix_column_to_colour(display[MATRIX_NUM_COLUMNS - 1], COLOUR_BLACK);
+}
+
+void ledmatrix_shift_display_right(void) {
+	for (uint8_t x = MATRIX_NUM_COLUMNS - 1; x > 0; x--) {
+		copy_matrix_column(display[x - 1], display[x]);
+	}
+	set_matrix_column_to_colour(display[0], COLOUR_BLACK);
+}
+
+void ledmatrix_shift_display_up(void) {
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		for (uint8_t y = MATRIX_NUM_ROWS - 1; y > 0; y--) {
+			display[x][y] = display[x][y - 1];
+		}
+		display[x][0] = COLOUR_BLACK;
+	}
+}
+
+void ledmatrix_shift_display_down(void) {
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		for (uint8_t y = 0; y < MATRIX_NUM_ROWS - 1; y++) {
+			display[x][y] = display[x][y + 1];
+		}
+		display[x][MATRIX_NUM_ROWS - 1] = COLOUR_BLACK;
+	}
+}
+
+void ledmatrix_clear(void) {
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		set_matrix_column_to_colour(display[x], COLOUR_BLACK);
+	}
+}
+
+void ledmatrix_draw_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
+	if (x < MATRIX_NUM_COLUMNS && y < MATRIX_NUM_ROWS) {
+		display[x][y] = pixel;
+	}
+}
+
+void ledmatrix_flush(void) {
+}
+
+uint32_t ledmatrix_bytes_sent(void) {
+	return 0;
+}
+
+uint32_t ledmatrix_bytes_saved(void) {
+	return 0;
+}
+
+void ledmatrix_get_column(uint8_t x, MatrixColumn col) {
+	if (x < MATRIX_NUM_COLUMNS) {
+		copy_matrix_column(display[x], col);
+	}
+}
+
+void copy_matrix_column(MatrixColumn from, MatrixColumn to) {
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		to[y] = from[y];
+	}
+}
+
+void copy_matrix_row(MatrixRow from, MatrixRow to) {
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		to[x] = from[x];
+	}
+}
+
+void set_matrix_column_to_colour(MatrixColumn matrix_column, PixelColour colour) {
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		matrix_column[y] = colour;
+	}
+}
+
+void set_matrix_row_to_colour(MatrixRow matrix_row, PixelColour colour) {
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		matrix_row[x] = colour;
+	}
+}
@@ -0,0 +1,43 @@
+/*
+ * sim/power_sim.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * Sleeping for the host simulation (see power.h). Waiting for the next
+ * interrupt takes no time, since the simulation moves time on between
+ * passes of the main loop itself. Sleeping with the timers stopped is
+ * reported to the simulation, which skips ahead to the next input (or to
+ * the end of the longest time asked for).
+ */
+
+#include <stdint.h>
+
+#include <avr/interrupt.h>
+
+#include "power.h"
+#include "sim.h"
+
+static uint8_t took_tickless_sleep;
+static uint16_t sleep_seconds;
+
+void power_init(void) {
+}
+
+void power_idle(void) {
+}
+
+void power_sleep_tickless(uint16_t max_seconds) {
+	took_tickless_sleep = 1;
+	sleep_seconds = max_seconds;
+	sei();
+}
+
+uint8_t sim_took_tickless_sleep(void) {
+	uint8_t result = took_tickless_sleep;
+	took_tickless_sleep = 0;
+	return result;
+}
+
+uint32_t sim_tickless_sleep_limit(void) {
+	return sleep_seconds ? sleep_seconds * 1000UL : UINT32_MAX;
+}
@@ -0,0 +1,82 @@
+#!/bin/sh
+#
+# sim/regress.sh
+#
+# Author: Alex Holdcroft
+#
+# Regression checks for the controller, run in the host simulation (see
+# sim.c). Builds the simulation and the event log test (test_eventlog.c),
+# then for fixed seeds checks that:
+#	- every policy, and the slow speed, delivers every traveller offered
+#	  in an hour at 4 a minute, with none turned away
+#	- each traffic generator pattern delivers travellers
+#	- no run misses a deadline (see latency.h)
+#	- event log frames are decoded whatever bytes are in them
+# Run from the top directory of the project (extra gcc options, e.g.
+# -DNUM_FLOORS=8, can be given as arguments):
+#
+#	sh sim/regress.sh
+#
+# Prints each failure and "ok" or "FAILED", and exits with 0 only if
+# everything passed.
+
+CC=${CC:-gcc}
+CFLAGS="-std=gnu99 -O2 -DHOST_SIM -Isim -I."
+out=$(mktemp -d) || exit 2
+trap 'rm -rf "$out"' EXIT
+
+$CC $CFLAGS "$@" -o "$out/elevator-sim" \
+	sim/sim.c sim/hal_sim.c sim/ledmatrix_sim.c sim/power_sim.c \
+	sim/serialio_sim.c sim/timer0_sim.c sim/eventdump.c \
+	Elevator-Emulator.c benchmark.c buttons.c dispatch.c display.c \
+	motion.c scheduler.c terminalio.c termrender.c traffic.c \
+	latency.c stats.c eventlog.c sound.c persist.c timer0.c -lm || exit 2
+$CC $CFLAGS "$@" -o "$out/test-eventlog" \
+	sim/test_eventlog.c sim/eventdump.c eventlog.c || exit 2
+
+failures=0
+
+fail() {
+	echo "FAIL: $1: $2"
+	failures=$((failures + 1))
+}
+
+# The value of name in a line of results
+field() {
+	echo "$2" | sed -n "s/.*[[:space:]]$1=\([^[:space:]]*\).*/\1/p"
+}
+
+# Run the simulation with the given options and check its results. With
+# all, every traveller offered must be delivered.
+check_run() {
+	all=$1
+	shift
+	results=$("$out/elevator-sim" "$@") || { fail "$*" "didn't run"; return; }
+	offered=$(field offered "$results")
+	delivered=$(field delivered "$results")
+	if [ "$(field deadline_misses "$results")" != 0 ]; then
+		fail "$*" "deadlines missed: $results"
+	fi
+	if [ "$all" = all ]; then
+		if [ "$delivered" != "$offered" ] || [ "$(field turned_away "$results")" != 0 ]; then
+			fail "$*" "not everyone delivered: $results"
+		fi
+	elif [ "$delivered" -eq 0 ]; then
+		fail "$*" "nobody delivered: $results"
+	fi
+}
+
+for policy in 0 1 2 3; do
+	check_run all -t 3600 -r 4 -s 1 -p $policy
+done
+check_run all -t 3600 -r 4 -s 1 -S
+for pattern in 0 1 2; do
+	check_run some -t 3600 -r 4 -s 1 -g $pattern
+done
+"$out/test-eventlog" > /dev/null || fail test-eventlog "frames decoded wrongly"
+
+if [ $failures -ne 0 ]; then
+	echo FAILED
+	exit 1
+fi
+echo ok
@@ -0,0 +1,136 @@
+/*
+ * sim/serialio_sim.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * The serial port for the host simulation (see serialio.h). Input is
+ * queued by the simulation with sim_serial_input() and, as on the board,
+ * is read through stdin. Output is counted and thrown away, unless echoing
+ * to stdout is turned on.
+ *
+ * stdin is replaced by a glibc custom stream (fopencookie()), just as
+ * init_serial_stdio() on the board points stdin at the UART.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "serialio.h"
+#include "sim.h"
+
+#define INPUT_BUFFER_SIZE 256
+
+static char input_buffer[INPUT_BUFFER_SIZE];
+static uint8_t input_head;
+static uint8_t input_tail;
+static uint8_t echo_output;
+static uint8_t decode_events;
+static uint32_t output_count;
+
+static ssize_t read_input(void* cookie, char* buffer, size_t size);
+
+void init_serial_stdio(long baudrate, int8_t echo) {
+	cookie_io_functions_t functions = {read_input, NULL, NULL, NULL};
+	input_head = 0;
+	input_tail = 0;
+	output_count = 0;
+	stdin = fopencookie(NULL, "r", functions);
+	setvbuf(stdin, NULL, _IONBF, 0);
+}
+
+int8_t serial_input_available(void) {
+	return input_head != input_tail;
+}
+
+void clear_serial_input_buffer(void) {
+	input_tail = input_head;
+}
+
+void serial_write(const char* data, uint8_t len) {
+	output_count += len;
+	if (echo_output) {
+		fwrite(data, 1, len, stdout);
+	}
+	if (decode_events) {
+		for (uint8_t i = 0; i < len; i++) {
+			sim_event_byte(data[i], stdout);
+		}
+	}
+}
+
+void serial_write_P(const char* data_P, uint8_t len) {
+	serial_write(data_P, len);
+}
+
+void serial_write_raw(const char* data, uint8_t len) {
+	// Nothing is translated here anyway
+	serial_write(data, len);
+}
+
+uint8_t serial_output_space(void) {
+	// Output is sent straight away, so the buffer is always empty
+	return 255;
+}
+
+void serial_set_output_policy(SerialOutputPolicy policy) {
+	// Output never has to wait
+}
+
+uint32_t serial_output_dropped(void) {
+	return 0;
+}
+
+uint8_t serial_output_high_watermark(void) {
+	return 0;
+}
+
+uint8_t serial_output_was_lost(void) {
+	return 0;
+}
+
+void serial_set_binary_input(uint8_t on) {
+	// Input is never translated or echoed
+}
+
+void serial_set_flow_control(uint8_t on) {
+	// Input queued by the simulation is never lost
+}
+
+uint8_t serial_input_was_lost(void) {
+	return 0;
+}
+
+void sim_serial_input(char c) {
+	if ((uint8_t)(input_head + 1) != input_tail) {
+		input_buffer[input_head++] = c;
+	}
+}
+
+uint8_t sim_serial_input_empty(void) {
+	return input_head == input_tail;
+}
+
+void sim_serial_echo(uint8_t on) {
+	echo_output = on;
+}
+
+void sim_serial_events(uint8_t on) {
+	decode_events = on;
+}
+
+uint32_t sim_serial_output_count(void) {
+	return output_count;
+}
+
+// Called by the stdio library to read from stdin. Only one character is
+// asked for at a time, since stdin isn't buffered. Returns 0 (end of
+// file) rather than waiting when there is no input.
+static ssize_t read_input(void* cookie, char* buffer, size_t size) {
+	size_t count = 0;
+	while (count < size && input_tail != input_head) {
+		buffer[count++] = input_buffer[input_tail++];
+	}
+	return count;
+}
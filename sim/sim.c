@@ -0,0 +1,240 @@
+/*
+ * sim/sim.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * Runs the elevator controller on the host (e.g. a PC, for regression
+ * tests and benchmarks) in virtual time, much faster than real time.
+ * The controller is built from the same source as on the board, with
+ * ledmatrix.c, serialio.c, power.c and hal.c replaced by the stand-ins
+ * in this directory (and the timers driven by timer0_sim.c). Travellers
+ * arrive at random (but repeatable) times and are placed the same way as
+ * from the terminal: with the switches set to the destination and the
+ * key for the floor they are on, or (with -g) come from the controller's
+ * own traffic generator (see traffic.h). regress.sh checks the results
+ * of fixed-seed runs.
+ *
+ * Build (from the top directory of the project):
+ *
+ *	gcc -std=gnu99 -O2 -DHOST_SIM -Isim -I. -o elevator-sim \
+ *		sim/sim.c sim/hal_sim.c sim/ledmatrix_sim.c sim/power_sim.c \
+ *		sim/serialio_sim.c sim/timer0_sim.c sim/eventdump.c \
+ *		Elevator-Emulator.c benchmark.c buttons.c dispatch.c display.c \
+ *		motion.c scheduler.c terminalio.c termrender.c traffic.c \
+ *		latency.c stats.c eventlog.c sound.c persist.c timer0.c -lm
+ *
+ * (NUM_FLOORS, NUM_CARS etc. can be set with -D as for the board.) Run:
+ *
+ *	./elevator-sim [-t seconds] [-r travellers per minute] [-s seed]
+ *		[-p policy] [-g pattern] [-S] [-v] [-e]
+ *	./elevator-sim -d capture
+ *
+ * -g turns on the traffic generator with the given pattern (0 up peak,
+ * 1 down peak, 2 inter-floor) at the -r rate (whole travellers per
+ * minute, up to 255) and the -s seed (its low 16 bits). -S runs with the
+ * slow speed switch on and -v copies the terminal output to stdout. -e
+ * turns on the event log (see eventlog.h) and prints the events on
+ * stdout. The results are printed as one line of name=value pairs.
+ *
+ * -d just prints the events in a capture of the board's serial output
+ * (e.g. saved by a terminal program after pressing 'e') and exits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "emulator.h"
+#include "dispatch.h"
+#include "building.h"
+#include "hal.h"
+#include "traffic.h"
+#include "latency.h"
+#include "eventlog.h"
+
+// Destinations are set with switches S0 and S1, so only floors 0 to 3 can
+// be chosen, and travellers can only be placed on floors 0 to 9 (by key)
+#define MAX_DESTINATION (NUM_FLOORS < 4 ? NUM_FLOORS - 1 : 3)
+#define MAX_ORIGIN (NUM_FLOORS < 10 ? NUM_FLOORS - 1 : 9)
+
+static uint32_t random_state;
+
+static uint32_t next_random(void);
+static uint32_t time_to_next_arrival(double mean_ms);
+static void place_traveller(uint8_t slow);
+static void send_frame(uint8_t type, const uint8_t* payload, uint8_t length);
+static int dump_events(const char* path);
+
+int main(int argc, char** argv) {
+	uint32_t seconds = 3600;
+	double per_minute = 4.0;
+	uint8_t policy = DISPATCH_POLICY;
+	uint8_t slow = 0;
+	uint8_t events = 0;
+	int pattern = -1;
+	random_state = 1;
+
+	int option;
+	while ((option = getopt(argc, argv, "t:r:s:p:g:Sved:")) != -1) {
+		switch (option) {
+			case 't': seconds = strtoul(optarg, NULL, 0); break;
+			case 'r': per_minute = atof(optarg); break;
+			case 's': random_state = strtoul(optarg, NULL, 0); break;
+			case 'p': policy = atoi(optarg); break;
+			case 'g': pattern = atoi(optarg); break;
+			case 'S': slow = 1; break;
+			case 'v': sim_serial_echo(1); break;
+			case 'e': events = 1; break;
+			case 'd': return dump_events(optarg);
+			default:
+				fprintf(stderr, "usage: %s [-t seconds] [-r per minute] "
+						"[-s seed] [-p policy] [-g pattern] [-S] [-v] [-e]\n"
+						"       %s -d capture\n", argv[0], argv[0]);
+				return 2;
+		}
+	}
+	if (random_state == 0 || per_minute <= 0 || policy >= NUM_DISPATCH_POLICIES) {
+		fprintf(stderr, "%s: the seed and rate must be non-zero and the "
+				"policy 0 to %d\n", argv[0], NUM_DISPATCH_POLICIES - 1);
+		return 2;
+	}
+	if (pattern >= NUM_TRAFFIC_PATTERNS || (pattern >= 0
+			&& ((uint16_t)random_state == 0 || per_minute > 255))) {
+		fprintf(stderr, "%s: the pattern must be 0 to %d, with a rate of at "
+				"most 255 and a seed which is non-zero in its low 16 bits\n",
+				argv[0], NUM_TRAFFIC_PATTERNS - 1);
+		return 2;
+	}
+
+	initialise_hardware();
+	setup_elevator_emulator();
+	dispatch_set_policy(policy);
+	sim_set_switches(slow ? HAL_SWITCH_SLOW : 0);
+	if (events) {
+		sim_serial_events(1);
+		eventlog_set_streaming(1);
+	}
+
+	double mean_ms = 60000.0 / per_minute;
+	uint32_t now = 0;
+	uint32_t end = seconds * 1000UL;
+	uint32_t next_arrival = time_to_next_arrival(mean_ms);
+	if (pattern >= 0) {
+		uint8_t payload[4] = {pattern, (uint8_t)per_minute,
+				random_state & 0xFF, (random_state >> 8) & 0xFF};
+		send_frame(TRAFFIC_GENERATE, payload, sizeof(payload));
+		// The controller places all the travellers itself (and doesn't
+		// count them), so none are placed from here
+		next_arrival = UINT32_MAX;
+	}
+	uint32_t offered = 0;
+	uint32_t passes = 0;
+	clock_t started = clock();
+
+	while (now < end) {
+		// Place the next traveller once the last key has been read
+		if (next_arrival != UINT32_MAX && now >= next_arrival
+				&& sim_serial_input_empty()) {
+			place_traveller(slow);
+			offered++;
+			next_arrival += time_to_next_arrival(mean_ms);
+		}
+
+		// A millisecond passes, then the main loop has its turn
+		sim_tick();
+		now++;
+		run_elevator_emulator();
+		passes++;
+
+		// While the controller sleeps with its timers stopped nothing
+		// happens until the next traveller arrives (or it wakes itself),
+		// so go straight there
+		if (sim_took_tickless_sleep() && next_arrival > now) {
+			uint32_t skip = (next_arrival < end ? next_arrival : end) - now;
+			if (skip > sim_tickless_sleep_limit()) {
+				skip = sim_tickless_sleep_limit();
+			}
+			sim_skip(skip);
+			now += skip;
+		}
+	}
+
+	double wall_seconds = (double)(clock() - started) / CLOCKS_PER_SEC;
+	DispatchStats stats;
+	dispatch_get_stats(&stats);
+	printf("policy=%s floors=%d cars=%d pattern=%d seconds=%lu offered=%lu "
+			"delivered=%u turned_away=%u mean_wait_ms=%lu p95_wait_ms=%u max_wait_ms=%u "
+			"mean_ride_ms=%lu p95_ride_ms=%u passes=%lu "
+			"serial_bytes=%lu deadline_misses=%u wall_s=%.3f speedup=%.0f\n",
+			dispatch_policy_name_P(policy), NUM_FLOORS, NUM_CARS, pattern,
+			(unsigned long)seconds, (unsigned long)offered, stats.delivered,
+			stats.turned_away,
+			(unsigned long)(stats.delivered ? stats.total_wait_time / stats.delivered : 0),
+			stats_p95(&stats.wait_times), stats.wait_times.max,
+			(unsigned long)(stats.delivered ? stats.total_ride_time / stats.delivered : 0),
+			stats_p95(&stats.ride_times),
+			(unsigned long)passes, (unsigned long)sim_serial_output_count(),
+			latency_misses(),
+			wall_seconds, wall_seconds > 0 ? seconds / wall_seconds : 0.0);
+	return 0;
+}
+
+// xorshift32, so that runs with the same seed are the same everywhere
+static uint32_t next_random(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+// Arrivals are a Poisson process, so the times between them are
+// exponentially distributed
+static uint32_t time_to_next_arrival(double mean_ms) {
+	double uniform = (next_random() + 1.0) / 4294967296.0;
+	return (uint32_t)(-log(uniform) * mean_ms) + 1;
+}
+
+static void place_traveller(uint8_t slow) {
+	uint8_t floor = next_random() % (MAX_ORIGIN + 1);
+	uint8_t destination;
+	do {
+		destination = next_random() % (MAX_DESTINATION + 1);
+	} while (destination == floor);
+	sim_set_switches(destination | (slow ? HAL_SWITCH_SLOW : 0));
+	sim_serial_input('0' + floor);
+}
+
+// Queue a traffic command frame (see traffic.h) as serial input
+static void send_frame(uint8_t type, const uint8_t* payload, uint8_t length) {
+	uint8_t sum = type;
+	sim_serial_input(TRAFFIC_SYNC);
+	sim_serial_input(type);
+	for (uint8_t i = 0; i < length; i++) {
+		sim_serial_input(payload[i]);
+		sum += payload[i];
+	}
+	sim_serial_input(-sum);
+}
+
+// Print the events in a capture of serial output
+static int dump_events(const char* path) {
+	FILE* capture = fopen(path, "rb");
+	if (capture == NULL) {
+		perror(path);
+		return 1;
+	}
+	int c;
+	while ((c = getc(capture)) != EOF) {
+		sim_event_byte(c, stdout);
+	}
+	fclose(capture);
+	if (sim_event_bad_frames() > 0) {
+		fprintf(stderr, "%s: %lu frames with the wrong check\n", path,
+				(unsigned long)sim_event_bad_frames());
+	}
+	return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * sim/sim.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * How the host simulation (sim.c) drives the stand-in hardware modules
+ * (hal_sim.c, timer0_sim.c, serialio_sim.c, ledmatrix_sim.c and
+ * power_sim.c).
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* The board's interrupt handlers, which the simulation calls as time
+ * passes.
+ */
+void TIMER0_COMPA_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER2_OVF_vect(void);
+
+/* Move virtual time on by one millisecond, running the timer interrupt
+ * handlers as the board would (the timer 0 handler once, the timer 1
+ * handler twice and the timer 2 handler, if it is on, once per period of
+ * the buzzer's tone). sim_timer2_ms() runs the timer 2 handler for one
+ * millisecond.
+ */
+void sim_tick(void);
+void sim_timer2_ms(void);
+
+/* Move the clock on by ms without running any interrupt handlers, as when
+ * the board sleeps with its timers stopped.
+ */
+void sim_skip(uint32_t ms);
+
+/* Set the switches (see hal.h), and see what the program has done with
+ * the outputs.
+ */
+void sim_set_switches(uint8_t switches);
+uint8_t sim_door_leds(void);
+uint8_t sim_buzzer_top(void);
+
+/* Queue a character of serial input, and find out whether the program has
+ * read everything queued so far.
+ */
+void sim_serial_input(char c);
+uint8_t sim_serial_input_empty(void);
+
+/* Whether serial output is written to stdout (off by default), and the
+ * number of characters output.
+ */
+void sim_serial_echo(uint8_t on);
+uint32_t sim_serial_output_count(void);
+
+/* Whether serial output is also passed to sim_event_byte() (off by
+ * default), to print the event log (see eventlog.h) on stdout.
+ */
+void sim_serial_events(uint8_t on);
+
+/* Decode serial output a byte at a time (see eventdump.c), printing the
+ * events in it on out, and return the number of frames thrown away
+ * because their check was wrong.
+ */
+void sim_event_byte(uint8_t c, FILE* out);
+uint32_t sim_event_bad_frames(void);
+
+/* Return 1 (once) if the program has gone to sleep with its timers stopped
+ * (see power_sleep_tickless()) since this was last called.
+ */
+uint8_t sim_took_tickless_sleep(void);
+
+/* Return the longest the last tickless sleep could last (ms), or
+ * UINT32_MAX if only input ends it.
+ */
+uint32_t sim_tickless_sleep_limit(void);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,140 @@
+/*
+ * sim/test_eventlog.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * Checks that event log frames (see eventlog.h) made by eventlog.c are
+ * decoded by eventdump.c, whatever the bytes in them are, and that a
+ * frame never contains XON (0x11), XOFF (0x13) or a sync byte other than
+ * its first. Every data value is sent, with both time bytes the same
+ * value, so each escaped byte turns up in each position. Then an XON and
+ * XOFF are put part way through a frame (as the controller does when its
+ * input buffer fills) and a frame is cut short. Build (from the top
+ * directory of the project) and run:
+ *
+ *	gcc -std=gnu99 -O2 -DHOST_SIM -Isim -I. -o test-eventlog \
+ *		sim/test_eventlog.c sim/eventdump.c eventlog.c
+ *	./test-eventlog
+ *
+ * It prints "ok" and exits with 0 if everything was right.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+
+#include "sim.h"
+#include "eventlog.h"
+#include "timer0.h"
+#include "serialio.h"
+
+#define XON 0x11
+#define XOFF 0x13
+
+// The stand-ins for the clock and serial output which eventlog.c uses
+volatile uint8_t SREG;
+static uint32_t now;
+static uint8_t output[64];
+static uint8_t output_length;
+
+static int failures;
+
+static void send_event(uint8_t data, uint16_t time);
+static void decode(const uint8_t* bytes, uint8_t length, char* text, size_t size);
+static void check(int ok, const char* what, unsigned value);
+
+uint32_t get_current_time(void) {
+	return now;
+}
+
+uint8_t serial_output_space(void) {
+	return 255;
+}
+
+void serial_write_raw(const char* data, uint8_t len) {
+	memcpy(&output[output_length], data, len);
+	output_length += len;
+}
+
+int main(void) {
+	char text[256];
+	char expected[256];
+	eventlog_set_streaming(1);
+	eventlog_drain();
+	decode(output, output_length, text, sizeof(text));
+	check(text[0] == '\0', "clock event printed", 0);
+
+	for (unsigned value = 0; value <= 255; value++) {
+		uint16_t time = value * 257;
+		send_event(value, time);
+
+		uint8_t syncs = 0;
+		for (uint8_t i = 0; i < output_length; i++) {
+			check(output[i] != XON && output[i] != XOFF, "flow control byte sent", value);
+			syncs += (output[i] == EVENT_LOG_SYNC);
+		}
+		check(syncs == 1 && output[0] == EVENT_LOG_SYNC, "sync byte in frame", value);
+
+		decode(output, output_length, text, sizeof(text));
+		snprintf(expected, sizeof(expected), "%u.%03u traveller placed on floor %u for floor %u\n",
+				time / 1000, time % 1000, value >> 4, value & 0x0F);
+		check(strcmp(text, expected) == 0, "frame decoded wrongly", value);
+	}
+	check(sim_event_bad_frames() == 0, "bad frames", sim_event_bad_frames());
+
+	// An XON and XOFF in the middle of a frame are skipped
+	send_event(EVENT_LOG_SYNC, 0x1113);
+	uint8_t bytes[sizeof(output) + 2];
+	uint8_t length = 0;
+	for (uint8_t i = 0; i < output_length; i++) {
+		bytes[length++] = output[i];
+		if (i == 2) {
+			bytes[length++] = XOFF;
+			bytes[length++] = XON;
+		}
+	}
+	decode(bytes, length, text, sizeof(text));
+	check(strcmp(text, "4.371 traveller placed on floor 10 for floor 5\n") == 0,
+			"frame with flow control decoded wrongly", 0);
+
+	// A frame cut short is bad, and the next one is still found
+	send_event(0x12, 1000);
+	memcpy(bytes, output, 3);
+	send_event(0x21, 2000);
+	memcpy(&bytes[3], output, output_length);
+	decode(bytes, 3 + output_length, text, sizeof(text));
+	check(strcmp(text, "2.000 traveller placed on floor 2 for floor 1\n") == 0,
+			"frame after a short one decoded wrongly", 0);
+	check(sim_event_bad_frames() == 1, "short frame not counted", sim_event_bad_frames());
+
+	if (failures == 0) {
+		printf("ok\n");
+	}
+	return failures != 0;
+}
+
+// Record an event and send it, leaving its frame in output
+static void send_event(uint8_t data, uint16_t time) {
+	now = time;
+	output_length = 0;
+	eventlog_record(EVENT_PLACED, 0, data);
+	eventlog_drain();
+}
+
+// Decode bytes, leaving what is printed in text
+static void decode(const uint8_t* bytes, uint8_t length, char* text, size_t size) {
+	FILE* out = fmemopen(text, size, "w");
+	for (uint8_t i = 0; i < length; i++) {
+		sim_event_byte(bytes[i], out);
+	}
+	fclose(out);
+}
+
+static void check(int ok, const char* what, unsigned value) {
+	if (!ok) {
+		fprintf(stderr, "test-eventlog: %s (%u)\n", what, value);
+		failures++;
+	}
+}
@@ -0,0 +1,30 @@
+/*
+ * sim/timer0_sim.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * The timers for the host simulation. The clock is timer0.c's, but time
+ * only passes when the simulation calls sim_tick() or sim_skip(), not when
+ * a real timer interrupts.
+ */
+
+#include <stdint.h>
+
+#include "timer0.h"
+#include "sim.h"
+
+void sim_tick(void) {
+	// The timer 0 interrupt comes every millisecond
+	TIMER0_COMPA_vect();
+
+	// The timer 1 interrupt comes every 0.5ms
+	TIMER1_COMPA_vect();
+	TIMER1_COMPA_vect();
+
+	// The timer 2 interrupt comes once per period of the buzzer's tone
+	sim_timer2_ms();
+}
+
+void sim_skip(uint32_t ms) {
+	add_to_current_time(ms);
+}
@@ -0,0 +1,16 @@
+/*
+ * sim/util/delay.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Stands in for avr-libc's <util/delay.h> in the host simulation. Busy
+ * waits take no virtual time.
+ */
+
+#ifndef SIM_UTIL_DELAY_H_
+#define SIM_UTIL_DELAY_H_
+
+#define _delay_ms(ms) ((void)(ms))
+#define _delay_us(us) ((void)(us))
+
+#endif /* SIM_UTIL_DELAY_H_ */
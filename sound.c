@@ -0,0 +1,196 @@
+/*
+ * sound.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See sound.h. Each queue has a single producer (sound_play(), from the
+ * main loop) and a single consumer (the timer 2 interrupt handler), so as
+ * with the button queue (see buttons.c) neither needs to turn interrupts
+ * off: the producer only writes the head and the consumer only writes the
+ * tail. Everything else is only changed by the interrupt handler, or with
+ * interrupts off while the handler isn't running.
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "sound.h"
+#include "hal.h"
+#include "profile.h"
+
+#define SOUND_QUEUE_MASK (SOUND_QUEUE_SIZE - 1)
+#if (SOUND_QUEUE_SIZE & SOUND_QUEUE_MASK) != 0 || SOUND_QUEUE_SIZE > 128
+#error "SOUND_QUEUE_SIZE must be a power of two no larger than 128"
+#endif
+
+// Timer 2 counts at clock/64, 125 counts a millisecond
+#define COUNTS_PER_MS 125
+
+// The timer top value used during rests, so the interrupt still comes
+// (every 1ms)
+#define REST_TOP (COUNTS_PER_MS - 1)
+
+static volatile Note queues[SOUND_VOICES][SOUND_QUEUE_SIZE];
+static volatile uint8_t heads[SOUND_VOICES];
+static volatile uint8_t tails[SOUND_VOICES];
+static volatile uint8_t running;
+
+// The note each voice is playing and how many ms of it are left (0 if the
+// voice has nothing to play), the voice the buzzer is playing, how long
+// until the next voice takes a turn, the timer's top value and the timer
+// counts not yet made into a whole ms
+static uint8_t note_top[SOUND_VOICES];
+static uint8_t note_left[SOUND_VOICES];
+static uint8_t current_voice;
+static uint8_t slice_left;
+static uint8_t timer_top;
+static uint16_t counts;
+
+static void next_note(uint8_t voice);
+static uint8_t choose_voice(void);
+static void play(void);
+
+void sound_init(void) {
+	hal_buzzer_interrupt(0);
+	hal_buzzer(0, 0);
+	running = 0;
+	for(uint8_t voice = 0; voice < SOUND_VOICES; voice++) {
+		heads[voice] = 0;
+		tails[voice] = 0;
+		note_left[voice] = 0;
+	}
+}
+
+uint8_t sound_play(uint8_t voice, const Note* tune) {
+	if(voice >= SOUND_VOICES) {
+		return 0;
+	}
+	// Queue all of the tune or none of it, so a tune is never cut short.
+	// The handler only takes notes, so there can be no less room once
+	// this check is passed.
+	uint8_t head = heads[voice];
+	uint8_t length = 0;
+	while(pgm_read_byte(&tune[length].ms) != 0) {
+		if(++length > SOUND_QUEUE_SIZE - (uint8_t)(head - tails[voice])) {
+			return 0;
+		}
+	}
+	uint8_t ms;
+	while((ms = pgm_read_byte(&tune->ms)) != 0) {
+		volatile Note* entry = &queues[voice][head & SOUND_QUEUE_MASK];
+		entry->top = pgm_read_byte(&tune->top);
+		entry->ms = ms;
+		head++;
+		tune++;
+	}
+	// The notes must be in the queue before the head is moved on, as the
+	// interrupt handler can take them as soon as it is
+	heads[voice] = head;
+
+	// Start the interrupt handler if it isn't running
+	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+	cli();
+	if(!running) {
+		for(uint8_t v = 0; v < SOUND_VOICES; v++) {
+			next_note(v);
+		}
+		current_voice = voice;
+		slice_left = SOUND_SLICE_MS;
+		counts = 0;
+		timer_top = 0;
+		running = 1;
+		play();
+		hal_buzzer_interrupt(1);
+	}
+	if(interrupts_on) {
+		sei();
+	}
+	return 1;
+}
+
+uint8_t sound_playing(void) {
+	return running;
+}
+
+ISR(TIMER2_OVF_vect) {
+	PROFILE_ISR_BEGIN();
+	// Another period of the tone (or rest) has gone by
+	counts += timer_top + 1;
+	while(counts >= COUNTS_PER_MS) {
+		counts -= COUNTS_PER_MS;
+		// Move every voice on by a ms, taking the next note from its
+		// queue when the last has finished (or if it had nothing to play)
+		for(uint8_t voice = 0; voice < SOUND_VOICES; voice++) {
+			if(note_left[voice] == 0 || --note_left[voice] == 0) {
+				next_note(voice);
+			}
+		}
+		if(--slice_left == 0 || note_left[current_voice] == 0
+				|| note_top[current_voice] == 0) {
+			slice_left = SOUND_SLICE_MS;
+			current_voice = choose_voice();
+			if(current_voice >= SOUND_VOICES) {
+				break; // Nothing left to play (play() stops the buzzer)
+			}
+		}
+	}
+	play();
+	PROFILE_ISR_END(PROFILE_TIMER2_ISR);
+}
+
+// Take a voice's next note from its queue, if it has one
+static void next_note(uint8_t voice) {
+	uint8_t tail = tails[voice];
+	if(heads[voice] == tail) {
+		note_left[voice] = 0;
+		return;
+	}
+	volatile Note* entry = &queues[voice][tail & SOUND_QUEUE_MASK];
+	note_top[voice] = entry->top;
+	note_left[voice] = entry->ms;
+	tails[voice] = tail + 1;
+}
+
+// The next voice after the current one with a tone to play or, if none
+// has, one with a rest (so that time is still counted). Returns
+// SOUND_VOICES if no voice has anything to play.
+static uint8_t choose_voice(void) {
+	uint8_t resting = SOUND_VOICES;
+	uint8_t voice = current_voice;
+	for(uint8_t i = 0; i < SOUND_VOICES; i++) {
+		if(++voice >= SOUND_VOICES) {
+			voice = 0;
+		}
+		if(note_left[voice] != 0) {
+			if(note_top[voice] != 0) {
+				return voice;
+			}
+			resting = voice;
+		}
+	}
+	return resting;
+}
+
+// Set the buzzer to the current voice's note, or stop when there is
+// nothing more to play
+static void play(void) {
+	if(current_voice >= SOUND_VOICES || note_left[current_voice] == 0) {
+		current_voice = choose_voice();
+	}
+	if(current_voice >= SOUND_VOICES) {
+		hal_buzzer_interrupt(0);
+		hal_buzzer(0, 0);
+		timer_top = 0;
+		running = 0;
+		return;
+	}
+	uint8_t top = note_top[current_voice];
+	uint8_t new_top = top ? top : REST_TOP;
+	if(new_top != timer_top || hal_buzzer_on() != (top != 0)) {
+		hal_buzzer(new_top, top != 0);
+		timer_top = new_top;
+	}
+}
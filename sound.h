@@ -0,0 +1,71 @@
+/*
+ * sound.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Tunes on the buzzer, played by the timer 2 interrupt handler with no
+ * help from the main loop. A tune is a list of notes in program memory,
+ * each a tone (or a rest) and how long it lasts, ending with SOUND_END.
+ * It is played on one of SOUND_VOICES voices, each with a queue of up to
+ * SOUND_QUEUE_SIZE notes waiting to be played, so a tune started while
+ * the voice is busy follows on after what it is playing.
+ *
+ * The buzzer can only play one tone at a time, so while more than one
+ * voice has a tone to play they take turns every SOUND_SLICE_MS. The
+ * voices overlap (as a warble) rather than waiting for each other, and
+ * each voice's notes still start and stop at their own times.
+ *
+ * Timer 2 drives the buzzer (see hal.h) and interrupts once per period of
+ * the tone (less often than every 2ms, at the lowest tones), which is used
+ * to count the milliseconds. It only interrupts while something is playing.
+ */
+
+#ifndef SOUND_H_
+#define SOUND_H_
+
+#include <stdint.h>
+
+#include "hal.h"
+
+/* Number of voices, notes which can wait on each voice (a power of two no
+ * larger than 128) and how long each voice plays for in turn (ms). Can be
+ * changed at compile time.
+ */
+#ifndef SOUND_VOICES
+#define SOUND_VOICES 3
+#endif
+#ifndef SOUND_QUEUE_SIZE
+#define SOUND_QUEUE_SIZE 4
+#endif
+#ifndef SOUND_SLICE_MS
+#define SOUND_SLICE_MS 8
+#endif
+
+/* A note: its timer top value (see HAL_BUZZER_TOP(), so tones from 490Hz
+ * up) or 0 for a rest, and how long it lasts (1 to 255ms).
+ */
+typedef struct {
+	uint8_t top;
+	uint8_t ms;
+} Note;
+
+#define SOUND_NOTE(hz, ms) {HAL_BUZZER_TOP(hz), (ms)}
+#define SOUND_REST(ms) {0, (ms)}
+#define SOUND_END {0, 0}
+
+/* Silence the buzzer and empty the queues. Called once hal_init() has set
+ * up timer 2.
+ */
+void sound_init(void);
+
+/* Queue the notes of tune (in program memory) on voice, and start playing
+ * them if nothing is playing yet. If the whole tune doesn't fit in the
+ * queue none of it is queued. Returns 1 if the tune was queued.
+ */
+uint8_t sound_play(uint8_t voice, const Note* tune);
+
+/* Return 1 if anything is playing (or waiting to be played).
+ */
+uint8_t sound_playing(void);
+
+#endif /* SOUND_H_ */
@@ -1,69 +1,213 @@
-/*
- * spi.c
- *
- * Author: Peter Sutton
- */ 
-
-#include <avr/io.h>
-#include "spi.h"
-
-void spi_setup_master(uint8_t clockdivider) {
-	// Set up SPI communication as a master
-	// Make the SS, MOSI and SCK pins outputs. These are pins
-	// 4, 5 and 7 of port B on the ATmega324A
-	
-	DDRB |= (1<<4)|(1<<5)|(1<<7);
-	
-	// Set the slave select (SS) line high
-	PORTB |= (1<<4);
-	
-	// Set up the SPI control registers SPCR and SPSR:
-	// - SPE bit = 1 (SPI is enabled)
-	// - MSTR bit = 1 (Master Mode)
-	SPCR0 = (1<<SPE0)|(1<<MSTR0);
-	
-	// Set SPR0 and SPR1 bits in SPCR and SPI2X bit in SPSR
-	// based on the given clock divider
-	// Invalid values default to the slowest speed
-	// We consider each bit in turn
-	switch(clockdivider) {
-		case 2:
-		case 8:
-		case 32:
-			SPSR0 = (1<<SPI2X0);
-			break;
-		default:
-			SPSR0 = 0;
-			break;
-	}
-	switch(clockdivider) {
-		case 128:
-			SPCR0 |= (1<<SPR00);
-			// Note this flows through to the next code block
-		case 32:
-		case 64:
-			SPCR0 |= (1<<SPR10);
-			break;
-		case 8:
-		case 16:
-			SPCR0 |= (1<<SPR00);
-			break;
-	}
-	
-	// Take SS (slave select) line low
-	PORTB &= ~(1<<4);
-}
-
-uint8_t spi_send_byte(uint8_t byte) {
-	// Write out the byte to the SPDR0 register. This will initiate
-	// the transfer. We then wait until the most significant byte of
-	// SPSR0 (SPIF0 bit) is set - this indicates that the transfer is
-	// complete. (The final read of SPSR0 followed by a read of SPDR0
-	// will cause the SPIF bit to be reset to 0. See page 173 of the 
-	// ATmega324A datasheet.)
-	SPDR0 = byte;
-	while((SPSR0 & (1<<SPIF0)) == 0) {
-		; // wait
-	}
-	return SPDR0;
+/*
+ * spi.c
+ *
+ * Author: Peter Sutton
+ */ 
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "spi.h"
+
+/* Circular buffer to hold outgoing bytes. Works on the same principle as
+ * the serial output buffer in serialio.c, except that we also keep the
+ * position of the next byte to be sent (so the ISR does not have to work
+ * it out) and the size is a power of two so positions can wrap with a
+ * mask. spi_busy is set while a byte is being shifted out - the SPI
+ * transfer complete interrupt then sends the next byte from the buffer
+ * (if any).
+ */
+#define SPI_BUFFER_SIZE 64
+#define SPI_BUFFER_MASK (SPI_BUFFER_SIZE - 1)
+static volatile uint8_t spi_buffer[SPI_BUFFER_SIZE];
+static volatile uint8_t spi_insert_pos;
+static volatile uint8_t spi_extract_pos;
+static volatile uint8_t bytes_in_spi_buffer;
+static volatile uint8_t spi_busy;
+
+// The clock divider currently in use
+static uint8_t spi_clock_divider;
+
+static void spi_service_polled(void);
+
+void spi_setup_master(uint8_t clockdivider) {
+	// Set up SPI communication as a master
+	// Make the SS, MOSI and SCK pins outputs. These are pins
+	// 4, 5 and 7 of port B on the ATmega324A
+	
+	DDRB |= (1<<4)|(1<<5)|(1<<7);
+	
+	// Set the slave select (SS) line high
+	PORTB |= (1<<4);
+	
+	// Set up the SPI control registers SPCR and SPSR:
+	// - SPE bit = 1 (SPI is enabled)
+	// - MSTR bit = 1 (Master Mode)
+	// - SPIE bit = 1 (Interrupt when a transfer completes)
+	SPCR0 = (1<<SPE0)|(1<<MSTR0)|(1<<SPIE0);
+	
+	// Empty the transmit buffer
+	spi_insert_pos = 0;
+	spi_extract_pos = 0;
+	bytes_in_spi_buffer = 0;
+	spi_busy = 0;
+	
+	spi_set_clock_divider(clockdivider);
+	
+	// Take SS (slave select) line low
+	PORTB &= ~(1<<4);
+}
+
+void spi_set_clock_divider(uint8_t clockdivider) {
+	// Don't change speed part way through sending something
+	spi_wait_idle();
+	
+	// Invalid values default to the slowest speed
+	switch(clockdivider) {
+		case 2:
+		case 4:
+		case 8:
+		case 16:
+		case 32:
+		case 64:
+			break;
+		default:
+			clockdivider = 128;
+			break;
+	}
+	spi_clock_divider = clockdivider;
+
+	// Set SPR0 and SPR1 bits in SPCR and SPI2X bit in SPSR
+	// based on the given clock divider
+	// We consider each bit in turn
+	switch(clockdivider) {
+		case 2:
+		case 8:
+		case 32:
+			SPSR0 = (1<<SPI2X0);
+			break;
+		default:
+			SPSR0 = 0;
+			break;
+	}
+	SPCR0 &= ~((1<<SPR10)|(1<<SPR00));
+	switch(clockdivider) {
+		case 128:
+			SPCR0 |= (1<<SPR00);
+			// Note this flows through to the next code block
+		case 32:
+		case 64:
+			SPCR0 |= (1<<SPR10);
+			break;
+		case 8:
+		case 16:
+			SPCR0 |= (1<<SPR00);
+			break;
+	}
+}
+
+uint8_t spi_get_clock_divider(void) {
+	return spi_clock_divider;
+}
+
+uint8_t spi_send_byte(uint8_t byte) {
+	uint8_t received;
+	
+	// Bytes must go out in order, so first wait for anything queued
+	// to be sent.
+	spi_wait_idle();
+	
+	// Write out the byte to the SPDR0 register. This will initiate
+	// the transfer. We then wait until the most significant byte of
+	// SPSR0 (SPIF0 bit) is set - this indicates that the transfer is
+	// complete. (The final read of SPSR0 followed by a read of SPDR0
+	// will cause the SPIF bit to be reset to 0. See page 173 of the 
+	// ATmega324A datasheet.) The transfer complete interrupt is turned
+	// off while we do this so the ISR doesn't take the flag first.
+	SPCR0 &= ~(1<<SPIE0);
+	SPDR0 = byte;
+	while((SPSR0 & (1<<SPIF0)) == 0) {
+		; // wait
+	}
+	received = SPDR0;
+	SPCR0 |= (1<<SPIE0);
+	return received;
+}
+
+void spi_queue_byte(uint8_t byte) {
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	
+	if(!interrupts_enabled) {
+		// The ISR can't run, so we send everything (including this
+		// byte) ourselves, busy waiting as spi_send_byte() does.
+		spi_wait_idle();
+		SPCR0 &= ~(1<<SPIE0);
+		SPDR0 = byte;
+		while((SPSR0 & (1<<SPIF0)) == 0) {
+			; // wait
+		}
+		(void)SPDR0;
+		SPCR0 |= (1<<SPIE0);
+		return;
+	}
+	
+	// If the buffer is full we wait for the ISR to make room
+	while(bytes_in_spi_buffer >= SPI_BUFFER_SIZE) {
+		; // wait
+	}
+	
+	// Either start the transfer straight away (if the SPI is idle) or
+	// add the byte to the buffer for the ISR to send. Interrupts are
+	// disabled so the ISR doesn't change the buffer at the same time.
+	cli();
+	if(!spi_busy) {
+		spi_busy = 1;
+		SPDR0 = byte;
+	} else {
+		spi_buffer[spi_insert_pos] = byte;
+		spi_insert_pos = (spi_insert_pos + 1) & SPI_BUFFER_MASK;
+		bytes_in_spi_buffer++;
+	}
+	sei();
+}
+
+void spi_wait_idle(void) {
+	if(bit_is_set(SREG, SREG_I)) {
+		while(spi_busy) {
+			; // wait for the ISR to empty the buffer
+		}
+	} else {
+		while(spi_busy) {
+			spi_service_polled();
+		}
+	}
+}
+
+// Do the work of the ISR below when interrupts are disabled. We wait for the
+// current transfer to finish and then start the next one (if any).
+static void spi_service_polled(void) {
+	while((SPSR0 & (1<<SPIF0)) == 0) {
+		; // wait
+	}
+	(void)SPDR0;
+	if(bytes_in_spi_buffer > 0) {
+		SPDR0 = spi_buffer[spi_extract_pos];
+		spi_extract_pos = (spi_extract_pos + 1) & SPI_BUFFER_MASK;
+		bytes_in_spi_buffer--;
+	} else {
+		spi_busy = 0;
+	}
+}
+
+/*
+ * Interrupt handler for SPI transfer complete. If there is another byte
+ * waiting in the buffer, we start sending it, otherwise the SPI is idle.
+ */
+ISR(SPI_STC_vect) {
+	if(bytes_in_spi_buffer > 0) {
+		SPDR0 = spi_buffer[spi_extract_pos];
+		spi_extract_pos = (spi_extract_pos + 1) & SPI_BUFFER_MASK;
+		bytes_in_spi_buffer--;
+	} else {
+		spi_busy = 0;
+	}
 }
\ No newline at end of file
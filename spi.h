@@ -1,18 +1,34 @@
-/*
- * spi.h
- *
- * Author: Peter Sutton
- */ 
-
-#ifndef SPI_H_
-#define SPI_H_
-
-// Set up SPI communication as a master.
-// clockdivider should be one of 2,4,8,16,32,64,128
-void spi_setup_master(uint8_t clockdivider);
-
-// Send and receive an SPI byte. This function will take at least 8 
-// cyles of the divided clock (i.e. will busy wait).
-uint8_t spi_send_byte(uint8_t byte);
-
+/*
+ * spi.h
+ *
+ * Author: Peter Sutton
+ */ 
+
+#ifndef SPI_H_
+#define SPI_H_
+
+// Set up SPI communication as a master.
+// clockdivider should be one of 2,4,8,16,32,64,128
+void spi_setup_master(uint8_t clockdivider);
+
+// Change the SPI clock speed (after any queued bytes have been sent).
+// clockdivider should be one of 2,4,8,16,32,64,128 - any other value
+// selects 128 (the slowest speed).
+void spi_set_clock_divider(uint8_t clockdivider);
+uint8_t spi_get_clock_divider(void);
+
+// Send and receive an SPI byte. This function will take at least 8 
+// cyles of the divided clock (i.e. will busy wait). Any queued bytes
+// are sent first.
+uint8_t spi_send_byte(uint8_t byte);
+
+// Queue a byte to be sent by the SPI interrupt handler and return
+// straight away (unless the queue is full, in which case we wait for
+// room). Received bytes are discarded. If interrupts are disabled the
+// byte is sent immediately, busy waiting as spi_send_byte() does.
+void spi_queue_byte(uint8_t byte);
+
+// Wait until all queued bytes have been sent.
+void spi_wait_idle(void);
+
 #endif /* SPI_H_ */
\ No newline at end of file
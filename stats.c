@@ -0,0 +1,254 @@
+/*
+ * stats.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See stats.h. Welford's method updates the mean and the variance from the
+ * difference between each new value and the mean, which keeps the numbers
+ * small (unlike a sum of squares, which would soon overflow). The variance
+ * is kept in quarters, with the remainder of each division by the count
+ * carried over to the next value, so it is exact apart from the rounding
+ * of the differences (rather than stopping changing once the count is
+ * larger than the changes are).
+ *
+ * The P-squared markers are at the minimum, the 47.5th, 95th and 97.5th
+ * percentiles and the maximum. Each new value moves the positions of the
+ * markers above it up by one. A middle marker which is then more than one
+ * place from where it should be is moved a place towards it, and its
+ * height is adjusted by fitting a parabola through it and its neighbours
+ * (or a straight line, if the parabola gives a height out of order).
+ */
+
+#include <stdint.h>
+
+#include "stats.h"
+
+// Where the markers should be, times 200, is 200 + (n - 1) * desired[i]
+// (e.g. marker 2 is 0.95 of the way from 1 to n)
+static const uint8_t desired[5] = {0, 95, 190, 195, 200};
+
+static void add_marker(RunningStats* stats, uint16_t value);
+static void adjust_marker(RunningStats* stats, uint8_t i);
+static int32_t divide_rounded(int32_t value, int32_t divisor);
+static uint16_t square_root(uint32_t value);
+
+void stats_init(RunningStats* stats) {
+	stats->count = 0;
+	stats->min = UINT16_MAX;
+	stats->max = 0;
+	stats->mean = 0;
+	stats->variance = 0;
+	stats->remainder = 0;
+	for(uint8_t i = 0; i < 5; i++) {
+		stats->marker[i] = 0;
+		stats->position[i] = 0;
+	}
+}
+
+void stats_add(RunningStats* stats, uint16_t value) {
+	if(value < stats->min) {
+		stats->min = value;
+	}
+	if(value > stats->max) {
+		stats->max = value;
+	}
+	if(stats->count < UINT16_MAX) {
+		stats->count++;
+	}
+
+	// The value's difference from the mean before and after the mean is
+	// updated. They have the same sign (unless rounding gets in the way,
+	// when they are both tiny).
+	int32_t before = ((int32_t)value << 8) - (int32_t)stats->mean;
+	stats->mean += divide_rounded(before, stats->count);
+	int32_t after = ((int32_t)value << 8) - (int32_t)stats->mean;
+	// Their product in quarters, from the differences rounded to halves
+	// (at most UINT32_MAX, which only the largest differences reach)
+	uint32_t product = 0;
+	if((before < 0) == (after < 0)) {
+		uint32_t a = ((before < 0 ? -before : before) + 64) >> 7;
+		uint32_t b = ((after < 0 ? -after : after) + 64) >> 7;
+		product = (a != 0 && b > UINT32_MAX / a) ? UINT32_MAX : a * b;
+	}
+	// variance += (product - variance) / count, carrying the remainder
+	// (which stays below the count) and without going negative
+	uint16_t count = stats->count;
+	if(product >= stats->variance) {
+		uint32_t change = product - stats->variance;
+		uint32_t left = stats->remainder + change % count;
+		stats->variance += change / count;
+		if(left >= count) {
+			stats->variance++;
+			left -= count;
+		}
+		stats->remainder = left;
+	} else {
+		uint32_t change = stats->variance - product;
+		uint16_t left = change % count;
+		stats->variance -= change / count;
+		if(left > stats->remainder) {
+			stats->variance--;
+			stats->remainder += count - left;
+		} else {
+			stats->remainder -= left;
+		}
+	}
+
+	add_marker(stats, value);
+}
+
+uint16_t stats_mean(const RunningStats* stats) {
+	return (stats->mean + 128) >> 8;
+}
+
+uint16_t stats_std_dev(const RunningStats* stats) {
+	// The variance to the nearest quarter (with what the remainder adds)
+	uint32_t variance = stats->variance;
+	if(stats->count != 0 && (uint32_t)stats->remainder * 2 >= stats->count
+			&& variance < UINT32_MAX) {
+		variance++;
+	}
+	// The root is twice the standard deviation, rounded down. Rounding half
+	// of it to the nearest whole number needs nothing more, as the standard
+	// deviation is at least k + 1/2 just when the variance (times 4) is at
+	// least (2k + 1)^2, i.e. when the root is odd.
+	return (square_root(variance) + 1) >> 1;
+}
+
+uint16_t stats_p95(const RunningStats* stats) {
+	uint16_t n = stats->position[4];
+	if(n == 0) {
+		return 0;
+	}
+	if(n < 5) {
+		// The values so far are sorted in the markers - take the one 0.95
+		// of the way from the first to the last
+		return stats->marker[(n - 1) * 19 / 20];
+	}
+	return stats->marker[2];
+}
+
+static void add_marker(RunningStats* stats, uint16_t value) {
+	uint16_t* marker = stats->marker;
+	uint16_t* position = stats->position;
+	uint16_t n = position[4];
+
+	if(n < 5) {
+		// Until there are five values, keep them all in order
+		uint8_t i = n;
+		while(i > 0 && marker[i - 1] > value) {
+			marker[i] = marker[i - 1];
+			i--;
+		}
+		marker[i] = value;
+		for(uint8_t j = 0; j <= n; j++) {
+			position[j] = j + 1;
+		}
+		for(uint8_t j = n + 1; j < 5; j++) {
+			position[j] = n + 1;
+		}
+		return;
+	}
+
+	// Find the markers the value is between (stretching the end markers if
+	// it is outside them), and move up the positions of those above it
+	uint8_t k;
+	if(value < marker[0]) {
+		marker[0] = value;
+		k = 0;
+	} else if(value >= marker[4]) {
+		marker[4] = value;
+		k = 3;
+	} else {
+		k = 0;
+		while(value >= marker[k + 1]) {
+			k++;
+		}
+	}
+	for(uint8_t i = k + 1; i < 5; i++) {
+		position[i]++;
+	}
+
+	// Move the positions back to half way before they get too big, keeping
+	// them in order
+	if(position[4] >= STATS_MAX_POSITION) {
+		for(uint8_t i = 1; i < 5; i++) {
+			position[i] = 1 + (position[i] - 1) / 2;
+			if(position[i] <= position[i - 1]) {
+				position[i] = position[i - 1] + 1;
+			}
+		}
+	}
+
+	for(uint8_t i = 1; i < 4; i++) {
+		adjust_marker(stats, i);
+	}
+}
+
+static void adjust_marker(RunningStats* stats, uint8_t i) {
+	uint16_t* marker = stats->marker;
+	uint16_t* position = stats->position;
+
+	// How far the marker is from where it should be, times 200
+	int32_t offset = 200 + (int32_t)(position[4] - 1) * desired[i]
+			- (int32_t)position[i] * 200;
+	int8_t d;
+	if(offset >= 200 && position[i + 1] - position[i] > 1) {
+		d = 1;
+	} else if(offset <= -200 && position[i - 1] - position[i] < -1) {
+		d = -1;
+	} else {
+		return;
+	}
+
+	// Fit a parabola through the marker and its neighbours. (The positions
+	// are at most STATS_MAX_POSITION, so the products fit in 32 bits.)
+	int32_t q = marker[i];
+	int32_t q_below = marker[i - 1];
+	int32_t q_above = marker[i + 1];
+	int32_t n = position[i];
+	int32_t n_below = position[i - 1];
+	int32_t n_above = position[i + 1];
+	int32_t height = q + d * divide_rounded((n - n_below + d) * (q_above - q) / (n_above - n)
+			+ (n_above - n - d) * (q - q_below) / (n - n_below), n_above - n_below);
+	if(height < q_below || height > q_above
+			|| (height == q && q != (d > 0 ? q_above : q_below))) {
+		// Out of order (or stuck, as the heights are whole numbers), so
+		// use a straight line to the neighbour instead. This always moves
+		// at least 1 towards it, unless they are the same height.
+		if(d > 0) {
+			height = q + (q_above - q + n_above - n - 1) / (n_above - n);
+		} else {
+			height = q - (q - q_below + n - n_below - 1) / (n - n_below);
+		}
+	}
+	marker[i] = height;
+	position[i] += d;
+}
+
+// value / divisor, rounded to the nearest whole number (divisor > 0)
+static int32_t divide_rounded(int32_t value, int32_t divisor) {
+	if(value < 0) {
+		return -((-value + divisor / 2) / divisor);
+	}
+	return (value + divisor / 2) / divisor;
+}
+
+// The integer square root (rounded down), a bit at a time from the top
+static uint16_t square_root(uint32_t value) {
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+	while(bit > value) {
+		bit >>= 2;
+	}
+	while(bit != 0) {
+		if(value >= root + bit) {
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
@@ -0,0 +1,60 @@
+/*
+ * stats.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Running statistics of a series of values (e.g. travellers' wait times),
+ * kept in a fixed amount of space however many values there are: the
+ * count, minimum, maximum, mean and variance (updated with Welford's
+ * method) and an estimate of the 95th percentile (with the P-squared
+ * method of Jain and Chlamtac, which follows it with five markers).
+ * Everything is in whole numbers - values are 0 to 65535, so times in
+ * milliseconds should be limited to that (about a minute) first.
+ *
+ * The 95th percentile is exact for up to 5 values and approaches the true
+ * value as more are added. After STATS_MAX_POSITION values the percentile
+ * markers are moved back to half way, so it follows the more recent
+ * values. The count stops at 65535, after which the mean and variance
+ * also follow the more recent values.
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+
+/* Largest marker position. Positions are kept below this so the marker
+ * arithmetic fits in 32 bits.
+ */
+#define STATS_MAX_POSITION 16384
+
+typedef struct {
+	uint16_t count;
+	uint16_t min;
+	uint16_t max;
+	uint32_t mean; // The mean times 256
+	uint32_t variance; // The variance times 4
+	uint16_t remainder; // What dividing the variance by the count left over
+	// The percentile markers' heights and positions (from 1)
+	uint16_t marker[5];
+	uint16_t position[5];
+} RunningStats;
+
+/* Start again with no values.
+ */
+void stats_init(RunningStats* stats);
+
+/* Add a value.
+ */
+void stats_add(RunningStats* stats, uint16_t value);
+
+/* The mean and standard deviation (both rounded) and 95th percentile
+ * (rounded down), or 0 if there are no values yet. The count, minimum and
+ * maximum can be read from the structure (the minimum and maximum are only
+ * meaningful once the count is non-zero).
+ */
+uint16_t stats_mean(const RunningStats* stats);
+uint16_t stats_std_dev(const RunningStats* stats);
+uint16_t stats_p95(const RunningStats* stats);
+
+#endif /* STATS_H_ */
@@ -1,86 +1,165 @@
-/*
- * terminalio.c
- *
- * Author: Peter Sutton
- */
-
-#include <stdio.h>
-#include <stdint.h>
-
-#include <avr/pgmspace.h>
-
-#include "terminalio.h"
-
-void move_terminal_cursor(int x, int y) {
-    printf_P(PSTR("\x1b[%d;%dH"), y, x);
-}
-
-void normal_display_mode(void) {
-	printf_P(PSTR("\x1b[0m"));
-}
-
-void reverse_video(void) {
-	printf_P(PSTR("\x1b[7m"));
-}
-
-void clear_terminal(void) {
-	printf_P(PSTR("\x1b[2J"));
-}
-
-void clear_to_end_of_line(void) {
-	printf_P(PSTR("\x1b[K"));
-}
-
-void set_display_attribute(DisplayParameter parameter) {
-	printf_P(PSTR("\x1b[%dm"), parameter);
-}
-
-void hide_cursor() {
-	printf_P(PSTR("\x1b[?25l"));
-}
-
-void show_cursor() {
-	printf_P(PSTR("\x1b[?25h"));
-}
-
-void enable_scrolling_for_whole_display(void) {
-	printf_P(PSTR("\x1b[r"));
-}
-
-void set_scroll_region(int8_t y1, int8_t y2) {
-	printf_P(PSTR("\x1b[%d;%dr"), y1, y2);
-}
-
-void scroll_down(void) {
-	printf_P(PSTR("\x1bM"));	// ESC-M
-}
-
-void scroll_up(void) {
-	printf_P(PSTR("\x1b\x44"));	// ESC-D
-}
-
-void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x) {
-	int8_t i;
-	move_terminal_cursor(start_x, y);
-	reverse_video();
-	for(i=start_x; i <= end_x; i++) {
-		printf(" ");	/* No need to use printf_P - printing 
-						 * a single character gets optimised
-						 * to a putchar call 
-						 */
-	}
-	normal_display_mode();
-}
-
-void draw_vertical_line(int8_t x, int8_t start_y, int8_t end_y) {
-	int8_t i;
-	move_terminal_cursor(x, start_y);
-	reverse_video();
-	for(i=start_y; i < end_y; i++) {
-		printf(" ");
-		/* Move down one and back to the left one */
-		printf_P(PSTR("\x1b[B\x1b[D"));
-	}
-	printf(" ");
-	normal_display_mode();
-}
+/*
+ * terminalio.c
+ *
+ * Author: Peter Sutton
+ *
+ * Escape sequences are built in a small buffer and written straight to the
+ * serial output buffer (see serial_write()) rather than through printf, so
+ * none of these functions need the printf formatting code.
+ */
+
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+
+#include "terminalio.h"
+#include "serialio.h"
+
+static char* put_decimal(char* p, uint8_t value);
+static uint8_t clamp_to_uint8(int value);
+
+// Write the decimal digits of value (without leading zeros) at p and return
+// a pointer to just after the last digit. Digits are found by repeated
+// subtraction, which is quicker than division on the AVR for values this
+// small.
+static char* put_decimal(char* p, uint8_t value) {
+	if(value >= 10) {
+		if(value >= 100) {
+			uint8_t hundreds = 0;
+			while(value >= 100) {
+				value -= 100;
+				hundreds++;
+			}
+			*p++ = '0' + hundreds;
+		}
+		uint8_t tens = 0;
+		while(value >= 10) {
+			value -= 10;
+			tens++;
+		}
+		*p++ = '0' + tens;
+	}
+	*p++ = '0' + value;
+	return p;
+}
+
+// Terminal positions and parameters are all small - anything outside 0 to
+// 255 is limited to that range.
+static uint8_t clamp_to_uint8(int value) {
+	if(value < 0) {
+		return 0;
+	} else if(value > 255) {
+		return 255;
+	}
+	return value;
+}
+
+void move_terminal_cursor(int x, int y) {
+	// ESC [ y ; x H
+	char buffer[10];
+	char* p = buffer;
+	*p++ = '\x1b';
+	*p++ = '[';
+	p = put_decimal(p, clamp_to_uint8(y));
+	*p++ = ';';
+	p = put_decimal(p, clamp_to_uint8(x));
+	*p++ = 'H';
+	serial_write(buffer, p - buffer);
+}
+
+void print_number(uint32_t value) {
+	// Values this big need division - fill the buffer from the end
+	char digits[10];
+	uint8_t pos = sizeof(digits);
+	do {
+		digits[--pos] = '0' + (value % 10);
+		value /= 10;
+	} while(value != 0);
+	serial_write(&digits[pos], sizeof(digits) - pos);
+}
+
+void normal_display_mode(void) {
+	serial_write_P_str("\x1b[0m");
+}
+
+void reverse_video(void) {
+	serial_write_P_str("\x1b[7m");
+}
+
+void clear_terminal(void) {
+	serial_write_P_str("\x1b[2J");
+}
+
+void clear_to_end_of_line(void) {
+	serial_write_P_str("\x1b[K");
+}
+
+void set_display_attribute(DisplayParameter parameter) {
+	// ESC [ parameter m
+	char buffer[6];
+	char* p = buffer;
+	*p++ = '\x1b';
+	*p++ = '[';
+	p = put_decimal(p, clamp_to_uint8(parameter));
+	*p++ = 'm';
+	serial_write(buffer, p - buffer);
+}
+
+void hide_cursor() {
+	serial_write_P_str("\x1b[?25l");
+}
+
+void show_cursor() {
+	serial_write_P_str("\x1b[?25h");
+}
+
+void enable_scrolling_for_whole_display(void) {
+	serial_write_P_str("\x1b[r");
+}
+
+void set_scroll_region(int8_t y1, int8_t y2) {
+	// ESC [ y1 ; y2 r
+	char buffer[10];
+	char* p = buffer;
+	*p++ = '\x1b';
+	*p++ = '[';
+	p = put_decimal(p, clamp_to_uint8(y1));
+	*p++ = ';';
+	p = put_decimal(p, clamp_to_uint8(y2));
+	*p++ = 'r';
+	serial_write(buffer, p - buffer);
+}
+
+void scroll_down(void) {
+	serial_write_P_str("\x1bM");	// ESC-M
+}
+
+void scroll_up(void) {
+	serial_write_P_str("\x1b\x44");	// ESC-D
+}
+
+void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x) {
+	static const char spaces[8] PROGMEM = "        ";
+	move_terminal_cursor(start_x, y);
+	reverse_video();
+	// Send the spaces up to 8 at a time
+	int16_t remaining = end_x - start_x + 1;
+	while(remaining > 0) {
+		uint8_t count = remaining > 8 ? 8 : remaining;
+		serial_write_P(spaces, count);
+		remaining -= count;
+	}
+	normal_display_mode();
+}
+
+void draw_vertical_line(int8_t x, int8_t start_y, int8_t end_y) {
+	int8_t i;
+	move_terminal_cursor(x, start_y);
+	reverse_video();
+	for(i=start_y; i < end_y; i++) {
+		/* Print a space then move down one and back to the left one */
+		serial_write_P_str(" \x1b[B\x1b[D");
+	}
+	serial_write_P_str(" ");
+	normal_display_mode();
+}
@@ -0,0 +1,137 @@
+/*
+ * termrender.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See termrender.h for a description of what this does.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+
+#include "termrender.h"
+#include "terminalio.h"
+#include "serialio.h"
+
+/* What we have sent for each field. The value starts at column
+ * x + label_length of row y.
+ */
+typedef struct {
+	const char* label_P;
+	uint8_t x;
+	uint8_t y;
+	uint8_t label_length;
+	uint8_t value_length;
+	char value[TERM_FIELD_WIDTH];
+} TermField;
+
+static TermField fields[TERM_NUM_FIELDS];
+
+/* If two changed parts of a value are separated by fewer than this many
+ * unchanged characters, it is cheaper to resend the unchanged characters
+ * than to move the cursor again, so we send them as one.
+ */
+#define MIN_CURSOR_MOVE_GAP 4
+
+static void update_field(uint8_t field, const char* value, uint8_t length);
+static void draw_field(TermField* f);
+
+void term_field_init(uint8_t field, uint8_t x, uint8_t y, const char* label_P) {
+	if(field >= TERM_NUM_FIELDS) {
+		return;
+	}
+	TermField* f = &fields[field];
+	f->label_P = label_P;
+	f->x = x;
+	f->y = y;
+	f->label_length = strlen_P(label_P);
+	f->value_length = 0;
+	draw_field(f);
+}
+
+void term_field_set(uint8_t field, const char* value) {
+	update_field(field, value, strlen(value));
+}
+
+void term_field_set_P(uint8_t field, const char* value_P) {
+	char value[TERM_FIELD_WIDTH];
+	uint8_t length = strlen_P(value_P);
+	if(length > TERM_FIELD_WIDTH) {
+		length = TERM_FIELD_WIDTH;
+	}
+	memcpy_P(value, value_P, length);
+	update_field(field, value, length);
+}
+
+void term_field_set_number(uint8_t field, uint32_t value) {
+	// Convert to decimal, filling the buffer from the end
+	char digits[10];
+	uint8_t pos = sizeof(digits);
+	do {
+		digits[--pos] = '0' + (value % 10);
+		value /= 10;
+	} while(value != 0);
+	update_field(field, &digits[pos], sizeof(digits) - pos);
+}
+
+void term_redraw_all(void) {
+	for(uint8_t field = 0; field < TERM_NUM_FIELDS; field++) {
+		if(fields[field].label_P) {
+			draw_field(&fields[field]);
+		}
+	}
+}
+
+static void update_field(uint8_t field, const char* value, uint8_t length) {
+	if(field >= TERM_NUM_FIELDS) {
+		return;
+	}
+	if(serial_output_was_lost()) {
+		term_redraw_all();
+	}
+	if(length > TERM_FIELD_WIDTH) {
+		length = TERM_FIELD_WIDTH;
+	}
+	
+	TermField* f = &fields[field];
+	uint8_t x = f->x + f->label_length;
+	uint8_t pos = 0;
+	while(pos < length) {
+		// Skip characters which are already on the terminal
+		if(pos < f->value_length && value[pos] == f->value[pos]) {
+			pos++;
+			continue;
+		}
+		// Find the end of this run of changed characters, joining on
+		// any further runs which are close enough
+		uint8_t end = pos + 1;
+		uint8_t same = 0;
+		while(end + same < length && same < MIN_CURSOR_MOVE_GAP) {
+			if(end + same < f->value_length && value[end + same] == f->value[end + same]) {
+				same++;
+			} else {
+				end += same + 1;
+				same = 0;
+			}
+		}
+		move_terminal_cursor(x + pos, f->y);
+		serial_write(&value[pos], end - pos);
+		pos = end;
+	}
+	if(length < f->value_length) {
+		// The old value was longer, so get rid of the rest of it
+		move_terminal_cursor(x + length, f->y);
+		clear_to_end_of_line();
+	}
+	memcpy(f->value, value, length);
+	f->value_length = length;
+}
+
+static void draw_field(TermField* f) {
+	move_terminal_cursor(f->x, f->y);
+	serial_write_P(f->label_P, f->label_length);
+	serial_write(f->value, f->value_length);
+	clear_to_end_of_line();
+}
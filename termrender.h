@@ -0,0 +1,49 @@
+/*
+ * termrender.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Status fields on the serial terminal which are only redrawn where they
+ * change. Each field is a label (printed once) followed by a value. The
+ * value last sent for each field is remembered, and setting a new value
+ * only sends the characters which differ (e.g. just the digit that
+ * changed in "Current floor: 2").
+ */
+
+#ifndef TERMRENDER_H_
+#define TERMRENDER_H_
+
+#include <stdint.h>
+
+/* Number of fields and the maximum number of characters in a field's
+ * value (longer values are cut short). Both can be changed at compile time.
+ */
+#ifndef TERM_NUM_FIELDS
+#define TERM_NUM_FIELDS 11
+#endif
+#ifndef TERM_FIELD_WIDTH
+#define TERM_FIELD_WIDTH 12
+#endif
+
+/* Set up field number field (0 to TERM_NUM_FIELDS-1) at column x, row y
+ * of the terminal (see terminalio.h) with the given label (a string in
+ * program memory, e.g. PSTR("Current floor: ")). The label is printed
+ * straight away and the value is empty.
+ */
+void term_field_init(uint8_t field, uint8_t x, uint8_t y, const char* label_P);
+
+/* Set the value of a field, sending only the characters that have changed.
+ * If any serial output has been discarded (see serial_output_was_lost())
+ * the terminal may not show what we think it does, so all fields are
+ * redrawn first.
+ */
+void term_field_set(uint8_t field, const char* value);
+void term_field_set_P(uint8_t field, const char* value_P);
+void term_field_set_number(uint8_t field, uint32_t value);
+
+/* Print all of the labels and values again (e.g. after the terminal has
+ * been cleared).
+ */
+void term_redraw_all(void);
+
+#endif /* TERMRENDER_H_ */
@@ -1,79 +1,105 @@
-/*
- * timer0.c
- *
- * Author: Peter Sutton
- *
- * We setup timer0 to generate an interrupt every 1ms
- * We update a global clock tick variable - whose value
- * can be retrieved using the get_clock_ticks() function.
- */
-
-#include <avr/io.h>
-#include <avr/interrupt.h>
-
-#include "timer0.h"
-
-/* Our internal clock tick count - incremented every 
- * millisecond. Will overflow every ~49 days. */
-static volatile uint32_t clockTicks;
-
-/* Set up timer 0 to generate an interrupt every 1ms. 
- * We will divide the clock by 64 and count up to 124.
- * We will therefore get an interrupt every 64 x 125
- * clock cycles, i.e. every 1 milliseconds with an 8MHz
- * clock. 
- * The counter will be reset to 0 when it reaches it's
- * output compare value.
- */
-void init_timer0(void) {
-	/* Reset clock tick count. L indicates a long (32 bit) 
-	 * constant. 
-	 */
-	clockTicks = 0L;
-	
-	/* Clear the timer */
-	TCNT0 = 0;
-
-	/* Set the output compare value to be 124 */
-	OCR0A = 124;
-	
-	/* Set the timer to clear on compare match (CTC mode)
-	 * and to divide the clock by 64. This starts the timer
-	 * running.
-	 */
-	TCCR0A = (1<<WGM01);
-	TCCR0B = (1<<CS01)|(1<<CS00);
-
-	/* Enable an interrupt on output compare match. 
-	 * Note that interrupts have to be enabled globally
-	 * before the interrupts will fire.
-	 */
-	TIMSK0 |= (1<<OCIE0A);
-	
-	/* Make sure the interrupt flag is cleared by writing a 
-	 * 1 to it.
-	 */
-	TIFR0 &= (1<<OCF0A);
-}
-
-uint32_t get_current_time(void) {
-	uint32_t returnValue;
-
-	/* Disable interrupts so we can be sure that the interrupt
-	 * doesn't fire when we've copied just a couple of bytes
-	 * of the value. Interrupts are re-enabled if they were
-	 * enabled at the start.
-	 */
-	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
-	cli();
-	returnValue = clockTicks;
-	if(interruptsOn) {
-		sei();
-	}
-	return returnValue;
-}
-
-ISR(TIMER0_COMPA_vect) {
-	/* Increment our clock tick count */
-	clockTicks++;
-}
+/*
+ * timer0.c
+ *
+ * Author: Peter Sutton
+ *
+ * We setup timer0 to generate an interrupt every 1ms
+ * We update a global clock tick variable - whose value
+ * can be retrieved using the get_clock_ticks() function.
+ * The push buttons are also sampled on every tick (see buttons.c).
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "timer0.h"
+#include "buttons.h"
+#include "profile.h"
+
+/* Our internal clock tick count - incremented every 
+ * millisecond. Will overflow every ~49 days. */
+static volatile uint32_t clockTicks;
+
+/* Set up timer 0 to generate an interrupt every 1ms. 
+ * We will divide the clock by 64 and count up to 124.
+ * We will therefore get an interrupt every 64 x 125
+ * clock cycles, i.e. every 1 milliseconds with an 8MHz
+ * clock. 
+ * The counter will be reset to 0 when it reaches it's
+ * output compare value.
+ */
+void init_timer0(void) {
+	/* Reset clock tick count. L indicates a long (32 bit) 
+	 * constant. 
+	 */
+	clockTicks = 0L;
+	
+	/* Clear the timer */
+	TCNT0 = 0;
+
+	/* Set the output compare value to be 124 */
+	OCR0A = 124;
+	
+	/* Set the timer to clear on compare match (CTC mode)
+	 * and to divide the clock by 64. This starts the timer
+	 * running.
+	 */
+	TCCR0A = (1<<WGM01);
+	TCCR0B = (1<<CS01)|(1<<CS00);
+
+	/* Enable an interrupt on output compare match. 
+	 * Note that interrupts have to be enabled globally
+	 * before the interrupts will fire.
+	 */
+	TIMSK0 |= (1<<OCIE0A);
+	
+	/* Make sure the interrupt flag is cleared by writing a 
+	 * 1 to it.
+	 */
+	TIFR0 &= (1<<OCF0A);
+}
+
+uint32_t get_current_time(void) {
+	uint32_t returnValue;
+
+	/* The value is copied a byte at a time, so the interrupt
+	 * may fire part way through. Rather than disabling
+	 * interrupts, we read it twice and try again if the reads
+	 * differ. The interrupt only fires once a millisecond so
+	 * this almost never takes more than two reads, and two
+	 * reads which match can't have been split by it.
+	 */
+	do {
+		returnValue = clockTicks;
+	} while(returnValue != clockTicks);
+	return returnValue;
+}
+
+uint16_t get_current_time16(void) {
+	uint16_t returnValue;
+
+	/* As above, but only the low two bytes are copied */
+	do {
+		returnValue = (uint16_t)clockTicks;
+	} while(returnValue != (uint16_t)clockTicks);
+	return returnValue;
+}
+
+void add_to_current_time(uint32_t ms) {
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	clockTicks += ms;
+	if(interruptsOn) {
+		sei();
+	}
+}
+
+ISR(TIMER0_COMPA_vect) {
+	PROFILE_ISR_BEGIN();
+	/* Increment our clock tick count */
+	clockTicks++;
+	
+	/* Read the push buttons */
+	button_sample(clockTicks);
+	PROFILE_ISR_END(PROFILE_TIMER0_ISR);
+}
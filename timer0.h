@@ -1,33 +1,45 @@
-/*
- * timer0.h
- *
- * Author: Peter Sutton
- *
- * We set up timer 0 to give us an interrupt
- * every millisecond. Tasks that have to occur
- * regularly (every millisecond or few) can be added 
- * to the interrupt handler (in timer0.c) or can
- * be added to the main event loop that checks the
- * clock tick value. This value (32 bits) can be 
- * obtained using the get_clock_ticks() function.
- * (Any tasks undertaken in the interrupt handler
- * should be kept short so that we don't run the 
- * risk of missing an interrupt in future.)
- */
-
-#ifndef TIMER0_H_
-#define TIMER0_H_
-
-#include <stdint.h>
-
-/* Set up our timer to give us an interrupt every millisecond
- * and update our time reference.
- */
-void init_timer0(void);
-
-/* Return the current clock tick value - milliseconds since the timer was
- * initialised.
- */
-uint32_t get_current_time(void);
-
+/*
+ * timer0.h
+ *
+ * Author: Peter Sutton
+ *
+ * We set up timer 0 to give us an interrupt
+ * every millisecond. Tasks that have to occur
+ * regularly (every millisecond or few) can be added 
+ * to the interrupt handler (in timer0.c) or can
+ * be added to the main event loop that checks the
+ * clock tick value. This value (32 bits) can be 
+ * obtained using the get_clock_ticks() function.
+ * (Any tasks undertaken in the interrupt handler
+ * should be kept short so that we don't run the 
+ * risk of missing an interrupt in future.)
+ */
+
+#ifndef TIMER0_H_
+#define TIMER0_H_
+
+#include <stdint.h>
+
+/* Set up our timer to give us an interrupt every millisecond
+ * and update our time reference.
+ */
+void init_timer0(void);
+
+/* Return the current clock tick value - milliseconds since the timer was
+ * initialised.
+ */
+uint32_t get_current_time(void);
+
+/* Return the low 16 bits of the clock tick value. This is quicker to get
+ * and is enough for measuring times of up to a minute or so - e.g.
+ * (uint16_t)(get_current_time16() - start) >= delay. Neither function
+ * disables interrupts.
+ */
+uint16_t get_current_time16(void);
+
+/* Move the clock on by ms milliseconds, to make up for time when the
+ * timer interrupt was turned off (see power_sleep_tickless()).
+ */
+void add_to_current_time(uint32_t ms);
+
 #endif
\ No newline at end of file
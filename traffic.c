@@ -0,0 +1,259 @@
+/*
+ * traffic.c
+ *
+ * Author: Alex Holdcroft
+ *
+ * See traffic.h. Frames are read a byte at a time by a small state
+ * machine, adding up the check as they go. Arrivals (from a trace or the
+ * generator) are kept in a queue in the order they are due, with the time
+ * each is due and its floor and destination packed into one byte.
+ */
+
+#include <stdint.h>
+
+#include "traffic.h"
+#include "building.h"
+
+#define TRAFFIC_QUEUE_MASK (TRAFFIC_QUEUE_SIZE - 1)
+#if (TRAFFIC_QUEUE_SIZE & TRAFFIC_QUEUE_MASK) != 0 || TRAFFIC_QUEUE_SIZE > 128
+#error "TRAFFIC_QUEUE_SIZE must be a power of two no larger than 128"
+#endif
+
+// An arrival, due at time, with (floor << 4) | destination
+typedef struct {
+	uint32_t time;
+	uint8_t floors;
+} Arrival;
+
+// The queue. The positions are free-running 8 bit counters, as for the
+// button queue (see buttons.c).
+static Arrival queue[TRAFFIC_QUEUE_SIZE];
+static uint8_t queue_head;
+static uint8_t queue_tail;
+
+// Where we are in the frame being read: waiting for TRAFFIC_SYNC, waiting
+// for the type, or the number of payload bytes read so far. The payload is
+// kept until the check has been read.
+#define WAIT_SYNC		0xFF
+#define WAIT_TYPE		0xFE
+#define MAX_PAYLOAD		4
+static uint8_t frame_state = WAIT_SYNC;
+static uint8_t frame_type;
+static uint8_t frame_length;
+static uint8_t frame_sum;
+static uint8_t payload[MAX_PAYLOAD];
+static uint16_t errors;
+
+// Whether a trace is running, the time of its last arrival and when the
+// last frame came
+static uint8_t tracing;
+static uint32_t last_arrival;
+static uint32_t last_frame;
+
+// The generator's pattern (or -1 if it is off), the chance of someone
+// arriving in each step (out of 65536) and its random number state
+static int8_t pattern = -1;
+static uint16_t threshold;
+static uint16_t random_state;
+
+static uint8_t payload_length(uint8_t type);
+static void handle_frame(uint32_t now);
+static void add_arrival(uint32_t time, uint8_t floors);
+static uint16_t next_random(void);
+static uint8_t random_floor(uint8_t n);
+static uint8_t generate_floors(void);
+
+uint8_t traffic_receive(char c, uint32_t now) {
+	uint8_t b = (uint8_t)c;
+	if (frame_state == WAIT_SYNC) {
+		if (b != TRAFFIC_SYNC) {
+			return 0;
+		}
+		frame_state = WAIT_TYPE;
+		frame_sum = 0;
+		return 1;
+	}
+	frame_sum += b;
+	if (frame_state == WAIT_TYPE) {
+		frame_type = b;
+		frame_length = payload_length(b);
+		if (frame_length > MAX_PAYLOAD) {
+			// Unknown type
+			errors++;
+			frame_state = WAIT_SYNC;
+		} else {
+			frame_state = 0;
+		}
+	} else if (frame_state < frame_length) {
+		payload[frame_state++] = b;
+	} else {
+		// This is the check, so the frame is complete
+		if (frame_sum == 0) {
+			handle_frame(now);
+		} else {
+			errors++;
+		}
+		frame_state = WAIT_SYNC;
+	}
+	return 1;
+}
+
+uint8_t traffic_can_receive(void) {
+	return (uint8_t)(queue_head - queue_tail) < TRAFFIC_QUEUE_SIZE;
+}
+
+void traffic_step(uint32_t now) {
+	if (tracing && queue_head == queue_tail
+			&& now - last_frame >= TRAFFIC_TRACE_TIMEOUT_MS) {
+		tracing = 0;
+	}
+	if (pattern < 0 || !traffic_can_receive()) {
+		return;
+	}
+	// One chance in each step for someone to arrive, so arrivals are
+	// (close to) a Poisson process
+	if (next_random() < threshold) {
+		add_arrival(now, generate_floors());
+	}
+}
+
+uint8_t traffic_next_arrival(uint32_t now, uint8_t* floor, uint8_t* destination) {
+	if (queue_head == queue_tail) {
+		return 0;
+	}
+	Arrival* arrival = &queue[queue_tail & TRAFFIC_QUEUE_MASK];
+	// Signed difference, so this works when the clock wraps around
+	if ((int32_t)(now - arrival->time) < 0) {
+		return 0;
+	}
+	*floor = arrival->floors >> 4;
+	*destination = arrival->floors & 0x0F;
+	queue_tail++;
+	return 1;
+}
+
+uint8_t traffic_active(void) {
+	return tracing || pattern >= 0 || queue_head != queue_tail;
+}
+
+int8_t traffic_pattern(void) {
+	return pattern;
+}
+
+uint16_t traffic_errors(void) {
+	return errors;
+}
+
+// The number of payload bytes for each frame type (more than MAX_PAYLOAD
+// for an unknown type)
+static uint8_t payload_length(uint8_t type) {
+	switch (type) {
+		case TRAFFIC_START:
+		case TRAFFIC_STOP:
+			return 0;
+		case TRAFFIC_ARRIVAL:
+			return 3;
+		case TRAFFIC_GENERATE:
+			return 4;
+		default:
+			return 0xFF;
+	}
+}
+
+static void handle_frame(uint32_t now) {
+	last_frame = now;
+	switch (frame_type) {
+		case TRAFFIC_START:
+			tracing = 1;
+			last_arrival = now;
+			break;
+		case TRAFFIC_ARRIVAL: {
+			uint8_t floor = payload[2] >> 4;
+			uint8_t destination = payload[2] & 0x0F;
+			if (floor >= NUM_FLOORS || destination >= NUM_FLOORS
+					|| floor == destination) {
+				errors++;
+				break;
+			}
+			// An arrival without a TRAFFIC_START starts a trace
+			if (!tracing) {
+				tracing = 1;
+				last_arrival = now;
+			}
+			last_arrival += payload[0] | ((uint16_t)payload[1] << 8);
+			add_arrival(last_arrival, payload[2]);
+			break;
+		}
+		case TRAFFIC_GENERATE: {
+			uint16_t seed = payload[2] | ((uint16_t)payload[3] << 8);
+			if (payload[0] >= NUM_TRAFFIC_PATTERNS) {
+				errors++;
+			} else if (seed == 0) {
+				pattern = -1;
+			} else {
+				pattern = payload[0];
+				random_state = seed;
+				// payload[1] travellers per minute is payload[1] in
+				// 60000 / TRAFFIC_STEP_MS steps
+				threshold = (uint16_t)(((uint32_t)payload[1] << 16)
+						/ (60000 / TRAFFIC_STEP_MS));
+			}
+			break;
+		}
+		case TRAFFIC_STOP:
+			tracing = 0;
+			pattern = -1;
+			queue_tail = queue_head;
+			break;
+	}
+}
+
+static void add_arrival(uint32_t time, uint8_t floors) {
+	// Frames aren't read while the queue is full (see traffic_can_receive())
+	// but a trace which ignores flow control could still overfill it
+	if (!traffic_can_receive()) {
+		errors++;
+		return;
+	}
+	Arrival* arrival = &queue[queue_head & TRAFFIC_QUEUE_MASK];
+	arrival->time = time;
+	arrival->floors = floors;
+	queue_head++;
+}
+
+// xorshift16, so that the same seed gives the same traffic
+static uint16_t next_random(void) {
+	random_state ^= random_state << 7;
+	random_state ^= random_state >> 9;
+	random_state ^= random_state << 8;
+	return random_state;
+}
+
+// A random floor from 0 to n-1
+static uint8_t random_floor(uint8_t n) {
+	return ((uint32_t)next_random() * n) >> 16;
+}
+
+// A traveller's floor and destination for the generator's pattern, packed
+// as in a TRAFFIC_ARRIVAL frame
+static uint8_t generate_floors(void) {
+	uint8_t floor;
+	uint8_t destination;
+	// Nine in ten travellers in a peak are going to or from floor 0
+	uint8_t peak = random_floor(10) < 9;
+	if (pattern == TRAFFIC_UP_PEAK && peak) {
+		floor = 0;
+		destination = 1 + random_floor(NUM_FLOORS - 1);
+	} else if (pattern == TRAFFIC_DOWN_PEAK && peak) {
+		floor = 1 + random_floor(NUM_FLOORS - 1);
+		destination = 0;
+	} else {
+		floor = random_floor(NUM_FLOORS);
+		// Any floor but their own
+		destination = random_floor(NUM_FLOORS - 1);
+		if (destination >= floor) {
+			destination++;
+		}
+	}
+	return (floor << 4) | destination;
+}
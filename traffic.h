@@ -0,0 +1,121 @@
+/*
+ * traffic.h
+ *
+ * Author: Alex Holdcroft
+ *
+ * Traveller arrivals from somewhere other than the buttons and keys, to
+ * load the dispatcher the way a real building would. Arrivals come either
+ * from a trace streamed over the serial port, or from a generator on the
+ * board which makes up up-peak, down-peak or inter-floor traffic from a
+ * seed (so a run can be repeated). Times are in milliseconds (see
+ * get_current_time()).
+ *
+ * Commands are binary frames read from the serial port (see
+ * serial_set_binary_input()):
+ *
+ *	TRAFFIC_SYNC, type, payload..., check
+ *
+ * where check makes type, the payload and check add up to 0 (mod 256).
+ * Numbers of more than one byte are sent least significant byte first.
+ * The frame types are:
+ * TRAFFIC_START - no payload. Start a trace: the next arrival's time is
+ *		counted from now
+ * TRAFFIC_ARRIVAL - milliseconds since the last arrival (2 bytes), then
+ *		(floor << 4) | destination
+ * TRAFFIC_GENERATE - pattern (a TrafficPattern), travellers per minute,
+ *		then the seed (2 bytes, 0 stops the generator)
+ * TRAFFIC_STOP - no payload. Stop the trace and the generator and throw
+ *		away any arrivals not yet due
+ * A trace also stops by itself once all of its arrivals have been due and
+ * no frame has come for TRAFFIC_TRACE_TIMEOUT_MS, in case the sender never
+ * sends TRAFFIC_STOP.
+ * Frames with the wrong check, an unknown type or invalid floors are thrown
+ * away and counted (see traffic_errors()), and bytes are then ignored
+ * until the next TRAFFIC_SYNC. Up to TRAFFIC_QUEUE_SIZE arrivals can be
+ * waiting to be due. The sender should use XON/XOFF flow control (see
+ * serial_set_flow_control()), since frames aren't read while the queue is
+ * full.
+ */
+
+#ifndef TRAFFIC_H_
+#define TRAFFIC_H_
+
+#include <stdint.h>
+
+#define TRAFFIC_SYNC		0xA5
+
+#define TRAFFIC_START		1
+#define TRAFFIC_ARRIVAL		2
+#define TRAFFIC_GENERATE	3
+#define TRAFFIC_STOP		4
+
+/* Number of arrivals which can be waiting to be due. Must be a power of
+ * two. Can be changed at compile time.
+ */
+#ifndef TRAFFIC_QUEUE_SIZE
+#define TRAFFIC_QUEUE_SIZE 16
+#endif
+
+/* How often traffic_step() should be called (milliseconds).
+ */
+#define TRAFFIC_STEP_MS 10
+
+/* How long a trace with no arrivals left waits for another frame before
+ * it stops (milliseconds). This is longer than the longest gap between
+ * arrivals, so a sender which sends each arrival as it is due isn't cut
+ * off. Can be changed at compile time.
+ */
+#ifndef TRAFFIC_TRACE_TIMEOUT_MS
+#define TRAFFIC_TRACE_TIMEOUT_MS 70000UL
+#endif
+
+/* Generated traffic patterns:
+ * TRAFFIC_UP_PEAK - most travellers (9 in 10) arrive on floor 0 and go up
+ *		(the morning rush), the rest go between floors
+ * TRAFFIC_DOWN_PEAK - most travellers go down to floor 0 (the evening
+ *		rush)
+ * TRAFFIC_INTER_FLOOR - travellers arrive on any floor and go to any
+ *		other floor
+ */
+typedef enum {
+	TRAFFIC_UP_PEAK,
+	TRAFFIC_DOWN_PEAK,
+	TRAFFIC_INTER_FLOOR,
+	NUM_TRAFFIC_PATTERNS
+} TrafficPattern;
+
+/* Pass a character read from the serial port at time now. Returns 1 if it
+ * was part of a frame, or 0 if it wasn't (it is an ordinary key).
+ */
+uint8_t traffic_receive(char c, uint32_t now);
+
+/* Return 1 if there is room to queue another arrival, i.e. more frames
+ * can be read.
+ */
+uint8_t traffic_can_receive(void);
+
+/* Run the generator (if it is on), queueing anyone who arrives, and stop
+ * a trace which has timed out. Called every TRAFFIC_STEP_MS while
+ * traffic_active().
+ */
+void traffic_step(uint32_t now);
+
+/* If an arrival is due at time now, remove it from the queue, set *floor
+ * and *destination and return 1. Otherwise return 0.
+ */
+uint8_t traffic_next_arrival(uint32_t now, uint8_t* floor, uint8_t* destination);
+
+/* Return 1 if a trace or the generator is running or arrivals are waiting
+ * to be due.
+ */
+uint8_t traffic_active(void);
+
+/* The generator's pattern (see above), or -1 if it is off.
+ */
+int8_t traffic_pattern(void);
+
+/* Number of frames thrown away since startup.
+ */
+uint16_t traffic_errors(void);
+
+#endif /* TRAFFIC_H_ */